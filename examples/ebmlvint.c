@@ -0,0 +1,309 @@
+/*
+ * Compare and time the EBML variable size integer decoders.
+ *
+ * Copyright (c) 2014 struktur AG, Joachim Bauch <bauch@struktur.de>
+ *
+ * This file is part of gstreamer-libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks gst_ebml_vint_length(), gst_ebml_read_vint() and
+ * gst_ebml_read_svint() from the matroska 1.2 sources against the
+ * bit-by-bit decoder they replaced, on edge cases and random input, then
+ * times both. Exits with 1 if any result differs.
+ *
+ * Usage: ebmlvint [benchmark rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ebml-read.h"
+
+#define RANDOM_CASES    1000000
+#define BENCH_VALUES    65536
+#define DEFAULT_ROUNDS  100
+
+static guint failures = 0;
+
+/* the decoder as it was in matroska-demux.c and matroska-parse.c */
+static gint
+old_vint_length (guint8 first)
+{
+  gint len_mask = 0x80, read = 1;
+
+  while (read <= 8 && !(first & len_mask)) {
+    read++;
+    len_mask >>= 1;
+  }
+  return read > 8 ? 0 : read;
+}
+
+static gint
+old_ebmlnum_uint (const guint8 * data, guint size, guint64 * num)
+{
+  gint len_mask = 0x80, read = 1, n = 1, num_ffs = 0;
+  guint64 total;
+
+  if (size <= 0) {
+    return -1;
+  }
+
+  total = data[0];
+  while (read <= 8 && !(total & len_mask)) {
+    read++;
+    len_mask >>= 1;
+  }
+  if (read > 8)
+    return -1;
+
+  if ((total &= (len_mask - 1)) == len_mask - 1)
+    num_ffs++;
+  if (size < read)
+    return -1;
+  while (n < read) {
+    if (data[n] == 0xff)
+      num_ffs++;
+    total = (total << 8) | data[n];
+    n++;
+  }
+
+  if (read == num_ffs && total != 0)
+    *num = G_MAXUINT64;
+  else
+    *num = total;
+
+  return read;
+}
+
+/* the old bias was computed with an int shift, which is only defined up
+ * to 4 bytes; longer numbers are compared against the 64 bit bias */
+static gint
+old_ebmlnum_sint (const guint8 * data, guint size, gint64 * num)
+{
+  guint64 unum;
+  gint res;
+
+  if ((res = old_ebmlnum_uint (data, size, &unum)) < 0)
+    return -1;
+
+  if (unum == G_MAXUINT64)
+    *num = G_MAXINT64;
+  else if (res <= 4)
+    *num = unum - ((1 << ((7 * res) - 1)) - 1);
+  else
+    *num = unum - ((G_GUINT64_CONSTANT (1) << (7 * res - 1)) - 1);
+
+  return res;
+}
+
+static void
+check (const guint8 * data, guint size, const gchar * what)
+{
+  guint64 old_u = 0, new_u = 0;
+  gint64 old_s = 0, new_s = 0;
+  gint old_len, new_len;
+  guint i;
+
+  old_len = old_ebmlnum_uint (data, size, &old_u);
+  new_len = gst_ebml_read_vint (data, size, &new_u);
+  if (old_len != new_len || (old_len >= 0 && old_u != new_u))
+    goto mismatch;
+
+  old_len = old_ebmlnum_sint (data, size, &old_s);
+  new_len = gst_ebml_read_svint (data, size, &new_s);
+  if (old_len != new_len || (old_len >= 0 && old_s != new_s))
+    goto mismatch;
+
+  return;
+
+mismatch:
+  if (failures++ < 20) {
+    g_printerr ("%s: mismatch for", what);
+    for (i = 0; i < MIN (size, 9); i++)
+      g_printerr (" %02x", data[i]);
+    g_printerr (" (size %u): old %d/%" G_GUINT64_FORMAT ", new %d/%"
+        G_GUINT64_FORMAT "\n", size, old_len, old_u, new_len, new_u);
+  }
+}
+
+/* writes @value (all ones for unknown) as a @len byte number to @data */
+static void
+encode (guint8 * data, guint len, guint64 value)
+{
+  guint i;
+
+  for (i = len; i > 0; i--) {
+    data[i - 1] = value & 0xff;
+    value >>= 8;
+  }
+  data[0] = (data[0] & (0xff >> len)) | (0x80 >> (len - 1));
+}
+
+static void
+test_lengths (void)
+{
+  guint b;
+
+  for (b = 0; b < 256; b++) {
+    if ((gint) gst_ebml_vint_length (b) != old_vint_length (b)) {
+      g_printerr ("length: mismatch for first byte %02x: old %d, new %u\n",
+          b, old_vint_length (b), gst_ebml_vint_length (b));
+      failures++;
+    }
+  }
+}
+
+static void
+test_edge_cases (void)
+{
+  guint8 data[16];
+  guint len, size;
+
+  for (len = 1; len <= 8; len++) {
+    guint64 max = (G_GUINT64_CONSTANT (1) << (7 * len)) - 1;
+    guint64 values[] = { 0, 1, max / 2, max - 1, max };
+    guint v;
+
+    for (v = 0; v < G_N_ELEMENTS (values); v++) {
+      /* padding after the number, so both the 8 byte load and the byte
+       * loop are used */
+      memset (data, 0xff, sizeof (data));
+      encode (data, len, values[v]);
+      for (size = 0; size <= sizeof (data); size++)
+        check (data, size, "edge case");
+
+      memset (data, 0x00, sizeof (data));
+      encode (data, len, values[v]);
+      for (size = 0; size <= sizeof (data); size++)
+        check (data, size, "edge case");
+    }
+  }
+
+  /* no length marker in the first byte */
+  memset (data, 0x00, sizeof (data));
+  for (size = 0; size <= sizeof (data); size++)
+    check (data, size, "zero first byte");
+  memset (data + 1, 0xff, sizeof (data) - 1);
+  for (size = 0; size <= sizeof (data); size++)
+    check (data, size, "zero first byte");
+}
+
+static void
+test_random (GRand * rand)
+{
+  guint8 data[16];
+  guint i, j;
+
+  for (i = 0; i < RANDOM_CASES; i++) {
+    for (j = 0; j < sizeof (data); j++)
+      data[j] = g_rand_int_range (rand, 0, 256);
+    /* make all lengths about as likely, with some invalid first bytes */
+    if (g_rand_int_range (rand, 0, 4)) {
+      guint len = g_rand_int_range (rand, 1, 9);
+
+      data[0] = (data[0] & (0xff >> len)) | (0x80 >> (len - 1));
+      /* and some all ones numbers */
+      if (!g_rand_int_range (rand, 0, 8))
+        encode (data, len, G_MAXUINT64);
+    }
+    check (data, g_rand_int_range (rand, 0, sizeof (data) + 1), "random");
+  }
+}
+
+static void
+benchmark (GRand * rand, guint rounds)
+{
+  guint8 *data, *p, *end;
+  guint64 num, sum_old = 0, sum_new = 0;
+  gint64 start, old_time, new_time;
+  guint i, r;
+  gint len;
+
+  /* mostly short numbers, as element sizes and lace sizes are */
+  data = g_malloc (BENCH_VALUES * 8 + 8);
+  p = data;
+  for (i = 0; i < BENCH_VALUES; i++) {
+    guint n = g_rand_int_range (rand, 0, 16);
+
+    len = n < 8 ? 1 : n < 12 ? 2 : n < 14 ? 3 : g_rand_int_range (rand, 4, 9);
+    encode (p, len, ((guint64) g_rand_int (rand) << 32) | g_rand_int (rand));
+    p += len;
+  }
+  end = p;
+  memset (end, 0, 8);
+
+  start = g_get_monotonic_time ();
+  for (r = 0; r < rounds; r++) {
+    for (p = data; p < end; p += len) {
+      len = old_ebmlnum_uint (p, end - p, &num);
+      sum_old += num;
+    }
+  }
+  old_time = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  for (r = 0; r < rounds; r++) {
+    for (p = data; p < end; p += len) {
+      len = gst_ebml_read_vint (p, end - p, &num);
+      sum_new += num;
+    }
+  }
+  new_time = g_get_monotonic_time () - start;
+
+  if (sum_old != sum_new) {
+    g_printerr ("benchmark: sums differ\n");
+    failures++;
+  }
+
+  g_print ("old decoder: %.2f ns per number\n",
+      old_time * 1000.0 / ((gdouble) rounds * BENCH_VALUES));
+  g_print ("new decoder: %.2f ns per number\n",
+      new_time * 1000.0 / ((gdouble) rounds * BENCH_VALUES));
+
+  g_free (data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  guint rounds = DEFAULT_ROUNDS;
+  GRand *rand;
+
+  if (argc > 1)
+    rounds = MAX (atoi (argv[1]), 1);
+
+  /* fixed seed, so failures can be reproduced */
+  rand = g_rand_new_with_seed (0x65626d6c);
+
+  test_lengths ();
+  test_edge_cases ();
+  test_random (rand);
+  if (failures) {
+    g_printerr ("%u mismatches\n", failures);
+    g_rand_free (rand);
+    return 1;
+  }
+  g_print ("decoders agree\n");
+
+  benchmark (rand, rounds);
+  g_rand_free (rand);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/* GStreamer memory mapped access to local files for the bundled demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * When a demuxer pulls from filesrc, every pull_range reads into a freshly
+ * allocated buffer. If the file is mapped instead, the demuxer can hand out
+ * buffers that share the mapping, so sample data goes from the page cache
+ * to the decoder without being copied.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "file-map.h"
+
+#if GST_CHECK_VERSION(1,0,0)
+
+GstMemory *
+gst_file_map_new_for_pad (GstPad * sinkpad)
+{
+  GstQuery *query;
+  GMappedFile *mapped = NULL;
+  GstMemory *file = NULL;
+  gchar *uri = NULL, *filename = NULL;
+  gint64 upstream_size = -1;
+  GError *err = NULL;
+  gsize size;
+
+  query = gst_query_new_uri ();
+  if (gst_pad_peer_query (sinkpad, query))
+    gst_query_parse_uri (query, &uri);
+  gst_query_unref (query);
+
+  if (uri == NULL || !gst_uri_has_protocol (uri, "file"))
+    goto done;
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  if (filename == NULL)
+    goto done;
+
+  mapped = g_mapped_file_new (filename, FALSE, &err);
+  if (mapped == NULL) {
+    GST_DEBUG_OBJECT (sinkpad, "can't map %s: %s", filename, err->message);
+    g_error_free (err);
+    goto done;
+  }
+
+  /* make sure upstream really just reads the file */
+  size = g_mapped_file_get_length (mapped);
+  if (size == 0 || !gst_pad_peer_query_duration (sinkpad, GST_FORMAT_BYTES,
+          &upstream_size) || upstream_size != size) {
+    GST_DEBUG_OBJECT (sinkpad, "not mapping %s, size %" G_GSIZE_FORMAT
+        " upstream size %" G_GINT64_FORMAT, filename, size, upstream_size);
+    goto done;
+  }
+
+  file = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+      g_mapped_file_get_contents (mapped), size, 0, size,
+      g_mapped_file_ref (mapped), (GDestroyNotify) g_mapped_file_unref);
+  GST_DEBUG_OBJECT (sinkpad, "mapped %s, %" G_GSIZE_FORMAT " bytes", filename,
+      size);
+
+done:
+  if (mapped)
+    g_mapped_file_unref (mapped);
+  g_free (filename);
+  g_free (uri);
+
+  return file;
+}
+
+gboolean
+gst_file_map_get_range (GstMemory * file, guint64 offset, guint64 size,
+    GstBuffer ** buf)
+{
+  if (offset > file->size || size > file->size - offset || size == 0)
+    return FALSE;
+
+  *buf = gst_buffer_new ();
+  gst_buffer_append_memory (*buf, gst_memory_share (file, offset, size));
+  GST_BUFFER_OFFSET (*buf) = offset;
+  GST_BUFFER_OFFSET_END (*buf) = offset + size;
+
+  return TRUE;
+}
+
+#endif
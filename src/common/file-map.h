@@ -0,0 +1,45 @@
+/* GStreamer memory mapped access to local files for the bundled demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_FILE_MAP_H__
+#define __GST_FILE_MAP_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#if GST_CHECK_VERSION(1,0,0)
+
+/* Maps the local file that is read through @sinkpad in pull mode, if
+ * upstream reports one by URI and its size matches. The returned read-only
+ * memory covers the whole file, the file is unmapped once it and all
+ * memories shared from it are freed. */
+GstMemory *   gst_file_map_new_for_pad   (GstPad * sinkpad);
+
+/* Replacement for gst_pad_pull_range() on the mapped file: returns a buffer
+ * sharing the mapping for @size bytes at @offset, or FALSE if the range
+ * isn't within the mapped file. */
+gboolean      gst_file_map_get_range     (GstMemory * file,
+                                          guint64 offset, guint64 size,
+                                          GstBuffer ** buf);
+
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_FILE_MAP_H__ */
@@ -0,0 +1,329 @@
+/* GStreamer sidecar seek index files for the bundled demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Building the seek tables of a big file (parsing Cues or stbl, or scanning
+ * for clusters) is repeated every time the file is opened. The demuxers
+ * can save their tables to a sidecar file in a cache directory and load
+ * them back the next time, as long as the file has the same size and
+ * modification time.
+ *
+ * The sidecar is named after a checksum of the file name and holds a
+ * header followed by tables, each with a small header of its own and an
+ * array of fixed size elements. Everything is in host byte order, a file
+ * written with another byte order is rejected.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "seek-index.h"
+
+#if GST_CHECK_VERSION(1,0,0)
+
+#define GST_SEEK_INDEX_MAGIC      GST_MAKE_FOURCC ('G','S','I','X')
+#define GST_SEEK_INDEX_VERSION    1
+#define GST_SEEK_INDEX_BYTE_ORDER 0x01020304
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 byte_order;
+  guint32 n_tables;
+  gchar kind[8];
+  guint64 file_size;
+  gint64 file_mtime;
+} GstSeekIndexHeader;
+
+typedef struct
+{
+  guint32 tag;
+  guint32 elem_size;
+  guint64 n_elems;
+} GstSeekIndexTableHeader;
+
+typedef struct
+{
+  guint32 elem_size;
+  guint n_elems;
+  gpointer data;
+} GstSeekIndexTable;
+
+struct _GstSeekIndex
+{
+  gchar *filename;
+  gchar *location;
+  gchar kind[8];
+  guint64 file_size;
+  gint64 file_mtime;
+
+  /* tag -> GstSeekIndexTable */
+  GHashTable *tables;
+};
+
+static void
+gst_seek_index_table_free (GstSeekIndexTable * table)
+{
+  g_free (table->data);
+  g_slice_free (GstSeekIndexTable, table);
+}
+
+static gboolean
+gst_seek_index_stat (const gchar * filename, guint64 * size, gint64 * mtime)
+{
+  GStatBuf st;
+
+  if (g_stat (filename, &st) != 0 || !S_ISREG (st.st_mode))
+    return FALSE;
+
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return TRUE;
+}
+
+GstSeekIndex *
+gst_seek_index_new_for_pad (GstPad * sinkpad, const gchar * cache_dir,
+    const gchar * kind)
+{
+  GstSeekIndex *index = NULL;
+  GstQuery *query;
+  gchar *uri = NULL, *filename = NULL, *name, *checksum;
+  gint64 upstream_size = -1;
+  guint64 size;
+  gint64 mtime;
+
+  g_return_val_if_fail (cache_dir != NULL, NULL);
+  g_return_val_if_fail (strlen (kind) <= 8, NULL);
+
+  query = gst_query_new_uri ();
+  if (gst_pad_peer_query (sinkpad, query))
+    gst_query_parse_uri (query, &uri);
+  gst_query_unref (query);
+
+  if (uri == NULL || !gst_uri_has_protocol (uri, "file"))
+    goto done;
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  if (filename == NULL || !gst_seek_index_stat (filename, &size, &mtime))
+    goto done;
+
+  /* make sure upstream really just reads the file */
+  if (!gst_pad_peer_query_duration (sinkpad, GST_FORMAT_BYTES,
+          &upstream_size) || upstream_size != size) {
+    GST_DEBUG_OBJECT (sinkpad, "no seek index for %s, size %" G_GUINT64_FORMAT
+        " upstream size %" G_GINT64_FORMAT, filename, size, upstream_size);
+    goto done;
+  }
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, filename, -1);
+  name = g_strdup_printf ("%s.%s.idx", checksum, kind);
+
+  index = g_slice_new0 (GstSeekIndex);
+  index->filename = filename;
+  index->location = g_build_filename (cache_dir, name, NULL);
+  strncpy (index->kind, kind, sizeof (index->kind));
+  index->file_size = size;
+  index->file_mtime = mtime;
+  index->tables = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) gst_seek_index_table_free);
+  filename = NULL;
+
+  GST_DEBUG_OBJECT (sinkpad, "seek index for %s is %s", index->filename,
+      index->location);
+
+  g_free (name);
+  g_free (checksum);
+
+done:
+  g_free (filename);
+  g_free (uri);
+
+  return index;
+}
+
+void
+gst_seek_index_free (GstSeekIndex * index)
+{
+  g_hash_table_destroy (index->tables);
+  g_free (index->location);
+  g_free (index->filename);
+  g_slice_free (GstSeekIndex, index);
+}
+
+gboolean
+gst_seek_index_load (GstSeekIndex * index)
+{
+  GstSeekIndexHeader header;
+  GstSeekIndexTableHeader th;
+  gchar *contents = NULL;
+  gsize length, pos;
+  guint i;
+
+  g_hash_table_remove_all (index->tables);
+
+  if (!g_file_get_contents (index->location, &contents, &length, NULL))
+    return FALSE;
+
+  if (length < sizeof (header))
+    goto invalid;
+  memcpy (&header, contents, sizeof (header));
+  if (header.magic != GST_SEEK_INDEX_MAGIC
+      || header.version != GST_SEEK_INDEX_VERSION
+      || header.byte_order != GST_SEEK_INDEX_BYTE_ORDER
+      || memcmp (header.kind, index->kind, sizeof (header.kind)) != 0)
+    goto invalid;
+  if (header.file_size != index->file_size
+      || header.file_mtime != index->file_mtime) {
+    GST_DEBUG ("seek index %s is out of date", index->location);
+    goto invalid;
+  }
+
+  pos = sizeof (header);
+  for (i = 0; i < header.n_tables; i++) {
+    GstSeekIndexTable *table;
+
+    if (length - pos < sizeof (th))
+      goto invalid;
+    memcpy (&th, contents + pos, sizeof (th));
+    pos += sizeof (th);
+
+    if (th.elem_size == 0 || th.n_elems > G_MAXUINT
+        || th.n_elems > (length - pos) / th.elem_size)
+      goto invalid;
+
+    table = g_slice_new (GstSeekIndexTable);
+    table->elem_size = th.elem_size;
+    table->n_elems = th.n_elems;
+    table->data = g_memdup (contents + pos, th.n_elems * th.elem_size);
+    g_hash_table_insert (index->tables, GUINT_TO_POINTER (th.tag), table);
+    pos += th.n_elems * th.elem_size;
+  }
+  if (pos != length)
+    goto invalid;
+
+  GST_DEBUG ("loaded %u tables from seek index %s", header.n_tables,
+      index->location);
+  g_free (contents);
+
+  return TRUE;
+
+invalid:
+  {
+    GST_DEBUG ("ignoring invalid seek index %s", index->location);
+    g_hash_table_remove_all (index->tables);
+    g_free (contents);
+    return FALSE;
+  }
+}
+
+gboolean
+gst_seek_index_save (GstSeekIndex * index)
+{
+  GstSeekIndexHeader header;
+  GstSeekIndexTableHeader th;
+  GstSeekIndexTable *table;
+  GHashTableIter iter;
+  gpointer tag;
+  GByteArray *contents;
+  GError *err = NULL;
+  gchar *dir;
+  guint64 size;
+  gint64 mtime;
+  gboolean ret = FALSE;
+
+  /* don't describe a file that is still being written */
+  if (!gst_seek_index_stat (index->filename, &size, &mtime)
+      || size != index->file_size || mtime != index->file_mtime) {
+    GST_DEBUG ("%s has changed, not writing seek index", index->filename);
+    return FALSE;
+  }
+
+  memset (&header, 0, sizeof (header));
+  header.magic = GST_SEEK_INDEX_MAGIC;
+  header.version = GST_SEEK_INDEX_VERSION;
+  header.byte_order = GST_SEEK_INDEX_BYTE_ORDER;
+  header.n_tables = g_hash_table_size (index->tables);
+  memcpy (header.kind, index->kind, sizeof (header.kind));
+  header.file_size = index->file_size;
+  header.file_mtime = index->file_mtime;
+
+  contents = g_byte_array_new ();
+  g_byte_array_append (contents, (const guint8 *) &header, sizeof (header));
+
+  g_hash_table_iter_init (&iter, index->tables);
+  while (g_hash_table_iter_next (&iter, &tag, (gpointer *) & table)) {
+    th.tag = GPOINTER_TO_UINT (tag);
+    th.elem_size = table->elem_size;
+    th.n_elems = table->n_elems;
+    g_byte_array_append (contents, (const guint8 *) &th, sizeof (th));
+    g_byte_array_append (contents, table->data,
+        table->n_elems * table->elem_size);
+  }
+
+  dir = g_path_get_dirname (index->location);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+
+  /* written to a temporary file and renamed, readers never see half of it */
+  if (g_file_set_contents (index->location, (const gchar *) contents->data,
+          contents->len, &err)) {
+    GST_DEBUG ("saved seek index %s, %u bytes", index->location,
+        contents->len);
+    ret = TRUE;
+  } else {
+    GST_WARNING ("can't write seek index: %s", err->message);
+    g_error_free (err);
+  }
+  g_byte_array_unref (contents);
+
+  return ret;
+}
+
+gconstpointer
+gst_seek_index_get_table (GstSeekIndex * index, guint32 tag,
+    gsize elem_size, guint * n_elems)
+{
+  GstSeekIndexTable *table;
+
+  table = g_hash_table_lookup (index->tables, GUINT_TO_POINTER (tag));
+  if (table == NULL || table->elem_size != elem_size)
+    return NULL;
+
+  *n_elems = table->n_elems;
+  return table->data;
+}
+
+void
+gst_seek_index_set_table (GstSeekIndex * index, guint32 tag,
+    gsize elem_size, gconstpointer data, guint n_elems)
+{
+  GstSeekIndexTable *table;
+
+  table = g_slice_new (GstSeekIndexTable);
+  table->elem_size = elem_size;
+  table->n_elems = n_elems;
+  table->data = g_memdup (data, n_elems * elem_size);
+  g_hash_table_insert (index->tables, GUINT_TO_POINTER (tag), table);
+}
+
+#endif
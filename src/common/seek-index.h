@@ -0,0 +1,76 @@
+/* GStreamer sidecar seek index files for the bundled demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_SEEK_INDEX_H__
+#define __GST_SEEK_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#if GST_CHECK_VERSION(1,0,0)
+
+typedef struct _GstSeekIndex GstSeekIndex;
+
+/* one keyframe: @offset is where reading must start to decode it, @sample
+ * is the demuxer's number of the keyframe within @track or its cluster */
+typedef struct _GstSeekIndexEntry {
+  guint64 time;
+  guint64 offset;
+  guint32 track;
+  guint32 sample;
+} GstSeekIndexEntry;
+
+/* table of GstSeekIndexEntry, sorted by time */
+#define GST_SEEK_INDEX_KEYFRAMES GST_MAKE_FOURCC ('k','e','y','s')
+
+/* Returns the sidecar index of the local file that is read through
+ * @sinkpad, kept in @cache_dir. @kind tells apart the formats of the
+ * demuxers (at most 8 characters). Returns NULL if upstream doesn't report
+ * a local file by URI or its size doesn't match. */
+GstSeekIndex *  gst_seek_index_new_for_pad (GstPad * sinkpad,
+                                            const gchar * cache_dir,
+                                            const gchar * kind);
+
+void            gst_seek_index_free        (GstSeekIndex * index);
+
+/* Reads the sidecar file, which is only accepted if it was written for a
+ * file of the same kind, size and modification time. */
+gboolean        gst_seek_index_load        (GstSeekIndex * index);
+
+/* Writes all tables to the sidecar file, unless the file has changed
+ * since gst_seek_index_new_for_pad(). */
+gboolean        gst_seek_index_save        (GstSeekIndex * index);
+
+/* Returns the table @tag of @n_elems elements of @elem_size bytes, or NULL
+ * if there is none with elements of that size. */
+gconstpointer   gst_seek_index_get_table   (GstSeekIndex * index,
+                                            guint32 tag, gsize elem_size,
+                                            guint * n_elems);
+
+/* Replaces table @tag with a copy of @data. */
+void            gst_seek_index_set_table   (GstSeekIndex * index,
+                                            guint32 tag, gsize elem_size,
+                                            gconstpointer data,
+                                            guint n_elems);
+
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_SEEK_INDEX_H__ */
@@ -29,6 +29,7 @@
 #include <libde265/de265.h>
 
 #include "libde265-dec.h"
+#include "libde265-mdec.h"
 
 #if !GST_CHECK_VERSION(1,4,0)
 GST_DEBUG_CATEGORY_EXTERN (matroskareadcommon_debug);
@@ -37,6 +38,9 @@ void gst_matroska_register_tags (void);
 gboolean gst_matroska_demux_plugin_init (GstPlugin * plugin);
 gboolean gst_matroska_parse_plugin_init (GstPlugin * plugin);
 gboolean gst_isomp4_plugin_init (GstPlugin * plugin);
+#if GST_CHECK_VERSION(1,2,0)
+gboolean gst_matroska_mux_plugin_init (GstPlugin * plugin);
+#endif
 #endif
 
 static gboolean
@@ -54,8 +58,14 @@ plugin_init (GstPlugin * plugin)
   ret = gst_matroska_demux_plugin_init (plugin);
   ret &= gst_matroska_parse_plugin_init (plugin);
   ret &= gst_isomp4_plugin_init (plugin);
+#if GST_CHECK_VERSION(1,2,0)
+  ret &= gst_matroska_mux_plugin_init (plugin);
+#endif
 #endif
   ret &= gst_libde265_dec_plugin_init (plugin);
+#if GST_CHECK_VERSION(1,0,0)
+  ret &= gst_libde265_mdec_plugin_init (plugin);
+#endif
   return ret;
 }
 
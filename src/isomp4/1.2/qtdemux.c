@@ -73,6 +73,7 @@
 #include <gst/math-compat.h>
 
 #include "../../common/codec-utils.h"
+#include "../../common/file-map.h"
 
 #ifdef HAVE_ZLIB
 # include <zlib.h>
@@ -412,10 +413,24 @@ GST_STATIC_PAD_TEMPLATE ("subtitle_%u",
     GST_PAD_SOMETIMES,
     GST_STATIC_CAPS_ANY);
 
+enum
+{
+  PROP_0,
+  PROP_USE_MMAP,
+  PROP_INDEX_CACHE_DIR
+};
+
+#define DEFAULT_USE_MMAP FALSE
+#define DEFAULT_INDEX_CACHE_DIR NULL
+
 #define gst_qtdemux_parent_class parent_class
 G_DEFINE_TYPE (GstQTDemux, gst_qtdemux, GST_TYPE_ELEMENT);
 
 static void gst_qtdemux_dispose (GObject * object);
+static void gst_qtdemux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_qtdemux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 
 static guint32
 gst_qtdemux_find_index_linear (GstQTDemux * qtdemux, QtDemuxStream * str,
@@ -472,6 +487,7 @@ static void gst_qtdemux_stream_free (GstQTDemux * qtdemux,
 static void gst_qtdemux_stream_clear (QtDemuxStream * stream);
 static void gst_qtdemux_remove_stream (GstQTDemux * qtdemux, int index);
 static GstFlowReturn qtdemux_prepare_streams (GstQTDemux * qtdemux);
+static void qtdemux_save_sidecar (GstQTDemux * qtdemux);
 static void qtdemux_do_allocation (GstQTDemux * qtdemux,
     QtDemuxStream * stream);
 
@@ -487,6 +503,22 @@ gst_qtdemux_class_init (GstQTDemuxClass * klass)
   parent_class = g_type_class_peek_parent (klass);
 
   gobject_class->dispose = gst_qtdemux_dispose;
+  gobject_class->set_property = gst_qtdemux_set_property;
+  gobject_class->get_property = gst_qtdemux_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_USE_MMAP,
+      g_param_spec_boolean ("use-mmap", "Use mmap",
+          "Map the file when reading from a local file in pull mode and "
+          "output buffers sharing the mapping. The file must not be "
+          "truncated while it is being played.", DEFAULT_USE_MMAP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_INDEX_CACHE_DIR,
+      g_param_spec_string ("index-cache-dir", "Index cache directory",
+          "Directory for sidecar seek index files of local files read in "
+          "pull mode. The sample tables of a file are loaded from there if "
+          "the file has not changed, otherwise they are parsed completely "
+          "when the file is opened and saved there (NULL = disabled).",
+          DEFAULT_INDEX_CACHE_DIR, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_qtdemux_change_state);
 #if 0
@@ -546,6 +578,10 @@ gst_qtdemux_init (GstQTDemux * qtdemux)
   qtdemux->upstream_newsegment = FALSE;
   qtdemux->have_group_id = FALSE;
   qtdemux->group_id = G_MAXUINT;
+  qtdemux->use_mmap = DEFAULT_USE_MMAP;
+  qtdemux->file_map = NULL;
+  qtdemux->index_cache_dir = g_strdup (DEFAULT_INDEX_CACHE_DIR);
+  qtdemux->sidecar = NULL;
   gst_segment_init (&qtdemux->segment, GST_FORMAT_TIME);
 
   GST_OBJECT_FLAG_SET (qtdemux, GST_ELEMENT_FLAG_INDEXABLE);
@@ -560,10 +596,59 @@ gst_qtdemux_dispose (GObject * object)
     g_object_unref (G_OBJECT (qtdemux->adapter));
     qtdemux->adapter = NULL;
   }
+  g_free (qtdemux->index_cache_dir);
+  qtdemux->index_cache_dir = NULL;
 
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
+static void
+gst_qtdemux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstQTDemux *qtdemux = GST_QTDEMUX (object);
+
+  switch (prop_id) {
+    case PROP_USE_MMAP:
+      GST_OBJECT_LOCK (qtdemux);
+      qtdemux->use_mmap = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (qtdemux);
+      break;
+    case PROP_INDEX_CACHE_DIR:
+      GST_OBJECT_LOCK (qtdemux);
+      g_free (qtdemux->index_cache_dir);
+      qtdemux->index_cache_dir = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (qtdemux);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_qtdemux_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstQTDemux *qtdemux = GST_QTDEMUX (object);
+
+  switch (prop_id) {
+    case PROP_USE_MMAP:
+      GST_OBJECT_LOCK (qtdemux);
+      g_value_set_boolean (value, qtdemux->use_mmap);
+      GST_OBJECT_UNLOCK (qtdemux);
+      break;
+    case PROP_INDEX_CACHE_DIR:
+      GST_OBJECT_LOCK (qtdemux);
+      g_value_set_string (value, qtdemux->index_cache_dir);
+      GST_OBJECT_UNLOCK (qtdemux);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static void
 gst_qtdemux_post_no_playable_stream_error (GstQTDemux * qtdemux)
 {
@@ -625,6 +710,11 @@ gst_qtdemux_pull_atom (GstQTDemux * qtdemux, guint64 offset, guint64 size,
     }
   }
 
+  /* samples of a mapped file share the mapping */
+  if (qtdemux->file_map
+      && gst_file_map_get_range (qtdemux->file_map, offset, size, buf))
+    return GST_FLOW_OK;
+
   flow = gst_pad_pull_range (qtdemux->sinkpad, offset, size, buf);
 
   if (G_UNLIKELY (flow != GST_FLOW_OK))
@@ -3204,6 +3294,8 @@ beach:
   if (ret == GST_FLOW_EOS && (qtdemux->got_moov || qtdemux->media_caps)) {
     /* digested all data, show what we have */
     qtdemux_prepare_streams (qtdemux);
+    if (qtdemux->sidecar)
+      qtdemux_save_sidecar (qtdemux);
     ret = qtdemux_expose_streams (qtdemux);
 
     qtdemux->state = QTDEMUX_STATE_MOVIE;
@@ -5108,11 +5200,35 @@ qtdemux_sink_activate_mode (GstPad * sinkpad, GstObject * parent,
       break;
     case GST_PAD_MODE_PULL:
       if (active) {
+        gboolean use_mmap;
+        gchar *cache_dir;
+
+        GST_OBJECT_LOCK (demux);
+        use_mmap = demux->use_mmap;
+        cache_dir = g_strdup (demux->index_cache_dir);
+        GST_OBJECT_UNLOCK (demux);
+        if (use_mmap)
+          demux->file_map = gst_file_map_new_for_pad (sinkpad);
+        if (cache_dir) {
+          demux->sidecar = gst_seek_index_new_for_pad (sinkpad, cache_dir,
+              "mp4");
+          if (demux->sidecar)
+            gst_seek_index_load (demux->sidecar);
+          g_free (cache_dir);
+        }
         demux->pullbased = TRUE;
         res = gst_pad_start_task (sinkpad, (GstTaskFunction) gst_qtdemux_loop,
             sinkpad, NULL);
       } else {
         res = gst_pad_stop_task (sinkpad);
+        if (demux->file_map) {
+          gst_memory_unref (demux->file_map);
+          demux->file_map = NULL;
+        }
+        if (demux->sidecar) {
+          gst_seek_index_free (demux->sidecar);
+          demux->sidecar = NULL;
+        }
       }
       break;
     default:
@@ -6028,6 +6144,67 @@ flow_failed:
   }
 }
 
+/* take the complete sample table of @stream from the sidecar index, so the
+ * stbl sub-atoms don't have to be parsed */
+static gboolean
+qtdemux_load_sidecar_samples (GstQTDemux * qtdemux, QtDemuxStream * stream)
+{
+  const QtDemuxSample *samples;
+  guint n;
+
+  samples = gst_seek_index_get_table (qtdemux->sidecar, stream->track_id,
+      sizeof (QtDemuxSample), &n);
+  if (samples == NULL || n != stream->n_samples)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (qtdemux, "%u samples of track %u from sidecar index", n,
+      stream->track_id);
+  memcpy (stream->samples, samples, n * sizeof (QtDemuxSample));
+  stream->stbl_index = n - 1;
+  gst_qtdemux_stbl_free (stream);
+
+  return TRUE;
+}
+
+/* parse the remaining samples of the streams that didn't come from the
+ * sidecar index and write them to it */
+static void
+qtdemux_save_sidecar (GstQTDemux * qtdemux)
+{
+  QtDemuxSample *samples;
+  gboolean changed = FALSE;
+  guint i, j, n;
+
+  /* the moov only describes the first part of a fragmented file */
+  if (qtdemux->fragmented)
+    return;
+
+  for (i = 0; i < qtdemux->n_streams; i++) {
+    QtDemuxStream *stream = qtdemux->streams[i];
+
+    if (!stream->n_samples || (gst_seek_index_get_table (qtdemux->sidecar,
+                stream->track_id, sizeof (QtDemuxSample), &n)
+            && n == stream->n_samples))
+      continue;
+
+    if (!qtdemux_parse_samples (qtdemux, stream, stream->n_samples - 1))
+      return;
+
+    /* keep the keyframe flags valid without the stss */
+    samples = g_memdup (stream->samples,
+        stream->n_samples * sizeof (QtDemuxSample));
+    for (j = 0; j < stream->n_samples; j++)
+      samples[j].keyframe = QTSAMPLE_KEYFRAME (stream, &samples[j]);
+    gst_seek_index_set_table (qtdemux->sidecar, stream->track_id,
+        sizeof (QtDemuxSample), samples, stream->n_samples);
+    g_free (samples);
+    changed = TRUE;
+  }
+
+  if (changed)
+    gst_seek_index_save (qtdemux->sidecar);
+}
+
 /* initialise bytereaders for stbl sub-atoms */
 static gboolean
 qtdemux_stbl_init (GstQTDemux * qtdemux, QtDemuxStream * stream, GNode * stbl)
@@ -6214,6 +6391,9 @@ qtdemux_stbl_init (GstQTDemux * qtdemux, QtDemuxStream * stream, GNode * stbl)
       goto corrupt_file;
   }
 
+  if (qtdemux->sidecar && !qtdemux->fragmented)
+    qtdemux_load_sidecar_samples (qtdemux, stream);
+
   return TRUE;
 
 corrupt_file:
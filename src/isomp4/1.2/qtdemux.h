@@ -24,6 +24,8 @@
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
 
+#include "../../common/seek-index.h"
+
 G_BEGIN_DECLS
 
 GST_DEBUG_CATEGORY_EXTERN (qtdemux_debug);
@@ -137,6 +139,14 @@ struct _GstQTDemux {
   gint64 chapters_track_id;
 
   GstClockTime min_elst_offset;
+
+  /* pull mode on a mapped local file */
+  gboolean use_mmap;
+  GstMemory *file_map;
+
+  /* sidecar seek index with the sample tables of a local file */
+  gchar *index_cache_dir;
+  GstSeekIndex *sidecar;
 };
 
 struct _GstQTDemuxClass {
@@ -0,0 +1,320 @@
+/*
+ * GStreamer HEVC/H.265 video codec.
+ *
+ * Copyright (c) 2014 struktur AG, Joachim Bauch <bauch@struktur.de>
+ *
+ * This file is part of gstreamer-libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libde265-convert.h"
+
+// 4x4 Bayer matrix used for ordered dithering
+static const uint8_t bayer_4x4[4][4] = {
+  {0, 8, 2, 10},
+  {12, 4, 14, 6},
+  {3, 11, 1, 9},
+  {15, 7, 13, 5}
+};
+
+/*
+ * Fill the bias values that get added to the four pixels of a row pattern
+ * before the bits are shifted out. The pattern repeats every four pixels.
+ */
+static inline void
+_gst_libde265_convert_row_bias (uint16_t bias[4], int y, int shift,
+    GstLibde265DecDither dither)
+{
+  int i;
+  for (i = 0; i < 4; i++) {
+    switch (dither) {
+      case GST_TYPE_LIBDE265_DEC_DITHER_ROUND:
+        bias[i] = 1 << (shift - 1);
+        break;
+      case GST_TYPE_LIBDE265_DEC_DITHER_ORDERED:
+        // thresholds centered inside the range of the discarded bits
+        bias[i] = ((2 * bayer_4x4[y & 3][i] + 1) << shift) >> 5;
+        break;
+      case GST_TYPE_LIBDE265_DEC_DITHER_TRUNCATE:
+      default:
+        bias[i] = 0;
+        break;
+    }
+  }
+}
+
+static inline void
+_gst_libde265_convert_row_16_to_8 (const uint16_t * s, uint8_t * d, int width,
+    int shift, const uint16_t bias[4])
+{
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i vbias = _mm_setr_epi16 (bias[0], bias[1], bias[2], bias[3],
+      bias[0], bias[1], bias[2], bias[3]);
+  const __m128i vshift = _mm_cvtsi32_si128 (shift);
+  for (; x + 16 <= width; x += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (s + x));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (s + x + 8));
+    a = _mm_srl_epi16 (_mm_adds_epu16 (a, vbias), vshift);
+    b = _mm_srl_epi16 (_mm_adds_epu16 (b, vbias), vshift);
+    // saturates values that were rounded up beyond 255
+    _mm_storeu_si128 ((__m128i *) (d + x), _mm_packus_epi16 (a, b));
+  }
+#endif
+  for (; x < width; x++) {
+    unsigned int v = (s[x] + bias[x & 3]) >> shift;
+    d[x] = v > 255 ? 255 : v;
+  }
+}
+
+static inline void
+_gst_libde265_convert_row_16_to_16 (const uint16_t * s, uint16_t * d,
+    int width, int shift, int max_value, const uint16_t bias[4])
+{
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i vbias = _mm_setr_epi16 (bias[0], bias[1], bias[2], bias[3],
+      bias[0], bias[1], bias[2], bias[3]);
+  const __m128i vshift = _mm_cvtsi32_si128 (shift);
+  const __m128i vmax = _mm_set1_epi16 (max_value);
+  for (; x + 8 <= width; x += 8) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (s + x));
+    a = _mm_srl_epi16 (_mm_adds_epu16 (a, vbias), vshift);
+    _mm_storeu_si128 ((__m128i *) (d + x), _mm_min_epi16 (a, vmax));
+  }
+#endif
+  for (; x < width; x++) {
+    int v = (s[x] + bias[x & 3]) >> shift;
+    d[x] = v > max_value ? max_value : v;
+  }
+}
+
+void
+gst_libde265_convert_plane_16_to_8 (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int width, int height, int shift,
+    GstLibde265DecDither dither)
+{
+  uint16_t bias[4];
+  int y;
+  for (y = 0; y < height; y++) {
+    _gst_libde265_convert_row_bias (bias, y, shift, dither);
+    _gst_libde265_convert_row_16_to_8 ((const uint16_t *) src, dst, width,
+        shift, bias);
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void
+gst_libde265_convert_plane_16_to_16 (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int width, int height, int shift,
+    int dst_bits, GstLibde265DecDither dither)
+{
+  int max_value = (1 << dst_bits) - 1;
+  uint16_t bias[4];
+  int y;
+  for (y = 0; y < height; y++) {
+    _gst_libde265_convert_row_bias (bias, y, shift, dither);
+    _gst_libde265_convert_row_16_to_16 ((const uint16_t *) src,
+        (uint16_t *) dst, width, shift, max_value, bias);
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void
+gst_libde265_convert_plane_8_to_16 (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int width, int height, int shift)
+{
+  while (height--) {
+    const uint8_t *s = src;
+    uint16_t *d = (uint16_t *) dst;
+    int x;
+    for (x = 0; x < width; x++) {
+      d[x] = s[x] << shift;
+    }
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void
+gst_libde265_convert_plane_16_to_16_up (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int width, int height, int shift)
+{
+  while (height--) {
+    const uint16_t *s = (const uint16_t *) src;
+    uint16_t *d = (uint16_t *) dst;
+    int x;
+    for (x = 0; x < width; x++) {
+      d[x] = s[x] << shift;
+    }
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void
+gst_libde265_convert_plane_copy (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int row_size, int height)
+{
+  if (src_stride == row_size && dst_stride == row_size) {
+    memcpy (dst, src, height * row_size);
+    return;
+  }
+
+  while (height--) {
+    memcpy (dst, src, row_size);
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void
+gst_libde265_convert_image_region (const struct de265_image *img, int x,
+    int y, int region_width, int region_height, uint8_t * const dest[3],
+    const int dest_stride[3], int dest_bits, GstLibde265DecDither dither)
+{
+  int luma_width = de265_get_image_width (img, 0);
+  int luma_height = de265_get_image_height (img, 0);
+  int plane;
+  for (plane = 0; plane < 3; plane++) {
+    int stride;
+    int plane_width = de265_get_image_width (img, plane);
+    int plane_height = de265_get_image_height (img, plane);
+    // scale the region for subsampled chroma planes
+    int px = x * plane_width / luma_width;
+    int py = y * plane_height / luma_height;
+    int width = plane_width * (x + region_width) / luma_width - px;
+    int height = plane_height * (y + region_height) / luma_height - py;
+    const uint8_t *src = de265_get_image_plane (img, plane, &stride);
+    uint8_t *dst = dest[plane];
+    int dst_stride = dest_stride[plane];
+    int plane_bits_per_pixel = de265_get_bits_per_pixel (img, plane);
+    if (width <= 0 || height <= 0) {
+      continue;
+    }
+    src += py * stride + px * ((plane_bits_per_pixel + 7) / 8);
+    if (plane_bits_per_pixel > dest_bits && dest_bits > 8) {
+      // More bits per pixel in this plane than supported by the output format
+      int shift = (plane_bits_per_pixel - dest_bits);
+      gst_libde265_convert_plane_16_to_16 (src, stride, dst, dst_stride,
+          width, height, shift, dest_bits, dither);
+    } else if (plane_bits_per_pixel > dest_bits && dest_bits == 8) {
+      // More bits per pixel in this plane than supported by the output format
+      int shift = (plane_bits_per_pixel - dest_bits);
+      gst_libde265_convert_plane_16_to_8 (src, stride, dst, dst_stride,
+          width, height, shift, dither);
+    } else if (plane_bits_per_pixel < dest_bits && plane_bits_per_pixel > 8) {
+      // Less bits per pixel in this plane than the rest of the picture
+      // but more than 8bpp.
+      int shift = (dest_bits - plane_bits_per_pixel);
+      gst_libde265_convert_plane_16_to_16_up (src, stride, dst, dst_stride,
+          width, height, shift);
+    } else if (plane_bits_per_pixel < dest_bits && plane_bits_per_pixel == 8) {
+      // 8 bits per pixel in this plane, which is less than the rest of the picture.
+      int shift = (dest_bits - plane_bits_per_pixel);
+      gst_libde265_convert_plane_8_to_16 (src, stride, dst, dst_stride,
+          width, height, shift);
+    } else {
+      // Bits per pixel of image match output format.
+      gst_libde265_convert_plane_copy (src, stride, dst, dst_stride,
+          width * ((dest_bits + 7) / 8), height);
+    }
+  }
+}
+
+#define HASH_PRIME      G_GUINT64_CONSTANT (0x9e3779b97f4a7c15)
+
+static inline guint64
+_gst_libde265_convert_hash_mix (guint64 h, guint64 v)
+{
+  h ^= v;
+  h *= HASH_PRIME;
+  return h ^ (h >> 29);
+}
+
+/*
+ * Hash a row using four independent lanes so the multiplications
+ * don't depend on each other and the loop runs at memory speed.
+ */
+static inline void
+_gst_libde265_convert_hash_row (const uint8_t * s, int size, guint64 h[4])
+{
+  int x = 0;
+  for (; x + 32 <= size; x += 32) {
+    guint64 v[4];
+    memcpy (v, s + x, sizeof (v));
+    h[0] = _gst_libde265_convert_hash_mix (h[0], v[0]);
+    h[1] = _gst_libde265_convert_hash_mix (h[1], v[1]);
+    h[2] = _gst_libde265_convert_hash_mix (h[2], v[2]);
+    h[3] = _gst_libde265_convert_hash_mix (h[3], v[3]);
+  }
+  for (; x + 8 <= size; x += 8) {
+    guint64 v;
+    memcpy (&v, s + x, sizeof (v));
+    h[0] = _gst_libde265_convert_hash_mix (h[0], v);
+  }
+  for (; x < size; x++) {
+    h[1] = _gst_libde265_convert_hash_mix (h[1], s[x]);
+  }
+}
+
+guint64
+gst_libde265_convert_hash_image_region (const struct de265_image *img, int x,
+    int y, int region_width, int region_height, guint64 seed)
+{
+  int luma_width = de265_get_image_width (img, 0);
+  int luma_height = de265_get_image_height (img, 0);
+  guint64 h[4] = { seed, seed ^ 1, seed ^ 2, seed ^ 3 };
+  int plane;
+  for (plane = 0; plane < 3; plane++) {
+    int stride;
+    int plane_width = de265_get_image_width (img, plane);
+    int plane_height = de265_get_image_height (img, plane);
+    int px = x * plane_width / luma_width;
+    int py = y * plane_height / luma_height;
+    int width = plane_width * (x + region_width) / luma_width - px;
+    int height = plane_height * (y + region_height) / luma_height - py;
+    int bytes_per_pixel = (de265_get_bits_per_pixel (img, plane) + 7) / 8;
+    const uint8_t *src = de265_get_image_plane (img, plane, &stride);
+    if (width <= 0 || height <= 0) {
+      continue;
+    }
+    src += py * stride + px * bytes_per_pixel;
+    while (height--) {
+      _gst_libde265_convert_hash_row (src, width * bytes_per_pixel, h);
+      src += stride;
+    }
+  }
+  return _gst_libde265_convert_hash_mix (_gst_libde265_convert_hash_mix (h[0],
+          h[1]), _gst_libde265_convert_hash_mix (h[2], h[3]));
+}
+
+void
+gst_libde265_convert_image (const struct de265_image *img,
+    uint8_t * const dest[3], const int dest_stride[3], int dest_bits,
+    GstLibde265DecDither dither)
+{
+  gst_libde265_convert_image_region (img, 0, 0,
+      de265_get_image_width (img, 0), de265_get_image_height (img, 0), dest,
+      dest_stride, dest_bits, dither);
+}
@@ -0,0 +1,89 @@
+/*
+ * GStreamer HEVC/H.265 video codec.
+ *
+ * Copyright (c) 2014 struktur AG, Joachim Bauch <bauch@struktur.de>
+ *
+ * This file is part of gstreamer-libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GST_LIBDE265_CONVERT_H__
+#define __GST_LIBDE265_CONVERT_H__
+
+#include <stdint.h>
+
+#include "libde265-dec.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Reduce the bit depth of a 16 bit plane by "shift" bits and write the
+ * result to an 8 bit plane. Strides are given in bytes, width in pixels.
+ */
+void gst_libde265_convert_plane_16_to_8 (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int width, int height, int shift,
+    GstLibde265DecDither dither);
+
+/*
+ * Reduce the bit depth of a 16 bit plane by "shift" bits and write the
+ * result to a 16 bit plane holding "dst_bits" significant bits.
+ */
+void gst_libde265_convert_plane_16_to_16 (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int width, int height, int shift,
+    int dst_bits, GstLibde265DecDither dither);
+
+/*
+ * Increase the bit depth of an 8 bit (or 16 bit) plane by "shift" bits and
+ * write the result to a 16 bit plane.
+ */
+void gst_libde265_convert_plane_8_to_16 (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int width, int height, int shift);
+
+void gst_libde265_convert_plane_16_to_16_up (const uint8_t * src,
+    int src_stride, uint8_t * dst, int dst_stride, int width, int height,
+    int shift);
+
+/*
+ * Copy a plane without changing the bit depth, "row_size" is in bytes.
+ */
+void gst_libde265_convert_plane_copy (const uint8_t * src, int src_stride,
+    uint8_t * dst, int dst_stride, int row_size, int height);
+
+/*
+ * Copy all planes of a decoded image to the given destination planes,
+ * converting to "dest_bits" bits per pixel where necessary.
+ */
+void gst_libde265_convert_image (const struct de265_image *img,
+    uint8_t * const dest[3], const int dest_stride[3], int dest_bits,
+    GstLibde265DecDither dither);
+
+/*
+ * Same as gst_libde265_convert_image but only copies the given region
+ * (in luma pixels) of the image.
+ */
+void gst_libde265_convert_image_region (const struct de265_image *img,
+    int x, int y, int width, int height, uint8_t * const dest[3],
+    const int dest_stride[3], int dest_bits, GstLibde265DecDither dither);
+
+/*
+ * Calculate a fast (non-cryptographic) hash of the given region of an
+ * image, used to detect pictures that didn't change.
+ */
+guint64 gst_libde265_convert_hash_image_region (const struct de265_image *img,
+    int x, int y, int width, int height, guint64 seed);
+
+G_END_DECLS
+
+#endif  // __GST_LIBDE265_CONVERT_H__
@@ -25,6 +25,7 @@
 #include <unistd.h>
 
 #include "libde265-dec.h"
+#include "libde265-convert.h"
 
 #if !defined(LIBDE265_NUMERIC_VERSION) || LIBDE265_NUMERIC_VERSION < 0x00070000
 #error "You need libde265 0.7 or newer to compile this plugin."
@@ -66,6 +67,15 @@ enum
   PROP_MODE,
   PROP_FRAMERATE,
   PROP_MAX_THREADS,
+  PROP_DITHER,
+  PROP_ROI_X,
+  PROP_ROI_Y,
+  PROP_ROI_WIDTH,
+  PROP_ROI_HEIGHT,
+  PROP_REUSE_REPEATED,
+  PROP_MAX_PICTURES,
+  PROP_MAX_IMAGE_MEMORY,
+  PROP_STATS,
   PROP_LAST
 };
 
@@ -73,6 +83,11 @@ enum
 #define DEFAULT_FPS_N       0
 #define DEFAULT_FPS_D       1
 #define DEFAULT_MAX_THREADS 0
+#define DEFAULT_DITHER      GST_TYPE_LIBDE265_DEC_DITHER_TRUNCATE
+#define DEFAULT_ROI         0
+#define DEFAULT_REUSE_REPEATED  FALSE
+#define DEFAULT_MAX_PICTURES    0
+#define DEFAULT_MAX_IMAGE_MEMORY    0
 
 
 #define GST_TYPE_LIBDE265_DEC_MODE (gst_libde265_dec_mode_get_type ())
@@ -96,6 +111,28 @@ gst_libde265_dec_mode_get_type (void)
   return libde265_dec_mode_type;
 }
 
+GType
+gst_libde265_dec_dither_get_type (void)
+{
+  static GType libde265_dec_dither_type = 0;
+  static const GEnumValue libde265_dec_dither_types[] = {
+    {GST_TYPE_LIBDE265_DEC_DITHER_TRUNCATE,
+        "Drop the extra bits", "truncate"},
+    {GST_TYPE_LIBDE265_DEC_DITHER_ROUND,
+        "Round to the nearest value", "round"},
+    {GST_TYPE_LIBDE265_DEC_DITHER_ORDERED,
+        "Ordered dithering with a 4x4 Bayer matrix", "ordered"},
+    {0, NULL, NULL}
+  };
+
+  if (!libde265_dec_dither_type) {
+    libde265_dec_dither_type =
+        g_enum_register_static ("GstLibde265DecDither",
+        libde265_dec_dither_types);
+  }
+  return libde265_dec_dither_type;
+}
+
 static void gst_libde265_dec_finalize (GObject * object);
 
 static void gst_libde265_dec_set_property (GObject * object, guint prop_id,
@@ -147,6 +184,60 @@ gst_libde265_dec_class_init (GstLibde265DecClass * klass)
           0, G_MAXINT, DEFAULT_MAX_THREADS,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_DITHER,
+      g_param_spec_enum ("dither", "Bit depth reduction",
+          "Conversion used if the stream has more bits per pixel than "
+          "the negotiated output format", GST_TYPE_LIBDE265_DEC_DITHER,
+          DEFAULT_DITHER, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_X,
+      g_param_spec_int ("roi-x", "Region of interest X",
+          "Left edge of the region to output", 0, G_MAXINT, DEFAULT_ROI,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_Y,
+      g_param_spec_int ("roi-y", "Region of interest Y",
+          "Top edge of the region to output", 0, G_MAXINT, DEFAULT_ROI,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_WIDTH,
+      g_param_spec_int ("roi-width", "Region of interest width",
+          "Width of the region to output, slices of tiles outside of the "
+          "region are not decoded. (0 = full picture)", 0, G_MAXINT,
+          DEFAULT_ROI, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_HEIGHT,
+      g_param_spec_int ("roi-height", "Region of interest height",
+          "Height of the region to output, slices of tiles outside of the "
+          "region are not decoded. (0 = full picture)", 0, G_MAXINT,
+          DEFAULT_ROI, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_REUSE_REPEATED,
+      g_param_spec_boolean ("reuse-repeated", "Reuse repeated pictures",
+          "Push the previous output buffer again instead of copying pictures "
+          "that didn't change (for slide shows and screen captures), "
+          "disables decoding directly into output buffers",
+          DEFAULT_REUSE_REPEATED,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PICTURES,
+      g_param_spec_uint ("max-pictures", "Maximum pictures",
+          "Push pictures that are ready for output early while the decoder "
+          "holds more pictures than this (0 = unlimited)", 0, G_MAXUINT,
+          DEFAULT_MAX_PICTURES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_IMAGE_MEMORY,
+      g_param_spec_uint64 ("max-image-memory", "Maximum image memory",
+          "Push pictures that are ready for output early while the decoder "
+          "holds more image memory than this (in bytes, 0 = unlimited)", 0,
+          G_MAXUINT64, DEFAULT_MAX_IMAGE_MEMORY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Pictures and image memory held by the decoder", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   decoder_class->start = GST_DEBUG_FUNCPTR (gst_libde265_dec_start);
   decoder_class->stop = GST_DEBUG_FUNCPTR (gst_libde265_dec_stop);
   decoder_class->set_format = GST_DEBUG_FUNCPTR (gst_libde265_dec_set_format);
@@ -177,6 +268,12 @@ _gst_libde265_dec_reset_decoder (GstLibde265Dec * dec)
   dec->width = -1;
   dec->height = -1;
   dec->buffer_full = 0;
+  dec->src_format = GST_VIDEO_FORMAT_UNKNOWN;
+  dec->out_format = GST_VIDEO_FORMAT_UNKNOWN;
+  dec->tiles = NULL;
+  dec->nals = NULL;
+  dec->last_hash = 0;
+  dec->last_buffer = NULL;
   dec->codec_data = NULL;
   dec->codec_data_size = 0;
 #if GST_CHECK_VERSION(1,0,0)
@@ -193,6 +290,18 @@ gst_libde265_dec_init (GstLibde265Dec * dec)
   dec->fps_n = DEFAULT_FPS_N;
   dec->fps_d = DEFAULT_FPS_D;
   dec->max_threads = DEFAULT_MAX_THREADS;
+  dec->dither = DEFAULT_DITHER;
+  dec->roi_x = DEFAULT_ROI;
+  dec->roi_y = DEFAULT_ROI;
+  dec->roi_width = DEFAULT_ROI;
+  dec->roi_height = DEFAULT_ROI;
+  dec->reuse_repeated = DEFAULT_REUSE_REPEATED;
+  dec->max_pictures = DEFAULT_MAX_PICTURES;
+  dec->max_image_memory = DEFAULT_MAX_IMAGE_MEMORY;
+  dec->pictures = 0;
+  dec->image_memory = 0;
+  dec->image_memory_peak = 0;
+  dec->pictures_early = 0;
   dec->length_size = 4;
   _gst_libde265_dec_reset_decoder (dec);
 #if GST_CHECK_VERSION(1,0,0)
@@ -209,6 +318,13 @@ _gst_libde265_dec_free_decoder (GstLibde265Dec * dec)
     de265_free_decoder (dec->ctx);
   }
   free (dec->codec_data);
+  if (dec->tiles != NULL) {
+    gst_libde265_tiles_free (dec->tiles);
+  }
+  if (dec->nals != NULL) {
+    g_array_free (dec->nals, TRUE);
+  }
+  gst_buffer_replace (&dec->last_buffer, NULL);
 #if GST_CHECK_VERSION(1,0,0)
   if (dec->input_state != NULL) {
     gst_video_codec_state_unref (dec->input_state);
@@ -254,6 +370,35 @@ gst_libde265_dec_set_property (GObject * object, guint prop_id,
         GST_DEBUG_OBJECT (dec, "Max. threads set to auto");
       }
       break;
+    case PROP_DITHER:
+      dec->dither = g_value_get_enum (value);
+      GST_DEBUG_OBJECT (dec, "Dither mode set to %d", dec->dither);
+      break;
+    case PROP_ROI_X:
+      dec->roi_x = g_value_get_int (value);
+      break;
+    case PROP_ROI_Y:
+      dec->roi_y = g_value_get_int (value);
+      break;
+    case PROP_ROI_WIDTH:
+      dec->roi_width = g_value_get_int (value);
+      break;
+    case PROP_ROI_HEIGHT:
+      dec->roi_height = g_value_get_int (value);
+      break;
+    case PROP_REUSE_REPEATED:
+      dec->reuse_repeated = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_PICTURES:
+      GST_OBJECT_LOCK (dec);
+      dec->max_pictures = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_MAX_IMAGE_MEMORY:
+      GST_OBJECT_LOCK (dec);
+      dec->max_image_memory = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (dec);
+      break;
     default:
       break;
   }
@@ -275,13 +420,50 @@ gst_libde265_dec_get_property (GObject * object, guint prop_id,
     case PROP_MAX_THREADS:
       g_value_set_int (value, dec->max_threads);
       break;
+    case PROP_DITHER:
+      g_value_set_enum (value, dec->dither);
+      break;
+    case PROP_ROI_X:
+      g_value_set_int (value, dec->roi_x);
+      break;
+    case PROP_ROI_Y:
+      g_value_set_int (value, dec->roi_y);
+      break;
+    case PROP_ROI_WIDTH:
+      g_value_set_int (value, dec->roi_width);
+      break;
+    case PROP_ROI_HEIGHT:
+      g_value_set_int (value, dec->roi_height);
+      break;
+    case PROP_REUSE_REPEATED:
+      g_value_set_boolean (value, dec->reuse_repeated);
+      break;
+    case PROP_MAX_PICTURES:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_uint (value, dec->max_pictures);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_MAX_IMAGE_MEMORY:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_uint64 (value, dec->max_image_memory);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (dec);
+      g_value_take_boxed (value, gst_structure_new ("libde265dec-stats",
+              "pictures", G_TYPE_UINT, dec->pictures,
+              "image-memory", G_TYPE_UINT64, dec->image_memory,
+              "image-memory-peak", G_TYPE_UINT64, dec->image_memory_peak,
+              "pictures-early", G_TYPE_UINT64, dec->pictures_early, NULL));
+      GST_OBJECT_UNLOCK (dec);
+      break;
     default:
       break;
   }
 }
 
-static inline GstVideoFormat
-_gst_libde265_get_video_format (enum de265_chroma chroma, int bits_per_pixel)
+GstVideoFormat
+gst_libde265_get_video_format (enum de265_chroma chroma, int bits_per_pixel)
 {
   GstVideoFormat result = GST_VIDEO_FORMAT_UNKNOWN;
   switch (chroma) {
@@ -373,6 +555,73 @@ _gst_libde265_get_video_format (enum de265_chroma chroma, int bits_per_pixel)
   return result;
 }
 
+static inline GstVideoFormat
+_gst_libde265_get_8bit_video_format (GstVideoFormat format)
+{
+  switch (format) {
+#if GST_CHECK_VERSION(1,0,0)
+    case GST_VIDEO_FORMAT_I420_10LE:
+      return GST_VIDEO_FORMAT_I420;
+    case GST_VIDEO_FORMAT_I422_10LE:
+      return GST_VIDEO_FORMAT_Y42B;
+    case GST_VIDEO_FORMAT_Y444_10LE:
+      return GST_VIDEO_FORMAT_Y444;
+#endif
+    default:
+      return format;
+  }
+}
+
+/*
+ * Returns the format to output images of the given decoded format in.
+ * If downstream can't handle more than 8 bits per pixel, the 8 bit
+ * variant is used and the planes get converted while copying.
+ * The result is cached until the decoded format changes or downstream
+ * asks to renegotiate.
+ */
+static GstVideoFormat
+_gst_libde265_dec_get_output_format (GstLibde265Dec * dec,
+    GstVideoFormat format)
+{
+#if GST_CHECK_VERSION(1,0,0)
+  // a RECONFIGURE event or a new peer sets the flag, which is left for
+  // the base class to clear when it negotiates
+  if (G_LIKELY (format == dec->src_format
+          && !gst_pad_needs_reconfigure (GST_VIDEO_DECODER_SRC_PAD (dec)))) {
+    return dec->out_format;
+  }
+#else
+  if (G_LIKELY (format == dec->src_format)) {
+    return dec->out_format;
+  }
+#endif
+
+  GstVideoFormat result = format;
+#if GST_CHECK_VERSION(1,0,0)
+  GstVideoFormat fallback = _gst_libde265_get_8bit_video_format (format);
+  if (fallback != format) {
+    GstCaps *peer_caps =
+        gst_pad_peer_query_caps (GST_VIDEO_DECODER_SRC_PAD (dec), NULL);
+    if (peer_caps != NULL) {
+      GstCaps *caps = gst_caps_new_simple ("video/x-raw",
+          "format", G_TYPE_STRING, gst_video_format_to_string (format),
+          NULL);
+      if (!gst_caps_can_intersect (peer_caps, caps)) {
+        GST_INFO_OBJECT (dec, "Downstream doesn't support %s, using %s",
+            gst_video_format_to_string (format),
+            gst_video_format_to_string (fallback));
+        result = fallback;
+      }
+      gst_caps_unref (caps);
+      gst_caps_unref (peer_caps);
+    }
+  }
+#endif
+  dec->src_format = format;
+  dec->out_format = result;
+  return result;
+}
+
 /*
  * Direct rendering code needs GStreamer 1.0
  * to have support for refcounted frames.
@@ -417,7 +666,7 @@ gst_libde265_dec_release_frame_ref (struct GstLibde265FrameRef *ref)
 }
 
 static int
-gst_libde265_dec_get_buffer (de265_decoder_context * ctx,
+_gst_libde265_dec_alloc_image (de265_decoder_context * ctx,
     struct de265_image_spec *spec, struct de265_image *img, void *userdata)
 {
   VIDEO_DECODER_BASE *base = (VIDEO_DECODER_BASE *) userdata;
@@ -462,11 +711,26 @@ gst_libde265_dec_get_buffer (de265_decoder_context * ctx,
 
   int bits_per_pixel = de265_get_bits_per_pixel (img, 0);
   GstVideoFormat format =
-      _gst_libde265_get_video_format (chroma, bits_per_pixel);
+      gst_libde265_get_video_format (chroma, bits_per_pixel);
   if (format == GST_VIDEO_FORMAT_UNKNOWN) {
     goto fallback;
   }
 
+  if (_gst_libde265_dec_get_output_format (dec, format) != format) {
+    // images will be converted to a lower bit depth while copying
+    goto fallback;
+  }
+
+  if (dec->roi_width > 0 && dec->roi_height > 0) {
+    // only the region of interest gets copied to the output
+    goto fallback;
+  }
+
+  if (dec->reuse_repeated) {
+    // repeated pictures are detected while copying to the output
+    goto fallback;
+  }
+
   const GstVideoFormatInfo *format_info = gst_video_format_get_info (format);
   if (GST_VIDEO_FORMAT_INFO_BITS (format_info) != bits_per_pixel) {
     GST_DEBUG_OBJECT (dec,
@@ -544,8 +808,46 @@ fallback:
       spec, img, userdata);
 }
 
+static guint64
+_gst_libde265_dec_get_image_size (const struct de265_image *img)
+{
+  guint64 size = 0;
+  int plane;
+  for (plane = 0; plane < 3; plane++) {
+    int stride;
+    if (de265_get_image_plane (img, plane, &stride) != NULL) {
+      size += (guint64) stride * de265_get_image_height (img, plane);
+    }
+  }
+  return size;
+}
+
+/*
+ * Account the memory of all images allocated by the decoder, this
+ * includes reference pictures and pictures waiting for output.
+ */
+static int
+gst_libde265_dec_get_buffer (de265_decoder_context * ctx,
+    struct de265_image_spec *spec, struct de265_image *img, void *userdata)
+{
+  GstLibde265Dec *dec = GST_LIBDE265_DEC (userdata);
+  if (!_gst_libde265_dec_alloc_image (ctx, spec, img, userdata)) {
+    return 0;
+  }
+
+  guint64 size = _gst_libde265_dec_get_image_size (img);
+  GST_OBJECT_LOCK (dec);
+  dec->pictures++;
+  dec->image_memory += size;
+  if (dec->image_memory > dec->image_memory_peak) {
+    dec->image_memory_peak = dec->image_memory;
+  }
+  GST_OBJECT_UNLOCK (dec);
+  return 1;
+}
+
 static void
-gst_libde265_dec_release_buffer (de265_decoder_context * ctx,
+_gst_libde265_dec_free_image (de265_decoder_context * ctx,
     struct de265_image *img, void *userdata)
 {
   VIDEO_DECODER_BASE *base = (VIDEO_DECODER_BASE *) userdata;
@@ -559,7 +861,41 @@ gst_libde265_dec_release_buffer (de265_decoder_context * ctx,
   gst_libde265_dec_release_frame_ref (ref);
   (void) base;                  // unused
 }
+
+static void
+gst_libde265_dec_release_buffer (de265_decoder_context * ctx,
+    struct de265_image *img, void *userdata)
+{
+  GstLibde265Dec *dec = GST_LIBDE265_DEC (userdata);
+  guint64 size = _gst_libde265_dec_get_image_size (img);
+  GST_OBJECT_LOCK (dec);
+  if (dec->pictures > 0) {
+    dec->pictures--;
+  }
+  dec->image_memory -= MIN (size, dec->image_memory);
+  GST_OBJECT_UNLOCK (dec);
+
+  _gst_libde265_dec_free_image (ctx, img, userdata);
+}
+#endif
+
+int
+gst_libde265_get_cpu_count (void)
+{
+  int count;
+#if defined(_SC_NPROC_ONLN)
+  count = sysconf (_SC_NPROC_ONLN);
+#elif defined(_SC_NPROCESSORS_ONLN)
+  count = sysconf (_SC_NPROCESSORS_ONLN);
+#else
+#warning "Don't know how to get number of CPU cores, will use the default thread count"
+  count = DEFAULT_THREAD_COUNT;
 #endif
+  if (count <= 0) {
+    count = DEFAULT_THREAD_COUNT;
+  }
+  return count;
+}
 
 static gboolean
 gst_libde265_dec_start (VIDEO_DECODER_BASE * parse)
@@ -572,19 +908,11 @@ gst_libde265_dec_start (VIDEO_DECODER_BASE * parse)
   if (dec->ctx == NULL) {
     return FALSE;
   }
+  dec->tiles = gst_libde265_tiles_new ();
+  dec->nals = g_array_new (FALSE, FALSE, sizeof (GstLibde265TilesNal));
 
   if (threads == 0) {
-#if defined(_SC_NPROC_ONLN)
-    threads = sysconf (_SC_NPROC_ONLN);
-#elif defined(_SC_NPROCESSORS_ONLN)
-    threads = sysconf (_SC_NPROCESSORS_ONLN);
-#else
-#warning "Don't know how to get number of CPU cores, will use the default thread count"
-    threads = DEFAULT_THREAD_COUNT;
-#endif
-    if (threads <= 0) {
-      threads = DEFAULT_THREAD_COUNT;
-    }
+    threads = gst_libde265_get_cpu_count ();
     // XXX: We start more threads than cores for now, as some threads
     // might get blocked while waiting for dependent data. Having more
     // threads increases decoding speed by about 10%
@@ -637,6 +965,7 @@ gst_libde265_dec_reset (VIDEO_DECODER_BASE * parse)
 
   de265_reset (dec->ctx);
   dec->buffer_full = 0;
+  gst_buffer_replace (&dec->last_buffer, NULL);
   if (dec->codec_data != NULL && dec->mode == GST_TYPE_LIBDE265_DEC_RAW) {
     int more;
     de265_error err =
@@ -681,7 +1010,12 @@ _gst_libde265_image_available (VIDEO_DECODER_BASE * parse,
 {
   GstLibde265Dec *dec = GST_LIBDE265_DEC (parse);
 
-  if (G_UNLIKELY (width != dec->width || height != dec->height)) {
+  if (G_UNLIKELY (width != dec->width || height != dec->height
+#if GST_CHECK_VERSION(1,0,0)
+          || dec->output_state == NULL
+          || GST_VIDEO_INFO_FORMAT (&dec->output_state->info) != format
+#endif
+          )) {
 #if GST_CHECK_VERSION(1,0,0)
     GstVideoCodecState *state =
         gst_video_decoder_set_output_state (parse, format, width,
@@ -730,6 +1064,109 @@ _gst_libde265_image_available (VIDEO_DECODER_BASE * parse,
   return GST_FLOW_OK;
 }
 
+gboolean
+gst_libde265_dec_push_codec_data (GstElement * element,
+    de265_decoder_context * ctx, const uint8_t * data, gsize size,
+    GstLibde265DecMode * mode, int *length_size)
+{
+  de265_error err;
+
+  if (size > 3 && (data[0] || data[1] || data[2] > 1)) {
+    // encoded in "hvcC" format (assume version 0)
+    *mode = GST_TYPE_LIBDE265_DEC_PACKETIZED;
+    if (size > 22) {
+      int i;
+      if (data[0] != 0) {
+        GST_ELEMENT_WARNING (element, STREAM,
+            DECODE, ("Unsupported extra data version %d, decoding may fail",
+                data[0]), (NULL));
+      }
+      *length_size = (data[21] & 3) + 1;
+      int num_param_sets = data[22];
+      int pos = 23;
+      for (i = 0; i < num_param_sets; i++) {
+        int j;
+        if (pos + 3 > size) {
+          GST_ELEMENT_ERROR (element, STREAM, DECODE,
+              ("Buffer underrun in extra header (%d >= %ld)", pos + 3,
+                  size), (NULL));
+          return FALSE;
+        }
+        // ignore flags + NAL type (1 byte)
+        int nal_count = data[pos + 1] << 8 | data[pos + 2];
+        pos += 3;
+        for (j = 0; j < nal_count; j++) {
+          if (pos + 2 > size) {
+            GST_ELEMENT_ERROR (element, STREAM, DECODE,
+                ("Buffer underrun in extra nal header (%d >= %ld)", pos + 2,
+                    size), (NULL));
+            return FALSE;
+          }
+          int nal_size = data[pos] << 8 | data[pos + 1];
+          if (pos + 2 + nal_size > size) {
+            GST_ELEMENT_ERROR (element, STREAM, DECODE,
+                ("Buffer underrun in extra nal (%d >= %ld)",
+                    pos + 2 + nal_size, size), (NULL));
+            return FALSE;
+          }
+          err = de265_push_NAL (ctx, data + pos + 2, nal_size, 0, NULL);
+          if (!de265_isOK (err)) {
+            GST_ELEMENT_ERROR (element, STREAM, DECODE,
+                ("Failed to push data: %s (%d)", de265_get_error_text (err),
+                    err), (NULL));
+            return FALSE;
+          }
+          pos += 2 + nal_size;
+        }
+      }
+    }
+    GST_DEBUG ("Assuming packetized data (%d bytes length)", *length_size);
+  } else {
+    *mode = GST_TYPE_LIBDE265_DEC_RAW;
+    GST_DEBUG ("Assuming non-packetized data");
+    err = de265_push_data (ctx, data, size, 0, NULL);
+    if (!de265_isOK (err)) {
+      GST_ELEMENT_ERROR (element, STREAM, DECODE,
+          ("Failed to push codec data: %s (code=%d)",
+              de265_get_error_text (err), err), (NULL));
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+gboolean
+gst_libde265_dec_push_packetized (GstElement * element,
+    de265_decoder_context * ctx, const uint8_t * data, gsize size,
+    int length_size, de265_PTS pts)
+{
+  const uint8_t *end_data = data + size;
+  de265_error ret;
+
+  // stream contains length fields and NALs
+  while (data + length_size <= end_data) {
+    int nal_size = 0;
+    int i;
+    for (i = 0; i < length_size; i++) {
+      nal_size = (nal_size << 8) | data[i];
+    }
+    if (data + length_size + nal_size > end_data) {
+      GST_ELEMENT_ERROR (element, STREAM, DECODE,
+          ("Overflow in input data, check data mode"), (NULL));
+      return FALSE;
+    }
+    ret = de265_push_NAL (ctx, data + length_size, nal_size, pts, NULL);
+    if (ret != DE265_OK) {
+      GST_ELEMENT_ERROR (element, STREAM, DECODE,
+          ("Error while pushing data: %s (code=%d)",
+              de265_get_error_text (ret), ret), (NULL));
+      return FALSE;
+    }
+    data += length_size + nal_size;
+  }
+  return TRUE;
+}
+
 static gboolean
 gst_libde265_dec_set_format (VIDEO_DECODER_BASE * parse, VIDEO_STATE * state)
 {
@@ -776,72 +1213,14 @@ gst_libde265_dec_set_format (VIDEO_DECODER_BASE * parse, VIDEO_STATE * state)
       g_assert (dec->codec_data != NULL);
       dec->codec_data_size = size;
       memcpy (dec->codec_data, data, size);
-      if (size > 3 && (data[0] || data[1] || data[2] > 1)) {
-        // encoded in "hvcC" format (assume version 0)
-        dec->mode = GST_TYPE_LIBDE265_DEC_PACKETIZED;
-        if (size > 22) {
-          int i;
-          if (data[0] != 0) {
-            GST_ELEMENT_WARNING (parse, STREAM,
-                DECODE, ("Unsupported extra data version %d, decoding may fail",
-                    data[0]), (NULL));
-          }
-          dec->length_size = (data[21] & 3) + 1;
-          int num_param_sets = data[22];
-          int pos = 23;
-          for (i = 0; i < num_param_sets; i++) {
-            int j;
-            if (pos + 3 > size) {
-              GST_ELEMENT_ERROR (parse, STREAM, DECODE,
-                  ("Buffer underrun in extra header (%d >= %ld)", pos + 3,
-                      size), (NULL));
-              return FALSE;
-            }
-            // ignore flags + NAL type (1 byte)
-            int nal_count = data[pos + 1] << 8 | data[pos + 2];
-            pos += 3;
-            for (j = 0; j < nal_count; j++) {
-              if (pos + 2 > size) {
-                GST_ELEMENT_ERROR (parse, STREAM, DECODE,
-                    ("Buffer underrun in extra nal header (%d >= %ld)", pos + 2,
-                        size), (NULL));
-                return FALSE;
-              }
-              int nal_size = data[pos] << 8 | data[pos + 1];
-              if (pos + 2 + nal_size > size) {
-                GST_ELEMENT_ERROR (parse, STREAM, DECODE,
-                    ("Buffer underrun in extra nal (%d >= %ld)",
-                        pos + 2 + nal_size, size), (NULL));
-                return FALSE;
-              }
-              err =
-                  de265_push_NAL (dec->ctx, data + pos + 2, nal_size, 0, NULL);
-              if (!de265_isOK (err)) {
-                GST_ELEMENT_ERROR (parse, STREAM, DECODE,
-                    ("Failed to push data: %s (%d)", de265_get_error_text (err),
-                        err), (NULL));
-                return FALSE;
-              }
-              pos += 2 + nal_size;
-            }
-          }
-        }
-        GST_DEBUG ("Assuming packetized data (%d bytes length)",
-            dec->length_size);
-      } else {
-        dec->mode = GST_TYPE_LIBDE265_DEC_RAW;
-        GST_DEBUG ("Assuming non-packetized data");
-        err = de265_push_data (dec->ctx, data, size, 0, NULL);
-        if (!de265_isOK (err)) {
+      if (!gst_libde265_dec_push_codec_data (GST_ELEMENT (parse), dec->ctx,
+              data, size, &dec->mode, &dec->length_size)) {
 #if GST_CHECK_VERSION(1,0,0)
-          gst_buffer_unmap (buf, &info);
+        gst_buffer_unmap (buf, &info);
 #endif
-          GST_ELEMENT_ERROR (parse, STREAM, DECODE,
-              ("Failed to push codec data: %s (code=%d)",
-                  de265_get_error_text (err), err), (NULL));
-          return FALSE;
-        }
+        return FALSE;
       }
+      gst_libde265_tiles_parse_codec_data (dec->tiles, data, size);
 #if GST_CHECK_VERSION(1,0,0)
       gst_buffer_unmap (buf, &info);
 #endif
@@ -879,12 +1258,263 @@ gst_libde265_dec_set_format (VIDEO_DECODER_BASE * parse, VIDEO_STATE * state)
   return TRUE;
 }
 
+/*
+ * Push the NAL units of an access unit, skipping slices of tiles that
+ * don't intersect the region of interest. This only gives correct
+ * results for streams where the motion vectors don't cross tile
+ * boundaries (motion-constrained tile sets).
+ */
+static gboolean
+_gst_libde265_dec_push_roi (GstLibde265Dec * dec, const uint8_t * data,
+    gsize size, de265_PTS pts)
+{
+  guint i;
+
+  g_array_set_size (dec->nals, 0);
+  if (!gst_libde265_tiles_filter (dec->tiles, data, size, dec->length_size,
+          dec->roi_x, dec->roi_y, dec->roi_width, dec->roi_height,
+          dec->nals)) {
+    GST_ELEMENT_ERROR (dec, STREAM, DECODE,
+        ("Overflow in input data, check data mode"), (NULL));
+    return FALSE;
+  }
+
+  for (i = 0; i < dec->nals->len; i++) {
+    GstLibde265TilesNal *nal = &g_array_index (dec->nals,
+        GstLibde265TilesNal, i);
+    if (!nal->keep) {
+      GST_LOG_OBJECT (dec, "Skipping slice outside of region of interest");
+      continue;
+    }
+    de265_error ret =
+        de265_push_NAL (dec->ctx, data + nal->offset, nal->size, pts, NULL);
+    if (ret != DE265_OK) {
+      GST_ELEMENT_ERROR (dec, STREAM, DECODE,
+          ("Error while pushing data: %s (code=%d)",
+              de265_get_error_text (ret), ret), (NULL));
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/*
+ * Get the part of the image to output, the region of interest is
+ * clipped to the image and aligned for subsampled chroma planes.
+ */
+static void
+_gst_libde265_dec_get_roi (GstLibde265Dec * dec, int image_width,
+    int image_height, int *x, int *y, int *width, int *height)
+{
+  *x = 0;
+  *y = 0;
+  *width = image_width;
+  *height = image_height;
+  if (dec->roi_width <= 0 || dec->roi_height <= 0) {
+    return;
+  }
+
+  int x0 = MIN (dec->roi_x, image_width) & ~1;
+  int y0 = MIN (dec->roi_y, image_height) & ~1;
+  // the properties go up to G_MAXINT, so the end may not fit into an int
+  int x1 = MIN (((gint64) dec->roi_x + dec->roi_width + 1) & ~1,
+      image_width);
+  int y1 = MIN (((gint64) dec->roi_y + dec->roi_height + 1) & ~1,
+      image_height);
+  if (x1 <= x0 || y1 <= y0) {
+    GST_DEBUG_OBJECT (dec, "Region of interest outside of image");
+    return;
+  }
+  *x = x0;
+  *y = y0;
+  *width = x1 - x0;
+  *height = y1 - y0;
+}
+
+/*
+ * Copy a decoded picture to the output buffer of "frame" (or use the
+ * buffer it was decoded into) and push it downstream. Takes ownership
+ * of "frame".
+ */
+static GstFlowReturn
+_gst_libde265_dec_finish_picture (GstLibde265Dec * dec, VIDEO_FRAME * frame,
+    const struct de265_image *img)
+{
+  VIDEO_DECODER_BASE *parse = (VIDEO_DECODER_BASE *) dec;
+#if GST_CHECK_VERSION(1,0,0)
+  GstMapInfo info;
+  struct GstLibde265FrameRef *ref =
+      (struct GstLibde265FrameRef *) de265_get_image_plane_user_data (img, 0);
+  if (ref != NULL) {
+    // decoder is using direct rendering
+    if (frame != NULL) {
+      gst_video_codec_frame_unref (frame);
+    }
+    VIDEO_FRAME *out_frame = gst_video_codec_frame_ref (ref->frame);
+    gst_buffer_replace (&out_frame->output_buffer, ref->buffer);
+    gst_buffer_replace (&ref->buffer, NULL);
+    FRAME_PTS (out_frame) = (GstClockTime) de265_get_image_PTS (img);
+    return FINISH_FRAME (parse, out_frame);
+  }
+
+  GST_VIDEO_CODEC_FRAME_FLAG_UNSET (frame,
+      GST_VIDEO_CODEC_FRAME_FLAG_DECODE_ONLY);
+#endif
+
+  int bits_per_pixel = MAX (MAX (de265_get_bits_per_pixel (img, 0),
+          de265_get_bits_per_pixel (img, 1)), de265_get_bits_per_pixel (img,
+          2));
+
+  GstVideoFormat format =
+      gst_libde265_get_video_format (de265_get_chroma_format (img),
+      bits_per_pixel);
+  if (format == GST_VIDEO_FORMAT_UNKNOWN) {
+    GST_ERROR_OBJECT (dec, "Unsupported image format");
+    return GST_FLOW_ERROR;
+  }
+
+  format = _gst_libde265_dec_get_output_format (dec, format);
+
+  int image_width = de265_get_image_width (img, 0);
+  int roi_x, roi_y, roi_width, roi_height;
+  _gst_libde265_dec_get_roi (dec, image_width,
+      de265_get_image_height (img, 0), &roi_x, &roi_y, &roi_width,
+      &roi_height);
+
+  GstFlowReturn result =
+      _gst_libde265_image_available (parse, roi_width, roi_height, format);
+  if (result != GST_FLOW_OK) {
+    GST_ERROR_OBJECT (dec, "Failed to notify about available image");
+    return result;
+  }
+
+  guint64 hash = 0;
+  if (dec->reuse_repeated) {
+    // the output also depends on the format, size and dither mode
+    guint64 seed = format | ((guint64) dec->dither << 8)
+        | ((guint64) roi_width << 16) | ((guint64) roi_height << 40);
+    hash = gst_libde265_convert_hash_image_region (img, roi_x, roi_y,
+        roi_width, roi_height, seed);
+    if (dec->last_buffer != NULL && hash == dec->last_hash) {
+      GST_LOG_OBJECT (dec, "Picture didn't change, reusing previous buffer");
+#if GST_CHECK_VERSION(1,0,0)
+      gst_buffer_replace (&frame->output_buffer, dec->last_buffer);
+#else
+      gst_buffer_replace (&frame->src_buffer, dec->last_buffer);
+#endif
+      FRAME_PTS (frame) = (GstClockTime) de265_get_image_PTS (img);
+      return FINISH_FRAME (parse, frame);
+    }
+  }
+
+  result = ALLOC_OUTPUT_FRAME (parse, frame);
+  if (result != GST_FLOW_OK) {
+    GST_ERROR_OBJECT (dec, "Failed to allocate output frame");
+    return result;
+  }
+
+  uint8_t *dest;
+#if GST_CHECK_VERSION(1,0,0)
+  if (!gst_buffer_map (frame->output_buffer, &info, GST_MAP_WRITE)) {
+    GST_ERROR_OBJECT (dec, "Failed to map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  dest = info.data;
+#else
+  dest = GST_BUFFER_DATA (frame->src_buffer);
+#endif
+
+#if GST_CHECK_VERSION(1,0,0)
+  const GstVideoFormatInfo *format_info = gst_video_format_get_info (format);
+  int max_bits_per_pixel = GST_VIDEO_FORMAT_INFO_BITS (format_info);
+#else
+  int max_bits_per_pixel = 8;
+#endif
+
+  // convert directly into the output buffer in a single pass
+  uint8_t *planes[3];
+  int strides[3];
+  int plane;
+  for (plane = 0; plane < 3; plane++) {
+    int plane_width = de265_get_image_width (img, plane) * roi_width
+        / image_width;
+    int plane_height = de265_get_image_height (img, plane) * roi_height
+        / de265_get_image_height (img, 0);
+    planes[plane] = dest;
+    strides[plane] = plane_width * ((max_bits_per_pixel + 7) / 8);
+    dest += plane_height * strides[plane];
+  }
+  gst_libde265_convert_image_region (img, roi_x, roi_y, roi_width,
+      roi_height, planes, strides, max_bits_per_pixel, dec->dither);
+#if GST_CHECK_VERSION(1,0,0)
+  gst_buffer_unmap (frame->output_buffer, &info);
+#endif
+  if (dec->reuse_repeated) {
+    // keep a reference, the buffer can't be written to by downstream
+    // elements while it is shared
+    dec->last_hash = hash;
+#if GST_CHECK_VERSION(1,0,0)
+    gst_buffer_replace (&dec->last_buffer, frame->output_buffer);
+#else
+    gst_buffer_replace (&dec->last_buffer, frame->src_buffer);
+#endif
+  }
+  FRAME_PTS (frame) = (GstClockTime) de265_get_image_PTS (img);
+  return FINISH_FRAME (parse, frame);
+}
+
+#if GST_CHECK_VERSION(1,0,0)
+static gboolean
+_gst_libde265_dec_over_limits (GstLibde265Dec * dec)
+{
+  gboolean result;
+
+  GST_OBJECT_LOCK (dec);
+  result = (dec->max_pictures > 0 && dec->pictures > dec->max_pictures)
+      || (dec->max_image_memory > 0
+      && dec->image_memory > dec->max_image_memory);
+  GST_OBJECT_UNLOCK (dec);
+  return result;
+}
+
+/*
+ * Push pictures that are ready for output early while the decoder holds
+ * more pictures or image memory than configured, so the memory is
+ * released as soon as possible.
+ */
+static GstFlowReturn
+_gst_libde265_dec_drain_pictures (GstLibde265Dec * dec)
+{
+  VIDEO_DECODER_BASE *parse = (VIDEO_DECODER_BASE *) dec;
+  const struct de265_image *img;
+  GstFlowReturn result = GST_FLOW_OK;
+
+  while (result == GST_FLOW_OK && _gst_libde265_dec_over_limits (dec)
+      && (img = de265_peek_next_picture (dec->ctx)) != NULL) {
+    VIDEO_FRAME *frame = NULL;
+    if (de265_get_image_plane_user_data (img, 0) == NULL) {
+      frame = gst_video_decoder_get_oldest_frame (parse);
+      if (frame == NULL) {
+        break;
+      }
+    }
+    GST_LOG_OBJECT (dec, "Decoder over limits, pushing picture early");
+    GST_OBJECT_LOCK (dec);
+    dec->pictures_early++;
+    GST_OBJECT_UNLOCK (dec);
+    result = _gst_libde265_dec_finish_picture (dec, frame,
+        de265_get_next_picture (dec->ctx));
+  }
+  return result;
+}
+#endif
+
 static GstFlowReturn
 gst_libde265_dec_handle_frame (VIDEO_DECODER_BASE * parse, VIDEO_FRAME * frame)
 {
   GstLibde265Dec *dec = GST_LIBDE265_DEC (parse);
   uint8_t *frame_data;
-  uint8_t *end_data;
   const struct de265_image *img;
   de265_error ret = DE265_OK;
   int more = 0;
@@ -904,37 +1534,21 @@ gst_libde265_dec_handle_frame (VIDEO_DECODER_BASE * parse, VIDEO_FRAME * frame)
   frame_data = GST_BUFFER_DATA (frame->sink_buffer);
   size = GST_BUFFER_SIZE (frame->sink_buffer);
 #endif
-  end_data = frame_data + size;
 
 #if GST_CHECK_VERSION(1,0,0)
   GST_VIDEO_CODEC_FRAME_FLAG_SET (frame,
       GST_VIDEO_CODEC_FRAME_FLAG_DECODE_ONLY);
 #endif
   if (size > 0) {
-    if (dec->mode == GST_TYPE_LIBDE265_DEC_PACKETIZED) {
-      // stream contains length fields and NALs
-      uint8_t *start_data = frame_data;
-      while (start_data + dec->length_size <= end_data) {
-        int nal_size = 0;
-        int i;
-        for (i = 0; i < dec->length_size; i++) {
-          nal_size = (nal_size << 8) | start_data[i];
-        }
-        if (start_data + dec->length_size + nal_size > end_data) {
-          GST_ELEMENT_ERROR (parse, STREAM, DECODE,
-              ("Overflow in input data, check data mode"), (NULL));
-          goto error_input;
-        }
-        ret =
-            de265_push_NAL (dec->ctx, start_data + dec->length_size, nal_size,
-            pts, NULL);
-        if (ret != DE265_OK) {
-          GST_ELEMENT_ERROR (parse, STREAM, DECODE,
-              ("Error while pushing data: %s (code=%d)",
-                  de265_get_error_text (ret), ret), (NULL));
-          goto error_input;
-        }
-        start_data += dec->length_size + nal_size;
+    if (dec->mode == GST_TYPE_LIBDE265_DEC_PACKETIZED
+        && dec->roi_width > 0 && dec->roi_height > 0) {
+      if (!_gst_libde265_dec_push_roi (dec, frame_data, size, pts)) {
+        goto error_input;
+      }
+    } else if (dec->mode == GST_TYPE_LIBDE265_DEC_PACKETIZED) {
+      if (!gst_libde265_dec_push_packetized (GST_ELEMENT (parse), dec->ctx,
+              frame_data, size, dec->length_size, pts)) {
+        goto error_input;
       }
     } else {
       ret = de265_push_data (dec->ctx, frame_data, size, pts, NULL);
@@ -995,160 +1609,14 @@ gst_libde265_dec_handle_frame (VIDEO_DECODER_BASE * parse, VIDEO_FRAME * frame)
     // need more data
     return GST_FLOW_OK;
   }
-#if GST_CHECK_VERSION(1,0,0)
-  struct GstLibde265FrameRef *ref =
-      (struct GstLibde265FrameRef *) de265_get_image_plane_user_data (img, 0);
-  if (ref != NULL) {
-    // decoder is using direct rendering
-    gst_video_codec_frame_unref (frame);
-    VIDEO_FRAME *out_frame = gst_video_codec_frame_ref (ref->frame);
-    gst_buffer_replace (&out_frame->output_buffer, ref->buffer);
-    gst_buffer_replace (&ref->buffer, NULL);
-    FRAME_PTS (out_frame) = (GstClockTime) de265_get_image_PTS (img);
-    return FINISH_FRAME (parse, out_frame);
-  }
-
-  GST_VIDEO_CODEC_FRAME_FLAG_UNSET (frame,
-      GST_VIDEO_CODEC_FRAME_FLAG_DECODE_ONLY);
-#endif
-
-  int bits_per_pixel = MAX (MAX (de265_get_bits_per_pixel (img, 0),
-          de265_get_bits_per_pixel (img, 1)), de265_get_bits_per_pixel (img,
-          2));
-
-  GstVideoFormat format =
-      _gst_libde265_get_video_format (de265_get_chroma_format (img),
-      bits_per_pixel);
-  if (format == GST_VIDEO_FORMAT_UNKNOWN) {
-    GST_ERROR_OBJECT (dec, "Unsupported image format");
-    return GST_FLOW_ERROR;
-  }
-
-  GstFlowReturn result =
-      _gst_libde265_image_available (parse, de265_get_image_width (img, 0),
-      de265_get_image_height (img, 0), format);
-  if (result != GST_FLOW_OK) {
-    GST_ERROR_OBJECT (dec, "Failed to notify about available image");
-    return result;
-  }
-
-  result = ALLOC_OUTPUT_FRAME (parse, frame);
-  if (result != GST_FLOW_OK) {
-    GST_ERROR_OBJECT (dec, "Failed to allocate output frame");
-    return result;
-  }
-
-  uint8_t *dest;
-#if GST_CHECK_VERSION(1,0,0)
-  if (!gst_buffer_map (frame->output_buffer, &info, GST_MAP_WRITE)) {
-    GST_ERROR_OBJECT (dec, "Failed to map output buffer");
-    return GST_FLOW_ERROR;
-  }
-
-  dest = info.data;
-#else
-  dest = GST_BUFFER_DATA (frame->src_buffer);
-#endif
 
+  GstFlowReturn result = _gst_libde265_dec_finish_picture (dec, frame, img);
 #if GST_CHECK_VERSION(1,0,0)
-  const GstVideoFormatInfo *format_info = gst_video_format_get_info (format);
-  int max_bits_per_pixel = GST_VIDEO_FORMAT_INFO_BITS (format_info);
-#else
-  int max_bits_per_pixel = 8;
-#endif
-
-  int plane;
-  for (plane = 0; plane < 3; plane++) {
-    int stride;
-    int pos;
-    int width = de265_get_image_width (img, plane);
-    int height = de265_get_image_height (img, plane);
-    const uint8_t *src = de265_get_image_plane (img, plane, &stride);
-    int dst_stride = width * ((max_bits_per_pixel + 7) / 8);
-    int plane_bits_per_pixel = de265_get_bits_per_pixel (img, plane);
-    if (plane_bits_per_pixel > max_bits_per_pixel && max_bits_per_pixel > 8) {
-      // More bits per pixel in this plane than supported by the output format
-      int shift = (plane_bits_per_pixel - max_bits_per_pixel);
-      int size = MIN (stride, dst_stride);
-      while (height--) {
-        uint16_t *s = (uint16_t *) src;
-        uint16_t *d = (uint16_t *) dest;
-        for (pos = 0; pos < size / 2; pos++) {
-          *d = *s >> shift;
-          d++;
-          s++;
-        }
-        src += stride;
-        dest += dst_stride;
-      }
-    } else if (plane_bits_per_pixel > max_bits_per_pixel
-        && max_bits_per_pixel == 8) {
-      // More bits per pixel in this plane than supported by the output format
-      int shift = (plane_bits_per_pixel - max_bits_per_pixel);
-      int size = MIN (stride, dst_stride);
-      while (height--) {
-        uint16_t *s = (uint16_t *) src;
-        uint8_t *d = (uint8_t *) dest;
-        for (pos = 0; pos < size; pos++) {
-          *d = *s >> shift;
-          d++;
-          s++;
-        }
-        src += stride;
-        dest += dst_stride;
-      }
-    } else if (plane_bits_per_pixel < max_bits_per_pixel
-        && plane_bits_per_pixel > 8) {
-      // Less bits per pixel in this plane than the rest of the picture
-      // but more than 8bpp.
-      int shift = (plane_bits_per_pixel - max_bits_per_pixel);
-      int size = MIN (stride, dst_stride);
-      while (height--) {
-        uint16_t *s = (uint16_t *) src;
-        uint16_t *d = (uint16_t *) dest;
-        for (pos = 0; pos < size / 2; pos++) {
-          *d = *s >> shift;
-          d++;
-          s++;
-        }
-        src += stride;
-        dest += dst_stride;
-      }
-    } else if (plane_bits_per_pixel < max_bits_per_pixel
-        && plane_bits_per_pixel == 8) {
-      // 8 bits per pixel in this plane, which is less than the rest of the picture.
-      int shift = (max_bits_per_pixel - plane_bits_per_pixel);
-      int size = MIN (stride, dst_stride);
-      while (height--) {
-        uint8_t *s = (uint8_t *) src;
-        uint16_t *d = (uint16_t *) dest;
-        for (pos = 0; pos < size; pos++) {
-          *d = *s << shift;
-          d++;
-          s++;
-        }
-        src += stride;
-        dest += dst_stride;
-      }
-    } else {
-      // Bits per pixel of image match output format.
-      if (stride == width) {
-        memcpy (dest, src, height * stride);
-        dest += (height * stride);
-      } else {
-        while (height--) {
-          memcpy (dest, src, width);
-          src += stride;
-          dest += width;
-        }
-      }
-    }
+  if (result == GST_FLOW_OK) {
+    result = _gst_libde265_dec_drain_pictures (dec);
   }
-#if GST_CHECK_VERSION(1,0,0)
-  gst_buffer_unmap (frame->output_buffer, &info);
 #endif
-  FRAME_PTS (frame) = (GstClockTime) de265_get_image_PTS (img);
-  return FINISH_FRAME (parse, frame);
+  return result;
 
 error_input:
 #if GST_CHECK_VERSION(1,0,0)
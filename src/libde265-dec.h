@@ -61,6 +61,8 @@
 
 #include <libde265/de265.h>
 
+#include "libde265-tiles.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_LIBDE265_DEC \
@@ -76,6 +78,15 @@ typedef enum {
   GST_TYPE_LIBDE265_DEC_RAW
 } GstLibde265DecMode;
 
+typedef enum {
+  GST_TYPE_LIBDE265_DEC_DITHER_TRUNCATE,
+  GST_TYPE_LIBDE265_DEC_DITHER_ROUND,
+  GST_TYPE_LIBDE265_DEC_DITHER_ORDERED
+} GstLibde265DecDither;
+
+#define GST_TYPE_LIBDE265_DEC_DITHER (gst_libde265_dec_dither_get_type ())
+GType gst_libde265_dec_dither_get_type (void);
+
 typedef struct _GstLibde265Dec {
     VIDEO_DECODER_BASE      parent;
 
@@ -89,6 +100,25 @@ typedef struct _GstLibde265Dec {
     int                     fps_d;
     int                     max_threads;
     int                     buffer_full;
+    GstLibde265DecDither    dither;
+    GstVideoFormat          src_format;
+    GstVideoFormat          out_format;
+    int                     roi_x;
+    int                     roi_y;
+    int                     roi_width;
+    int                     roi_height;
+    GstLibde265Tiles        *tiles;
+    GArray                  *nals;
+    gboolean                reuse_repeated;
+    guint64                 last_hash;
+    GstBuffer               *last_buffer;
+    guint                   max_pictures;
+    guint64                 max_image_memory;
+    /* image memory accounting, protected by the object lock */
+    guint                   pictures;
+    guint64                 image_memory;
+    guint64                 image_memory_peak;
+    guint64                 pictures_early;
     void                    *codec_data;
     int                     codec_data_size;
 #if GST_CHECK_VERSION(1,0,0)
@@ -106,4 +136,15 @@ G_END_DECLS
 
 gboolean gst_libde265_dec_plugin_init (GstPlugin *plugin);
 
+/* helpers shared with the multi-stream decoder */
+int gst_libde265_get_cpu_count (void);
+GstVideoFormat gst_libde265_get_video_format (enum de265_chroma chroma,
+    int bits_per_pixel);
+gboolean gst_libde265_dec_push_codec_data (GstElement * element,
+    de265_decoder_context * ctx, const uint8_t * data, gsize size,
+    GstLibde265DecMode * mode, int *length_size);
+gboolean gst_libde265_dec_push_packetized (GstElement * element,
+    de265_decoder_context * ctx, const uint8_t * data, gsize size,
+    int length_size, de265_PTS pts);
+
 #endif  // __GST_LIBDE265_DEC_H__
@@ -0,0 +1,1180 @@
+/*
+ * GStreamer HEVC/H.265 video codec.
+ *
+ * Copyright (c) 2014 struktur AG, Joachim Bauch <bauch@struktur.de>
+ *
+ * This file is part of gstreamer-libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decoder for multiple independent HEVC/H.265 streams. Every "sink_%u"
+ * request pad gets its own libde265 context and a matching "src_%u" pad.
+ * Instead of a thread pool per stream, all contexts are decoded by one
+ * fixed set of worker threads. Streams that have data queued are picked
+ * by weighted fair scheduling, so each stream gets decoder time according
+ * to its "priority" and no stream can starve the others. Decoded pictures
+ * are pushed downstream by a task on each src pad, a stream whose output
+ * queue is full isn't scheduled until its task caught up.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libde265-mdec.h"
+#include "libde265-convert.h"
+
+#if GST_CHECK_VERSION(1,0,0)
+
+#define parent_class gst_libde265_mdec_parent_class
+G_DEFINE_TYPE (GstLibde265MDec, gst_libde265_mdec, GST_TYPE_ELEMENT);
+G_DEFINE_TYPE (GstLibde265MDecPad, gst_libde265_mdec_pad, GST_TYPE_PAD);
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("video/x-h265")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ I420, Y42B, Y444, GRAY8, "
+            "I420_10LE, I422_10LE, Y444_10LE }"))
+    );
+
+enum
+{
+  PROP_0,
+  PROP_MAX_THREADS,
+  PROP_MAX_QUEUED,
+  PROP_DITHER,
+  PROP_LAST
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_PRIORITY,
+  PROP_PAD_STATS,
+  PROP_PAD_LAST
+};
+
+#define DEFAULT_MAX_THREADS 0
+#define DEFAULT_MAX_QUEUED  4
+#define DEFAULT_DITHER      GST_TYPE_LIBDE265_DEC_DITHER_TRUNCATE
+#define DEFAULT_PRIORITY    100
+
+#define GST_LIBDE265_MDEC_LOCK(mdec)   g_mutex_lock (&(mdec)->lock)
+#define GST_LIBDE265_MDEC_UNLOCK(mdec) g_mutex_unlock (&(mdec)->lock)
+
+/* queued buffer or serialized event with the time it was queued at */
+typedef struct _GstLibde265MDecItem
+{
+  GstMiniObject *object;
+  gint64 queued_at;
+} GstLibde265MDecItem;
+
+static void gst_libde265_mdec_finalize (GObject * object);
+static void gst_libde265_mdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_libde265_mdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn gst_libde265_mdec_change_state (GstElement *
+    element, GstStateChange transition);
+static GstPad *gst_libde265_mdec_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_libde265_mdec_release_pad (GstElement * element, GstPad * pad);
+
+static GstFlowReturn gst_libde265_mdec_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer);
+static gboolean gst_libde265_mdec_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static GstIterator *gst_libde265_mdec_iterate_internal_links (GstPad * pad,
+    GstObject * parent);
+static gboolean gst_libde265_mdec_src_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active);
+static void gst_libde265_mdec_src_loop (GstPad * pad);
+static void _gst_libde265_mdec_schedule (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream);
+
+/* pad type */
+
+static void gst_libde265_mdec_pad_finalize (GObject * object);
+static void gst_libde265_mdec_pad_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_libde265_mdec_pad_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+
+static void
+gst_libde265_mdec_pad_class_init (GstLibde265MDecPadClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = gst_libde265_mdec_pad_finalize;
+  gobject_class->set_property = gst_libde265_mdec_pad_set_property;
+  gobject_class->get_property = gst_libde265_mdec_pad_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_PRIORITY,
+      g_param_spec_uint ("priority", "Priority",
+          "Share of decoder time relative to the other streams",
+          1, 10000, DEFAULT_PRIORITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PAD_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Decoding statistics of this stream", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_libde265_mdec_pad_init (GstLibde265MDecPad * stream)
+{
+  stream->mode = GST_TYPE_LIBDE265_DEC_PACKETIZED;
+  stream->length_size = 4;
+  stream->format = GST_VIDEO_FORMAT_UNKNOWN;
+  gst_video_info_init (&stream->info);
+  g_queue_init (&stream->queue);
+  g_queue_init (&stream->out_queue);
+  g_cond_init (&stream->out_cond);
+  stream->out_flushing = TRUE;
+  stream->last_flow = GST_FLOW_OK;
+  stream->priority = DEFAULT_PRIORITY;
+}
+
+static void
+_gst_libde265_mdec_clear_queue (GstLibde265MDecPad * stream)
+{
+  GstLibde265MDecItem *item;
+
+  while ((item = g_queue_pop_head (&stream->queue)) != NULL) {
+    gst_mini_object_unref (item->object);
+    g_slice_free (GstLibde265MDecItem, item);
+  }
+  stream->queued_buffers = 0;
+}
+
+static void
+_gst_libde265_mdec_clear_out_queue (GstLibde265MDecPad * stream)
+{
+  GstMiniObject *object;
+
+  while ((object = g_queue_pop_head (&stream->out_queue)) != NULL) {
+    gst_mini_object_unref (object);
+  }
+  stream->out_buffers = 0;
+}
+
+static void
+gst_libde265_mdec_pad_finalize (GObject * object)
+{
+  GstLibde265MDecPad *stream = GST_LIBDE265_MDEC_PAD (object);
+
+  _gst_libde265_mdec_clear_queue (stream);
+  _gst_libde265_mdec_clear_out_queue (stream);
+  g_cond_clear (&stream->out_cond);
+  gst_event_replace (&stream->segment_event, NULL);
+  if (stream->ctx != NULL) {
+    de265_free_decoder (stream->ctx);
+  }
+
+  G_OBJECT_CLASS (gst_libde265_mdec_pad_parent_class)->finalize (object);
+}
+
+static GstLibde265MDec *
+_gst_libde265_mdec_pad_get_decoder (GstLibde265MDecPad * stream)
+{
+  GstObject *parent = gst_object_get_parent (GST_OBJECT (stream));
+  if (parent == NULL) {
+    return NULL;
+  }
+  return GST_LIBDE265_MDEC (parent);
+}
+
+static void
+gst_libde265_mdec_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstLibde265MDecPad *stream = GST_LIBDE265_MDEC_PAD (object);
+  GstLibde265MDec *mdec = _gst_libde265_mdec_pad_get_decoder (stream);
+
+  if (mdec != NULL) {
+    GST_LIBDE265_MDEC_LOCK (mdec);
+  }
+  switch (prop_id) {
+    case PROP_PAD_PRIORITY:
+      stream->priority = g_value_get_uint (value);
+      GST_DEBUG_OBJECT (stream, "Priority set to %u", stream->priority);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  if (mdec != NULL) {
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+    gst_object_unref (mdec);
+  }
+}
+
+static void
+gst_libde265_mdec_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstLibde265MDecPad *stream = GST_LIBDE265_MDEC_PAD (object);
+  GstLibde265MDec *mdec = _gst_libde265_mdec_pad_get_decoder (stream);
+
+  if (mdec != NULL) {
+    GST_LIBDE265_MDEC_LOCK (mdec);
+  }
+  switch (prop_id) {
+    case PROP_PAD_PRIORITY:
+      g_value_set_uint (value, stream->priority);
+      break;
+    case PROP_PAD_STATS:
+      g_value_take_boxed (value, gst_structure_new ("libde265mdec-stats",
+              "frames-in", G_TYPE_UINT64, stream->frames_in,
+              "frames-out", G_TYPE_UINT64, stream->frames_out,
+              "decode-time", G_TYPE_UINT64,
+              stream->decode_time * GST_USECOND,
+              "max-wait-time", G_TYPE_UINT64,
+              stream->max_wait_time * GST_USECOND,
+              "queued", G_TYPE_UINT, stream->queued_buffers, NULL));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  if (mdec != NULL) {
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+    gst_object_unref (mdec);
+  }
+}
+
+/* element type */
+
+static void
+gst_libde265_mdec_class_init (GstLibde265MDecClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_libde265_mdec_finalize;
+  gobject_class->set_property = gst_libde265_mdec_set_property;
+  gobject_class->get_property = gst_libde265_mdec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MAX_THREADS,
+      g_param_spec_int ("max-threads", "Maximum decode threads",
+          "Number of worker threads shared by all streams. (0 = auto)",
+          0, G_MAXINT, DEFAULT_MAX_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_QUEUED,
+      g_param_spec_uint ("max-queued", "Maximum queued buffers",
+          "Number of input buffers to queue per stream before blocking",
+          1, G_MAXUINT, DEFAULT_MAX_QUEUED,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DITHER,
+      g_param_spec_enum ("dither", "Bit depth reduction",
+          "Conversion used if the stream has more bits per pixel than "
+          "the output format", GST_TYPE_LIBDE265_DEC_DITHER,
+          DEFAULT_DITHER, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_change_state);
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_release_pad);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_template));
+
+  gst_element_class_set_details_simple (gstelement_class,
+      "HEVC/H.265 multi-stream decoder",
+      "Codec/Decoder/Video",
+      "Decodes multiple HEVC/H.265 streams on a shared set of threads "
+      "using libde265", "struktur AG <opensource@struktur.de>");
+}
+
+static void
+gst_libde265_mdec_init (GstLibde265MDec * mdec)
+{
+  g_mutex_init (&mdec->lock);
+  g_cond_init (&mdec->work_cond);
+  g_cond_init (&mdec->space_cond);
+  mdec->max_threads = DEFAULT_MAX_THREADS;
+  mdec->max_queued = DEFAULT_MAX_QUEUED;
+  mdec->dither = DEFAULT_DITHER;
+}
+
+static void
+gst_libde265_mdec_finalize (GObject * object)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (object);
+
+  g_list_free (mdec->streams);
+  g_list_free (mdec->ready);
+  g_cond_clear (&mdec->space_cond);
+  g_cond_clear (&mdec->work_cond);
+  g_mutex_clear (&mdec->lock);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_libde265_mdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (object);
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  switch (prop_id) {
+    case PROP_MAX_THREADS:
+      mdec->max_threads = g_value_get_int (value);
+      if (mdec->max_threads) {
+        GST_DEBUG_OBJECT (mdec, "Max. threads set to %d", mdec->max_threads);
+      } else {
+        GST_DEBUG_OBJECT (mdec, "Max. threads set to auto");
+      }
+      break;
+    case PROP_MAX_QUEUED:{
+      GList *walk;
+
+      mdec->max_queued = g_value_get_uint (value);
+      // streams held back by their output queue may go on
+      for (walk = mdec->streams; walk != NULL; walk = walk->next) {
+        _gst_libde265_mdec_schedule (mdec, walk->data);
+      }
+      g_cond_broadcast (&mdec->space_cond);
+      break;
+    }
+    case PROP_DITHER:
+      mdec->dither = g_value_get_enum (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+}
+
+static void
+gst_libde265_mdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (object);
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  switch (prop_id) {
+    case PROP_MAX_THREADS:
+      g_value_set_int (value, mdec->max_threads);
+      break;
+    case PROP_MAX_QUEUED:
+      g_value_set_uint (value, mdec->max_queued);
+      break;
+    case PROP_DITHER:
+      g_value_set_enum (value, mdec->dither);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+}
+
+/* scheduler, must be called with the lock held */
+
+static void
+_gst_libde265_mdec_schedule (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream)
+{
+  if (stream->scheduled || stream->busy || stream->flushing
+      || stream->removed || g_queue_is_empty (&stream->queue)
+      || stream->out_buffers >= mdec->max_queued) {
+    return;
+  }
+
+  // streams that were idle don't get to catch up on decoder time
+  if (stream->vtime < mdec->vtime) {
+    stream->vtime = mdec->vtime;
+  }
+  stream->scheduled = TRUE;
+  mdec->ready = g_list_prepend (mdec->ready, stream);
+  g_cond_signal (&mdec->work_cond);
+}
+
+static void
+_gst_libde265_mdec_unschedule (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream)
+{
+  if (stream->scheduled) {
+    mdec->ready = g_list_remove (mdec->ready, stream);
+    stream->scheduled = FALSE;
+  }
+}
+
+static GstLibde265MDecPad *
+_gst_libde265_mdec_pick (GstLibde265MDec * mdec)
+{
+  GstLibde265MDecPad *result = NULL;
+  GList *walk;
+
+  for (walk = mdec->ready; walk != NULL; walk = walk->next) {
+    GstLibde265MDecPad *stream = walk->data;
+    if (result == NULL || stream->vtime < result->vtime) {
+      result = stream;
+    }
+  }
+  if (result != NULL) {
+    _gst_libde265_mdec_unschedule (mdec, result);
+    mdec->vtime = result->vtime;
+  }
+  return result;
+}
+
+static void
+_gst_libde265_mdec_enqueue (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream, GstMiniObject * object)
+{
+  GstLibde265MDecItem *item = g_slice_new (GstLibde265MDecItem);
+
+  item->object = object;
+  item->queued_at = g_get_monotonic_time ();
+  g_queue_push_tail (&stream->queue, item);
+  if (GST_IS_BUFFER (object)) {
+    stream->queued_buffers++;
+  }
+  _gst_libde265_mdec_schedule (mdec, stream);
+}
+
+/* decoding, called from the worker threads without the lock held */
+
+/* hands a picture or event to the task of the src pad, returns FALSE
+ * if the pad is flushing */
+static gboolean
+_gst_libde265_mdec_output (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream, GstMiniObject * object)
+{
+  gboolean res = TRUE;
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  if (stream->out_flushing) {
+    gst_mini_object_unref (object);
+    res = FALSE;
+  } else {
+    g_queue_push_tail (&stream->out_queue, object);
+    if (GST_IS_BUFFER (object)) {
+      stream->out_buffers++;
+    }
+    g_cond_signal (&stream->out_cond);
+  }
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+  return res;
+}
+
+static GstFlowReturn
+_gst_libde265_mdec_push_image (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream, const struct de265_image *img)
+{
+  GstVideoFrame vframe;
+  GstBuffer *buffer;
+  int i;
+
+  int bits_per_pixel = MAX (MAX (de265_get_bits_per_pixel (img, 0),
+          de265_get_bits_per_pixel (img, 1)), de265_get_bits_per_pixel (img,
+          2));
+  GstVideoFormat format =
+      gst_libde265_get_video_format (de265_get_chroma_format (img),
+      bits_per_pixel);
+  if (format == GST_VIDEO_FORMAT_UNKNOWN) {
+    GST_ELEMENT_ERROR (mdec, STREAM, DECODE,
+        ("Unsupported image format"), (NULL));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  int width = de265_get_image_width (img, 0);
+  int height = de265_get_image_height (img, 0);
+  if (G_UNLIKELY (format != stream->format
+          || width != GST_VIDEO_INFO_WIDTH (&stream->info)
+          || height != GST_VIDEO_INFO_HEIGHT (&stream->info))) {
+    gst_video_info_set_format (&stream->info, format, width, height);
+    if (stream->fps_n > 0) {
+      GST_VIDEO_INFO_FPS_N (&stream->info) = stream->fps_n;
+      GST_VIDEO_INFO_FPS_D (&stream->info) = stream->fps_d;
+    }
+
+    // refused caps show up as flow return of the next push
+    GstCaps *caps = gst_video_info_to_caps (&stream->info);
+    gboolean ok = _gst_libde265_mdec_output (mdec, stream,
+        GST_MINI_OBJECT_CAST (gst_event_new_caps (caps)));
+    gst_caps_unref (caps);
+    if (!ok) {
+      return GST_FLOW_FLUSHING;
+    }
+    GST_DEBUG_OBJECT (stream, "Frame dimensions are %d x %d", width, height);
+    stream->format = format;
+  }
+
+  if (stream->segment_event != NULL) {
+    // the segment was held back until the caps were known
+    _gst_libde265_mdec_output (mdec, stream,
+        GST_MINI_OBJECT_CAST (stream->segment_event));
+    stream->segment_event = NULL;
+  }
+
+  buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&stream->info),
+      NULL);
+  if (!gst_video_frame_map (&vframe, &stream->info, buffer, GST_MAP_WRITE)) {
+    GST_ERROR_OBJECT (stream, "Failed to map output buffer");
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+
+  uint8_t *planes[3] = { NULL, NULL, NULL };
+  int strides[3] = { 0, 0, 0 };
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (&vframe) && i < 3; i++) {
+    planes[i] = GST_VIDEO_FRAME_PLANE_DATA (&vframe, i);
+    strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE (&vframe, i);
+  }
+  gst_libde265_convert_image (img, planes, strides,
+      GST_VIDEO_FORMAT_INFO_BITS (vframe.info.finfo), mdec->dither);
+  gst_video_frame_unmap (&vframe);
+
+  GST_BUFFER_PTS (buffer) = (GstClockTime) de265_get_image_PTS (img);
+  if (stream->fps_n > 0) {
+    GST_BUFFER_DURATION (buffer) =
+        gst_util_uint64_scale (GST_SECOND, stream->fps_d, stream->fps_n);
+  }
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  stream->frames_out++;
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+
+  if (!_gst_libde265_mdec_output (mdec, stream,
+          GST_MINI_OBJECT_CAST (buffer))) {
+    return GST_FLOW_FLUSHING;
+  }
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+_gst_libde265_mdec_decode (GstLibde265MDec * mdec, GstLibde265MDecPad * stream)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  const struct de265_image *img;
+  de265_error err;
+  int more;
+
+  do {
+    int drained = 0;
+
+    more = 0;
+    err = de265_decode (stream->ctx, &more);
+    switch (err) {
+      case DE265_OK:
+        break;
+
+      case DE265_ERROR_WAITING_FOR_INPUT_DATA:
+        more = 0;
+        break;
+
+      case DE265_ERROR_IMAGE_BUFFER_FULL:
+        // output pictures get drained below, then decoding continues
+        more = 1;
+        break;
+
+      default:
+        GST_ELEMENT_ERROR (mdec, STREAM, DECODE,
+            ("Error while decoding: %s (code=%d)", de265_get_error_text (err),
+                err), (NULL));
+        return GST_FLOW_ERROR;
+    }
+
+    while ((err = de265_get_warning (stream->ctx)) != DE265_OK) {
+      GST_ELEMENT_WARNING (mdec, STREAM, DECODE,
+          ("%s (code=%d)", de265_get_error_text (err), err), (NULL));
+    }
+
+    while (ret == GST_FLOW_OK
+        && (img = de265_get_next_picture (stream->ctx)) != NULL) {
+      ret = _gst_libde265_mdec_push_image (mdec, stream, img);
+      drained++;
+    }
+
+    if (err == DE265_ERROR_IMAGE_BUFFER_FULL && !drained) {
+      break;
+    }
+  } while (more && ret == GST_FLOW_OK);
+
+  return ret;
+}
+
+static gboolean
+_gst_libde265_mdec_set_caps (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream, GstCaps * caps)
+{
+  GstStructure *str = gst_caps_get_structure (caps, 0);
+  const GValue *value;
+
+  if (!gst_structure_get_fraction (str, "framerate", &stream->fps_n,
+          &stream->fps_d) || stream->fps_d == 0) {
+    stream->fps_n = 0;
+    stream->fps_d = 1;
+  }
+
+  if ((value = gst_structure_get_value (str, "codec_data"))) {
+    GstBuffer *buf = gst_value_get_buffer (value);
+    GstMapInfo info;
+    gboolean ok;
+
+    if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
+      GST_ELEMENT_ERROR (mdec, STREAM, DECODE,
+          ("Failed to map codec data"), (NULL));
+      return FALSE;
+    }
+    ok = gst_libde265_dec_push_codec_data (GST_ELEMENT (mdec), stream->ctx,
+        info.data, info.size, &stream->mode, &stream->length_size);
+    gst_buffer_unmap (buf, &info);
+    if (!ok) {
+      return FALSE;
+    }
+    de265_push_end_of_NAL (stream->ctx);
+    return _gst_libde265_mdec_decode (mdec, stream) == GST_FLOW_OK;
+  } else if ((value = gst_structure_get_value (str, "stream-format"))) {
+    if (strcmp (g_value_get_string (value), "byte-stream") == 0) {
+      stream->mode = GST_TYPE_LIBDE265_DEC_RAW;
+      GST_DEBUG_OBJECT (stream, "Assuming raw byte-stream");
+    }
+  }
+  return TRUE;
+}
+
+static GstFlowReturn
+_gst_libde265_mdec_process_buffer (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream, GstBuffer * buffer)
+{
+  de265_PTS pts = (de265_PTS) GST_BUFFER_PTS (buffer);
+  GstMapInfo info;
+  de265_error err;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (stream, "Failed to map input buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  if (stream->mode == GST_TYPE_LIBDE265_DEC_PACKETIZED) {
+    if (!gst_libde265_dec_push_packetized (GST_ELEMENT (mdec), stream->ctx,
+            info.data, info.size, stream->length_size, pts)) {
+      gst_buffer_unmap (buffer, &info);
+      return GST_FLOW_ERROR;
+    }
+  } else {
+    err = de265_push_data (stream->ctx, info.data, info.size, pts, NULL);
+    if (err != DE265_OK) {
+      GST_ELEMENT_ERROR (mdec, STREAM, DECODE,
+          ("Error while pushing data: %s (code=%d)",
+              de265_get_error_text (err), err), (NULL));
+      gst_buffer_unmap (buffer, &info);
+      return GST_FLOW_ERROR;
+    }
+  }
+  gst_buffer_unmap (buffer, &info);
+
+  return _gst_libde265_mdec_decode (mdec, stream);
+}
+
+static GstFlowReturn
+_gst_libde265_mdec_process_event (GstLibde265MDec * mdec,
+    GstLibde265MDecPad * stream, GstEvent * event)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      if (!_gst_libde265_mdec_set_caps (mdec, stream, caps)) {
+        ret = GST_FLOW_NOT_NEGOTIATED;
+      }
+      // output caps are sent once the first image is decoded
+      gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+      if (stream->format == GST_VIDEO_FORMAT_UNKNOWN) {
+        gst_event_replace (&stream->segment_event, event);
+        gst_event_unref (event);
+      } else {
+        _gst_libde265_mdec_output (mdec, stream, GST_MINI_OBJECT_CAST (event));
+      }
+      break;
+    case GST_EVENT_EOS:
+      if (de265_flush_data (stream->ctx) == DE265_OK) {
+        ret = _gst_libde265_mdec_decode (mdec, stream);
+      }
+      _gst_libde265_mdec_output (mdec, stream, GST_MINI_OBJECT_CAST (event));
+      break;
+    default:
+      _gst_libde265_mdec_output (mdec, stream, GST_MINI_OBJECT_CAST (event));
+      break;
+  }
+  return ret;
+}
+
+static gpointer
+gst_libde265_mdec_worker (gpointer data)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (data);
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  while (mdec->running) {
+    GstLibde265MDecPad *stream = _gst_libde265_mdec_pick (mdec);
+    if (stream == NULL) {
+      g_cond_wait (&mdec->work_cond, &mdec->lock);
+      continue;
+    }
+
+    GstLibde265MDecItem *item = g_queue_pop_head (&stream->queue);
+    GstMiniObject *object = item->object;
+    gint64 start = g_get_monotonic_time ();
+    if (start - item->queued_at > stream->max_wait_time) {
+      stream->max_wait_time = start - item->queued_at;
+    }
+    g_slice_free (GstLibde265MDecItem, item);
+
+    GstFlowReturn ret = stream->last_flow;
+    stream->busy = TRUE;
+    if (GST_IS_BUFFER (object)) {
+      stream->queued_buffers--;
+      g_cond_broadcast (&mdec->space_cond);
+    }
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+
+    if (GST_IS_BUFFER (object)) {
+      if (ret == GST_FLOW_OK) {
+        ret = _gst_libde265_mdec_process_buffer (mdec, stream,
+            GST_BUFFER_CAST (object));
+      }
+      gst_buffer_unref (GST_BUFFER_CAST (object));
+    } else {
+      GstFlowReturn event_ret = _gst_libde265_mdec_process_event (mdec,
+          stream, GST_EVENT_CAST (object));
+      if (ret == GST_FLOW_OK) {
+        ret = event_ret;
+      }
+    }
+    gint64 elapsed = g_get_monotonic_time () - start;
+
+    GST_LIBDE265_MDEC_LOCK (mdec);
+    stream->busy = FALSE;
+    stream->decode_time += elapsed;
+    stream->vtime += elapsed * DEFAULT_PRIORITY / stream->priority;
+    // don't overwrite an error of the src pad task
+    if (!stream->flushing && ret != GST_FLOW_OK) {
+      stream->last_flow = ret;
+    }
+    _gst_libde265_mdec_schedule (mdec, stream);
+    // wake up chain functions and threads waiting for the stream to be idle
+    g_cond_broadcast (&mdec->space_cond);
+  }
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+  return NULL;
+}
+
+/* pushing, one task per src pad */
+
+static void
+gst_libde265_mdec_src_loop (GstPad * pad)
+{
+  GstLibde265MDecPad *stream = gst_pad_get_element_private (pad);
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (GST_OBJECT_PARENT (pad));
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstFlowReturn last_flow;
+  GstMiniObject *object;
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  while (g_queue_is_empty (&stream->out_queue) && !stream->out_flushing) {
+    g_cond_wait (&stream->out_cond, &mdec->lock);
+  }
+  if (stream->out_flushing) {
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+    GST_DEBUG_OBJECT (pad, "Flushing, pausing task");
+    gst_pad_pause_task (pad);
+    return;
+  }
+  object = g_queue_pop_head (&stream->out_queue);
+  if (GST_IS_BUFFER (object)) {
+    stream->out_buffers--;
+    // the stream may have been held back because of the full queue
+    _gst_libde265_mdec_schedule (mdec, stream);
+  }
+  last_flow = stream->last_flow;
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+
+  if (!GST_IS_BUFFER (object)) {
+    gst_pad_push_event (pad, GST_EVENT_CAST (object));
+  } else if (last_flow == GST_FLOW_OK) {
+    ret = gst_pad_push (pad, GST_BUFFER_CAST (object));
+  } else {
+    // upstream gets the error from the chain function
+    gst_buffer_unref (GST_BUFFER_CAST (object));
+  }
+
+  if (ret != GST_FLOW_OK) {
+    GST_LOG_OBJECT (pad, "Pushing buffer returned %s", gst_flow_get_name (ret));
+    GST_LIBDE265_MDEC_LOCK (mdec);
+    if (!stream->flushing && stream->last_flow == GST_FLOW_OK) {
+      stream->last_flow = ret;
+    }
+    g_cond_broadcast (&mdec->space_cond);
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+  }
+}
+
+static gboolean
+gst_libde265_mdec_src_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (parent);
+  GstLibde265MDecPad *stream = gst_pad_get_element_private (pad);
+
+  if (mode != GST_PAD_MODE_PUSH) {
+    return FALSE;
+  }
+
+  if (active) {
+    GST_LIBDE265_MDEC_LOCK (mdec);
+    stream->out_flushing = FALSE;
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+    return gst_pad_start_task (pad,
+        (GstTaskFunction) gst_libde265_mdec_src_loop, pad, NULL);
+  }
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  stream->out_flushing = TRUE;
+  _gst_libde265_mdec_clear_out_queue (stream);
+  g_cond_signal (&stream->out_cond);
+  _gst_libde265_mdec_schedule (mdec, stream);
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+  return gst_pad_stop_task (pad);
+}
+
+static void
+gst_libde265_mdec_start_workers (GstLibde265MDec * mdec)
+{
+  int i;
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  mdec->num_workers = mdec->max_threads;
+  if (mdec->num_workers == 0) {
+    mdec->num_workers = gst_libde265_get_cpu_count ();
+  }
+  mdec->workers = g_new0 (GThread *, mdec->num_workers);
+  mdec->running = TRUE;
+  for (i = 0; i < mdec->num_workers; i++) {
+    mdec->workers[i] =
+        g_thread_new ("libde265mdec", gst_libde265_mdec_worker, mdec);
+  }
+  GST_INFO_OBJECT (mdec, "Using libde265 %s with %d shared worker threads",
+      de265_get_version (), mdec->num_workers);
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+}
+
+static void
+gst_libde265_mdec_stop_workers (GstLibde265MDec * mdec)
+{
+  GList *walk;
+  int i;
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  mdec->running = FALSE;
+  g_cond_broadcast (&mdec->work_cond);
+  g_cond_broadcast (&mdec->space_cond);
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+
+  for (i = 0; i < mdec->num_workers; i++) {
+    g_thread_join (mdec->workers[i]);
+  }
+  g_free (mdec->workers);
+  mdec->workers = NULL;
+  mdec->num_workers = 0;
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  g_list_free (mdec->ready);
+  mdec->ready = NULL;
+  mdec->vtime = 0;
+  for (walk = mdec->streams; walk != NULL; walk = walk->next) {
+    GstLibde265MDecPad *stream = walk->data;
+    _gst_libde265_mdec_clear_queue (stream);
+    _gst_libde265_mdec_clear_out_queue (stream);
+    gst_event_replace (&stream->segment_event, NULL);
+    de265_reset (stream->ctx);
+    stream->scheduled = FALSE;
+    stream->vtime = 0;
+    stream->format = GST_VIDEO_FORMAT_UNKNOWN;
+    stream->last_flow = GST_FLOW_OK;
+  }
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+}
+
+static GstStateChangeReturn
+gst_libde265_mdec_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_libde265_mdec_start_workers (mdec);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      // unblock chain functions before the pads get deactivated
+      GST_LIBDE265_MDEC_LOCK (mdec);
+      mdec->running = FALSE;
+      g_cond_broadcast (&mdec->work_cond);
+      g_cond_broadcast (&mdec->space_cond);
+      GST_LIBDE265_MDEC_UNLOCK (mdec);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_libde265_mdec_stop_workers (mdec);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
+
+/* pads */
+
+static GstPad *
+gst_libde265_mdec_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (element);
+  GstLibde265MDecPad *stream;
+  guint id;
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  if (name != NULL && sscanf (name, "sink_%u", &id) == 1) {
+    if (id >= mdec->next_pad_id) {
+      mdec->next_pad_id = id + 1;
+    }
+  } else {
+    id = mdec->next_pad_id++;
+  }
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+
+  gchar *sink_name = g_strdup_printf ("sink_%u", id);
+  stream = g_object_new (GST_TYPE_LIBDE265_MDEC_PAD, "name", sink_name,
+      "direction", GST_PAD_SINK, "template", templ, NULL);
+  g_free (sink_name);
+
+  stream->ctx = de265_new_decoder ();
+  if (stream->ctx == NULL) {
+    gst_object_unref (stream);
+    return NULL;
+  }
+  // NOTE: we explicitly disable hash checks for now
+  de265_set_parameter_bool (stream->ctx,
+      DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH, 0);
+
+  gst_pad_set_chain_function (GST_PAD (stream),
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_chain));
+  gst_pad_set_event_function (GST_PAD (stream),
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_sink_event));
+  gst_pad_set_iterate_internal_links_function (GST_PAD (stream),
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_iterate_internal_links));
+
+  gchar *src_name = g_strdup_printf ("src_%u", id);
+  stream->srcpad = gst_pad_new_from_static_template (&src_template, src_name);
+  g_free (src_name);
+  gst_pad_set_element_private (stream->srcpad, stream);
+  gst_pad_set_iterate_internal_links_function (stream->srcpad,
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_iterate_internal_links));
+  gst_pad_set_activatemode_function (stream->srcpad,
+      GST_DEBUG_FUNCPTR (gst_libde265_mdec_src_activate_mode));
+  gst_pad_use_fixed_caps (stream->srcpad);
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  mdec->streams = g_list_append (mdec->streams, stream);
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+
+  gst_element_add_pad (element, stream->srcpad);
+  gst_element_add_pad (element, GST_PAD (stream));
+  return GST_PAD (stream);
+}
+
+static void
+gst_libde265_mdec_release_pad (GstElement * element, GstPad * pad)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (element);
+  GstLibde265MDecPad *stream = GST_LIBDE265_MDEC_PAD (pad);
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  stream->removed = TRUE;
+  stream->flushing = TRUE;
+  _gst_libde265_mdec_unschedule (mdec, stream);
+  while (stream->busy) {
+    g_cond_wait (&mdec->space_cond, &mdec->lock);
+  }
+  _gst_libde265_mdec_clear_queue (stream);
+  mdec->streams = g_list_remove (mdec->streams, stream);
+  g_cond_broadcast (&mdec->space_cond);
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+
+  // stops the task before the pad goes away
+  gst_pad_set_active (stream->srcpad, FALSE);
+  gst_element_remove_pad (element, stream->srcpad);
+  gst_element_remove_pad (element, pad);
+}
+
+static GstIterator *
+gst_libde265_mdec_iterate_internal_links (GstPad * pad, GstObject * parent)
+{
+  GValue value = G_VALUE_INIT;
+  GstIterator *it;
+  GstPad *other;
+
+  if (GST_PAD_IS_SINK (pad)) {
+    other = GST_LIBDE265_MDEC_PAD (pad)->srcpad;
+  } else {
+    other = GST_PAD (gst_pad_get_element_private (pad));
+  }
+
+  g_value_init (&value, GST_TYPE_PAD);
+  g_value_set_object (&value, other);
+  it = gst_iterator_new_single (GST_TYPE_PAD, &value);
+  g_value_unset (&value);
+  return it;
+}
+
+static GstFlowReturn
+gst_libde265_mdec_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (parent);
+  GstLibde265MDecPad *stream = GST_LIBDE265_MDEC_PAD (pad);
+  GstFlowReturn ret;
+
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  while (stream->queued_buffers >= mdec->max_queued && !stream->flushing
+      && mdec->running && stream->last_flow == GST_FLOW_OK) {
+    g_cond_wait (&mdec->space_cond, &mdec->lock);
+  }
+  if (stream->flushing || !mdec->running) {
+    ret = GST_FLOW_FLUSHING;
+  } else {
+    ret = stream->last_flow;
+  }
+  if (ret != GST_FLOW_OK) {
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
+  stream->frames_in++;
+  _gst_libde265_mdec_enqueue (mdec, stream, GST_MINI_OBJECT_CAST (buffer));
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_libde265_mdec_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstLibde265MDec *mdec = GST_LIBDE265_MDEC (parent);
+  GstLibde265MDecPad *stream = GST_LIBDE265_MDEC_PAD (pad);
+  gboolean res;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      GST_LIBDE265_MDEC_LOCK (mdec);
+      stream->flushing = TRUE;
+      stream->out_flushing = TRUE;
+      _gst_libde265_mdec_unschedule (mdec, stream);
+      _gst_libde265_mdec_clear_queue (stream);
+      _gst_libde265_mdec_clear_out_queue (stream);
+      g_cond_signal (&stream->out_cond);
+      g_cond_broadcast (&mdec->space_cond);
+      GST_LIBDE265_MDEC_UNLOCK (mdec);
+      res = gst_pad_push_event (stream->srcpad, event);
+      gst_pad_pause_task (stream->srcpad);
+      return res;
+
+    case GST_EVENT_FLUSH_STOP:
+      GST_LIBDE265_MDEC_LOCK (mdec);
+      while (stream->busy) {
+        g_cond_wait (&mdec->space_cond, &mdec->lock);
+      }
+      _gst_libde265_mdec_clear_queue (stream);
+      _gst_libde265_mdec_clear_out_queue (stream);
+      gst_event_replace (&stream->segment_event, NULL);
+      de265_reset (stream->ctx);
+      stream->last_flow = GST_FLOW_OK;
+      stream->flushing = FALSE;
+      GST_LIBDE265_MDEC_UNLOCK (mdec);
+      res = gst_pad_push_event (stream->srcpad, event);
+      if (GST_PAD_MODE (stream->srcpad) == GST_PAD_MODE_PUSH) {
+        GST_LIBDE265_MDEC_LOCK (mdec);
+        stream->out_flushing = FALSE;
+        GST_LIBDE265_MDEC_UNLOCK (mdec);
+        gst_pad_start_task (stream->srcpad,
+            (GstTaskFunction) gst_libde265_mdec_src_loop, stream->srcpad,
+            NULL);
+      }
+      return res;
+
+    default:
+      break;
+  }
+
+  if (!GST_EVENT_IS_SERIALIZED (event)) {
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  // keep serialized events in order with the buffers
+  GST_LIBDE265_MDEC_LOCK (mdec);
+  if (stream->flushing || !mdec->running) {
+    GST_LIBDE265_MDEC_UNLOCK (mdec);
+    gst_event_unref (event);
+    return FALSE;
+  }
+  _gst_libde265_mdec_enqueue (mdec, stream, GST_MINI_OBJECT_CAST (event));
+  GST_LIBDE265_MDEC_UNLOCK (mdec);
+  return TRUE;
+}
+
+gboolean
+gst_libde265_mdec_plugin_init (GstPlugin * plugin)
+{
+  if (!gst_element_register (plugin, "libde265mdec",
+          GST_RANK_NONE, GST_TYPE_LIBDE265_MDEC))
+    return FALSE;
+
+  return TRUE;
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * GStreamer HEVC/H.265 video codec.
+ *
+ * Copyright (c) 2014 struktur AG, Joachim Bauch <bauch@struktur.de>
+ *
+ * This file is part of gstreamer-libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GST_LIBDE265_MDEC_H__
+#define __GST_LIBDE265_MDEC_H__
+
+#include "libde265-dec.h"
+
+/*
+ * The multi-stream decoder needs GStreamer 1.0 for its
+ * request pad and video info handling.
+ */
+#if GST_CHECK_VERSION(1,0,0)
+
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_LIBDE265_MDEC \
+    (gst_libde265_mdec_get_type())
+#define GST_LIBDE265_MDEC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_LIBDE265_MDEC,GstLibde265MDec))
+#define GST_LIBDE265_MDEC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_LIBDE265_MDEC,GstLibde265MDecClass))
+
+#define GST_TYPE_LIBDE265_MDEC_PAD \
+    (gst_libde265_mdec_pad_get_type())
+#define GST_LIBDE265_MDEC_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_LIBDE265_MDEC_PAD,GstLibde265MDecPad))
+
+/*
+ * Each request sink pad carries the state of one decoded stream.
+ * All fields are protected by the scheduler lock of the element
+ * unless noted otherwise.
+ */
+typedef struct _GstLibde265MDecPad {
+    GstPad                  parent;
+
+    GstPad                  *srcpad;
+    /* only accessed by the worker that has the stream "busy" */
+    de265_decoder_context   *ctx;
+    GstLibde265DecMode      mode;
+    int                     length_size;
+    GstVideoInfo            info;
+    GstVideoFormat          format;
+    int                     fps_n;
+    int                     fps_d;
+    GstEvent                *segment_event;
+
+    /* queued buffers and serialized events */
+    GQueue                  queue;
+    guint                   queued_buffers;
+    gboolean                scheduled;
+    gboolean                busy;
+    gboolean                flushing;
+    gboolean                removed;
+    GstFlowReturn           last_flow;
+
+    /* decoded pictures and events waiting to be pushed by the task of
+     * the src pad, so the workers never block on downstream */
+    GQueue                  out_queue;
+    guint                   out_buffers;
+    gboolean                out_flushing;
+    GCond                   out_cond;
+
+    /* scheduling */
+    guint                   priority;
+    guint64                 vtime;
+
+    /* statistics */
+    guint64                 frames_in;
+    guint64                 frames_out;
+    guint64                 decode_time;
+    guint64                 max_wait_time;
+} GstLibde265MDecPad;
+
+typedef struct _GstLibde265MDecPadClass {
+    GstPadClass             parent;
+} GstLibde265MDecPadClass;
+
+typedef struct _GstLibde265MDec {
+    GstElement              parent;
+
+    /* protects the pads and the scheduler state */
+    GMutex                  lock;
+    /* signalled when streams have data to decode */
+    GCond                   work_cond;
+    /* signalled when queued data was consumed or a stream got idle */
+    GCond                   space_cond;
+    GList                   *streams;
+    GList                   *ready;
+    GThread                 **workers;
+    int                     num_workers;
+    gboolean                running;
+    guint64                 vtime;
+    guint                   next_pad_id;
+
+    /* properties */
+    int                     max_threads;
+    guint                   max_queued;
+    GstLibde265DecDither    dither;
+} GstLibde265MDec;
+
+typedef struct _GstLibde265MDecClass {
+    GstElementClass         parent;
+} GstLibde265MDecClass;
+
+GType gst_libde265_mdec_pad_get_type (void);
+GType gst_libde265_mdec_get_type (void);
+
+G_END_DECLS
+
+#endif
+
+gboolean gst_libde265_mdec_plugin_init (GstPlugin *plugin);
+
+#endif  // __GST_LIBDE265_MDEC_H__
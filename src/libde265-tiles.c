@@ -0,0 +1,614 @@
+/*
+ * GStreamer HEVC/H.265 video codec.
+ *
+ * Copyright (c) 2014 struktur AG, Joachim Bauch <bauch@struktur.de>
+ *
+ * This file is part of gstreamer-libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "libde265-tiles.h"
+
+#define MAX_SPS_COUNT       16
+#define MAX_PPS_COUNT       64
+// the spec allows at most 20 columns and 22 rows
+#define MAX_TILE_COLUMNS    32
+#define MAX_TILE_ROWS       32
+// the slice header fields we need are in the first few bytes
+#define MAX_SLICE_HEADER    64
+#define MAX_HEADER_SIZE     1024
+
+#define NAL_TYPE_BLA_W_LP   16
+#define NAL_TYPE_RSV_IRAP   23
+#define NAL_TYPE_SLICE_MAX  21
+#define NAL_TYPE_SPS        33
+#define NAL_TYPE_PPS        34
+
+typedef struct
+{
+  gboolean valid;
+  int width;
+  int height;
+  int log2_ctb_size;
+} GstLibde265TilesSps;
+
+typedef struct
+{
+  gboolean valid;
+  int sps_id;
+  gboolean dependent_slice_segments;
+  int num_extra_slice_header_bits;
+  int columns;
+  int rows;
+  gboolean uniform;
+  int column_width[MAX_TILE_COLUMNS];
+  int row_height[MAX_TILE_ROWS];
+} GstLibde265TilesPps;
+
+struct _GstLibde265Tiles
+{
+  GstLibde265TilesSps sps[MAX_SPS_COUNT];
+  GstLibde265TilesPps pps[MAX_PPS_COUNT];
+};
+
+/* tile boundaries of a picture in CTB units */
+typedef struct
+{
+  int width_ctbs;
+  int height_ctbs;
+  int log2_ctb_size;
+  int columns;
+  int rows;
+  int col_bd[MAX_TILE_COLUMNS + 1];
+  int row_bd[MAX_TILE_ROWS + 1];
+} GstLibde265TilesLayout;
+
+typedef struct
+{
+  guint nal;
+  int pps_id;
+  gboolean first_in_pic;
+  gboolean dependent;
+  int address;
+} GstLibde265TilesSlice;
+
+/* bit reader on the NAL payload with emulation prevention bytes removed */
+typedef struct
+{
+  uint8_t data[MAX_HEADER_SIZE];
+  int size;
+  int pos;
+} GstLibde265BitReader;
+
+static void
+_gst_libde265_bit_reader_init (GstLibde265BitReader * br, const uint8_t * src,
+    gsize size, int max_size)
+{
+  int zeros = 0;
+  gsize i;
+
+  br->size = 0;
+  br->pos = 0;
+  for (i = 0; i < size && br->size < max_size; i++) {
+    if (zeros >= 2 && src[i] == 3) {
+      zeros = 0;
+      continue;
+    }
+    zeros = src[i] == 0 ? zeros + 1 : 0;
+    br->data[br->size++] = src[i];
+  }
+}
+
+static inline guint
+_gst_libde265_bit_reader_bit (GstLibde265BitReader * br)
+{
+  guint result = 0;
+  if (br->pos < br->size * 8) {
+    result = (br->data[br->pos >> 3] >> (7 - (br->pos & 7))) & 1;
+  }
+  br->pos++;
+  return result;
+}
+
+static guint
+_gst_libde265_bit_reader_bits (GstLibde265BitReader * br, int count)
+{
+  guint result = 0;
+  while (count--) {
+    result = (result << 1) | _gst_libde265_bit_reader_bit (br);
+  }
+  return result;
+}
+
+static inline void
+_gst_libde265_bit_reader_skip (GstLibde265BitReader * br, int count)
+{
+  br->pos += count;
+}
+
+static guint
+_gst_libde265_bit_reader_ue (GstLibde265BitReader * br)
+{
+  int zeros = 0;
+  while (!_gst_libde265_bit_reader_bit (br)) {
+    if (++zeros > 31 || br->pos > br->size * 8) {
+      return 0;
+    }
+  }
+  return ((1u << zeros) - 1) + _gst_libde265_bit_reader_bits (br, zeros);
+}
+
+static inline gboolean
+_gst_libde265_bit_reader_overrun (GstLibde265BitReader * br)
+{
+  return br->pos > br->size * 8;
+}
+
+GstLibde265Tiles *
+gst_libde265_tiles_new (void)
+{
+  return g_new0 (GstLibde265Tiles, 1);
+}
+
+void
+gst_libde265_tiles_free (GstLibde265Tiles * tiles)
+{
+  g_free (tiles);
+}
+
+static void
+_gst_libde265_tiles_parse_sps (GstLibde265Tiles * tiles,
+    GstLibde265BitReader * br)
+{
+  gboolean sub_layer_profile[8];
+  gboolean sub_layer_level[8];
+  int i;
+
+  // sps_video_parameter_set_id
+  _gst_libde265_bit_reader_skip (br, 4);
+  int max_sub_layers_minus1 = _gst_libde265_bit_reader_bits (br, 3);
+  // sps_temporal_id_nesting_flag
+  _gst_libde265_bit_reader_skip (br, 1);
+
+  // profile_tier_level: general profile (88 bits) and level (8 bits)
+  _gst_libde265_bit_reader_skip (br, 88 + 8);
+  for (i = 0; i < max_sub_layers_minus1; i++) {
+    sub_layer_profile[i] = _gst_libde265_bit_reader_bit (br);
+    sub_layer_level[i] = _gst_libde265_bit_reader_bit (br);
+  }
+  if (max_sub_layers_minus1 > 0) {
+    _gst_libde265_bit_reader_skip (br, 2 * (8 - max_sub_layers_minus1));
+  }
+  for (i = 0; i < max_sub_layers_minus1; i++) {
+    if (sub_layer_profile[i]) {
+      _gst_libde265_bit_reader_skip (br, 88);
+    }
+    if (sub_layer_level[i]) {
+      _gst_libde265_bit_reader_skip (br, 8);
+    }
+  }
+
+  guint sps_id = _gst_libde265_bit_reader_ue (br);
+  if (sps_id >= MAX_SPS_COUNT) {
+    return;
+  }
+
+  guint chroma_format_idc = _gst_libde265_bit_reader_ue (br);
+  if (chroma_format_idc == 3) {
+    // separate_colour_plane_flag
+    _gst_libde265_bit_reader_skip (br, 1);
+  }
+  int width = _gst_libde265_bit_reader_ue (br);
+  int height = _gst_libde265_bit_reader_ue (br);
+  if (_gst_libde265_bit_reader_bit (br)) {
+    // conformance window offsets
+    for (i = 0; i < 4; i++) {
+      _gst_libde265_bit_reader_ue (br);
+    }
+  }
+  // bit_depth_luma_minus8, bit_depth_chroma_minus8,
+  // log2_max_pic_order_cnt_lsb_minus4
+  for (i = 0; i < 3; i++) {
+    _gst_libde265_bit_reader_ue (br);
+  }
+  gboolean ordering_info = _gst_libde265_bit_reader_bit (br);
+  for (i = ordering_info ? 0 : max_sub_layers_minus1;
+      i <= max_sub_layers_minus1; i++) {
+    _gst_libde265_bit_reader_ue (br);
+    _gst_libde265_bit_reader_ue (br);
+    _gst_libde265_bit_reader_ue (br);
+  }
+  int log2_min_cb_size = _gst_libde265_bit_reader_ue (br) + 3;
+  int log2_diff_max_min_cb_size = _gst_libde265_bit_reader_ue (br);
+  int log2_ctb_size = log2_min_cb_size + log2_diff_max_min_cb_size;
+  if (_gst_libde265_bit_reader_overrun (br) || width <= 0 || height <= 0
+      || log2_ctb_size < 4 || log2_ctb_size > 6) {
+    return;
+  }
+
+  GstLibde265TilesSps *sps = &tiles->sps[sps_id];
+  sps->valid = TRUE;
+  sps->width = width;
+  sps->height = height;
+  sps->log2_ctb_size = log2_ctb_size;
+}
+
+static void
+_gst_libde265_tiles_parse_pps (GstLibde265Tiles * tiles,
+    GstLibde265BitReader * br)
+{
+  GstLibde265TilesPps pps;
+  int i;
+
+  memset (&pps, 0, sizeof (pps));
+  guint pps_id = _gst_libde265_bit_reader_ue (br);
+  guint sps_id = _gst_libde265_bit_reader_ue (br);
+  if (pps_id >= MAX_PPS_COUNT || sps_id >= MAX_SPS_COUNT) {
+    return;
+  }
+  pps.sps_id = sps_id;
+
+  pps.dependent_slice_segments = _gst_libde265_bit_reader_bit (br);
+  // output_flag_present_flag
+  _gst_libde265_bit_reader_skip (br, 1);
+  pps.num_extra_slice_header_bits = _gst_libde265_bit_reader_bits (br, 3);
+  // sign_data_hiding_enabled_flag, cabac_init_present_flag
+  _gst_libde265_bit_reader_skip (br, 2);
+  // num_ref_idx_l0/l1_default_active_minus1, init_qp_minus26
+  for (i = 0; i < 3; i++) {
+    _gst_libde265_bit_reader_ue (br);
+  }
+  // constrained_intra_pred_flag, transform_skip_enabled_flag
+  _gst_libde265_bit_reader_skip (br, 2);
+  if (_gst_libde265_bit_reader_bit (br)) {
+    // diff_cu_qp_delta_depth
+    _gst_libde265_bit_reader_ue (br);
+  }
+  // pps_cb_qp_offset, pps_cr_qp_offset
+  _gst_libde265_bit_reader_ue (br);
+  _gst_libde265_bit_reader_ue (br);
+  // pps_slice_chroma_qp_offsets_present_flag, weighted_pred_flag,
+  // weighted_bipred_flag, transquant_bypass_enabled_flag
+  _gst_libde265_bit_reader_skip (br, 4);
+  gboolean tiles_enabled = _gst_libde265_bit_reader_bit (br);
+  // entropy_coding_sync_enabled_flag
+  _gst_libde265_bit_reader_skip (br, 1);
+
+  pps.columns = 1;
+  pps.rows = 1;
+  pps.uniform = TRUE;
+  if (tiles_enabled) {
+    pps.columns = _gst_libde265_bit_reader_ue (br) + 1;
+    pps.rows = _gst_libde265_bit_reader_ue (br) + 1;
+    if (pps.columns > MAX_TILE_COLUMNS || pps.rows > MAX_TILE_ROWS) {
+      return;
+    }
+    pps.uniform = _gst_libde265_bit_reader_bit (br);
+    if (!pps.uniform) {
+      for (i = 0; i < pps.columns - 1; i++) {
+        pps.column_width[i] = _gst_libde265_bit_reader_ue (br) + 1;
+      }
+      for (i = 0; i < pps.rows - 1; i++) {
+        pps.row_height[i] = _gst_libde265_bit_reader_ue (br) + 1;
+      }
+    }
+  }
+  if (_gst_libde265_bit_reader_overrun (br)) {
+    return;
+  }
+
+  pps.valid = TRUE;
+  tiles->pps[pps_id] = pps;
+}
+
+void
+gst_libde265_tiles_parse_nal (GstLibde265Tiles * tiles, const uint8_t * data,
+    gsize size)
+{
+  GstLibde265BitReader br;
+
+  if (size < 3) {
+    return;
+  }
+
+  switch ((data[0] >> 1) & 0x3f) {
+    case NAL_TYPE_SPS:
+      _gst_libde265_bit_reader_init (&br, data + 2, size - 2,
+          MAX_HEADER_SIZE);
+      _gst_libde265_tiles_parse_sps (tiles, &br);
+      break;
+    case NAL_TYPE_PPS:
+      _gst_libde265_bit_reader_init (&br, data + 2, size - 2,
+          MAX_HEADER_SIZE);
+      _gst_libde265_tiles_parse_pps (tiles, &br);
+      break;
+    default:
+      break;
+  }
+}
+
+void
+gst_libde265_tiles_parse_codec_data (GstLibde265Tiles * tiles,
+    const uint8_t * data, gsize size)
+{
+  gsize pos = 23;
+  int i;
+  int j;
+
+  if (size <= 22 || !(data[0] || data[1] || data[2] > 1)) {
+    // not in "hvcC" format
+    return;
+  }
+
+  int num_param_sets = data[22];
+  for (i = 0; i < num_param_sets && pos + 3 <= size; i++) {
+    int nal_count = data[pos + 1] << 8 | data[pos + 2];
+    pos += 3;
+    for (j = 0; j < nal_count && pos + 2 <= size; j++) {
+      gsize nal_size = data[pos] << 8 | data[pos + 1];
+      if (pos + 2 + nal_size > size) {
+        return;
+      }
+      gst_libde265_tiles_parse_nal (tiles, data + pos + 2, nal_size);
+      pos += 2 + nal_size;
+    }
+  }
+}
+
+static gboolean
+_gst_libde265_tiles_get_layout (GstLibde265Tiles * tiles, int pps_id,
+    GstLibde265TilesLayout * layout)
+{
+  GstLibde265TilesPps *pps = &tiles->pps[pps_id];
+  GstLibde265TilesSps *sps;
+  int i;
+
+  if (!pps->valid || !tiles->sps[pps->sps_id].valid) {
+    return FALSE;
+  }
+
+  sps = &tiles->sps[pps->sps_id];
+  int ctb_size = 1 << sps->log2_ctb_size;
+  layout->log2_ctb_size = sps->log2_ctb_size;
+  layout->width_ctbs = (sps->width + ctb_size - 1) >> sps->log2_ctb_size;
+  layout->height_ctbs = (sps->height + ctb_size - 1) >> sps->log2_ctb_size;
+  layout->columns = pps->columns;
+  layout->rows = pps->rows;
+
+  layout->col_bd[0] = 0;
+  for (i = 0; i < pps->columns; i++) {
+    if (pps->uniform) {
+      layout->col_bd[i + 1] = ((i + 1) * layout->width_ctbs) / pps->columns;
+    } else if (i < pps->columns - 1) {
+      layout->col_bd[i + 1] = layout->col_bd[i] + pps->column_width[i];
+    } else {
+      layout->col_bd[i + 1] = layout->width_ctbs;
+    }
+  }
+  layout->row_bd[0] = 0;
+  for (i = 0; i < pps->rows; i++) {
+    if (pps->uniform) {
+      layout->row_bd[i + 1] = ((i + 1) * layout->height_ctbs) / pps->rows;
+    } else if (i < pps->rows - 1) {
+      layout->row_bd[i + 1] = layout->row_bd[i] + pps->row_height[i];
+    } else {
+      layout->row_bd[i + 1] = layout->height_ctbs;
+    }
+  }
+  return layout->col_bd[pps->columns] == layout->width_ctbs
+      && layout->row_bd[pps->rows] == layout->height_ctbs;
+}
+
+/* converts a CTB address from raster scan to tile scan */
+static int
+_gst_libde265_tiles_rs_to_ts (const GstLibde265TilesLayout * layout, int rs)
+{
+  int cx = rs % layout->width_ctbs;
+  int cy = rs / layout->width_ctbs;
+  int tx = 0;
+  int ty = 0;
+
+  while (tx < layout->columns - 1 && cx >= layout->col_bd[tx + 1]) {
+    tx++;
+  }
+  while (ty < layout->rows - 1 && cy >= layout->row_bd[ty + 1]) {
+    ty++;
+  }
+
+  int tile_width = layout->col_bd[tx + 1] - layout->col_bd[tx];
+  int tile_height = layout->row_bd[ty + 1] - layout->row_bd[ty];
+  return layout->row_bd[ty] * layout->width_ctbs
+      + layout->col_bd[tx] * tile_height
+      + (cy - layout->row_bd[ty]) * tile_width + (cx - layout->col_bd[tx]);
+}
+
+/*
+ * Checks if any CTB in the tile scan range [start, end) lies inside
+ * the rectangle (in CTB units, inclusive).
+ */
+static gboolean
+_gst_libde265_tiles_range_intersects (const GstLibde265TilesLayout * layout,
+    int start, int end, int x0, int y0, int x1, int y1)
+{
+  int tile_start = 0;
+  int ty;
+  int tx;
+
+  for (ty = 0; ty < layout->rows; ty++) {
+    int tile_height = layout->row_bd[ty + 1] - layout->row_bd[ty];
+    for (tx = 0; tx < layout->columns; tx++) {
+      int tile_width = layout->col_bd[tx + 1] - layout->col_bd[tx];
+      int tile_end = tile_start + tile_width * tile_height;
+      if (tile_end > start && tile_start < end) {
+        // covered part of this tile, in tile local raster order
+        int a = MAX (start, tile_start) - tile_start;
+        int b = MIN (end, tile_end) - tile_start - 1;
+        int first_row = layout->row_bd[ty] + a / tile_width;
+        int last_row = layout->row_bd[ty] + b / tile_width;
+        int first_col = layout->col_bd[tx];
+        int last_col = layout->col_bd[tx + 1] - 1;
+        if (first_row == last_row) {
+          first_col += a % tile_width;
+          last_col = layout->col_bd[tx] + b % tile_width;
+        }
+        if (first_col <= x1 && last_col >= x0 && first_row <= y1
+            && last_row >= y0) {
+          return TRUE;
+        }
+      }
+      tile_start = tile_end;
+    }
+  }
+  return FALSE;
+}
+
+static gboolean
+_gst_libde265_tiles_parse_slice (GstLibde265Tiles * tiles,
+    const uint8_t * data, gsize size, GstLibde265TilesSlice * slice)
+{
+  GstLibde265BitReader br;
+  int nal_type = (data[0] >> 1) & 0x3f;
+  GstLibde265TilesLayout layout;
+
+  _gst_libde265_bit_reader_init (&br, data + 2, size - 2, MAX_SLICE_HEADER);
+  slice->first_in_pic = _gst_libde265_bit_reader_bit (&br);
+  if (nal_type >= NAL_TYPE_BLA_W_LP && nal_type <= NAL_TYPE_RSV_IRAP) {
+    // no_output_of_prior_pics_flag
+    _gst_libde265_bit_reader_skip (&br, 1);
+  }
+  slice->pps_id = _gst_libde265_bit_reader_ue (&br);
+  slice->dependent = FALSE;
+  slice->address = 0;
+  if (slice->pps_id >= MAX_PPS_COUNT
+      || !_gst_libde265_tiles_get_layout (tiles, slice->pps_id, &layout)) {
+    return FALSE;
+  }
+
+  if (!slice->first_in_pic) {
+    int pic_size = layout.width_ctbs * layout.height_ctbs;
+    int bits = 0;
+    while ((1 << bits) < pic_size) {
+      bits++;
+    }
+    if (tiles->pps[slice->pps_id].dependent_slice_segments) {
+      slice->dependent = _gst_libde265_bit_reader_bit (&br);
+    }
+    slice->address = _gst_libde265_bit_reader_bits (&br, bits);
+    if (slice->address >= pic_size) {
+      return FALSE;
+    }
+  }
+  return !_gst_libde265_bit_reader_overrun (&br);
+}
+
+gboolean
+gst_libde265_tiles_filter (GstLibde265Tiles * tiles, const uint8_t * data,
+    gsize size, int length_size, int x, int y, int width, int height,
+    GArray * nals)
+{
+  const uint8_t *pos = data;
+  const uint8_t *end = data + size;
+  guint first = nals->len;
+  GArray *slices;
+  gboolean ok = TRUE;
+  guint i;
+
+  while (pos + length_size <= end) {
+    GstLibde265TilesNal nal;
+    int nal_size = 0;
+    int j;
+    for (j = 0; j < length_size; j++) {
+      nal_size = (nal_size << 8) | pos[j];
+    }
+    if (pos + length_size + nal_size > end) {
+      return FALSE;
+    }
+    nal.offset = pos + length_size - data;
+    nal.size = nal_size;
+    nal.keep = TRUE;
+    g_array_append_val (nals, nal);
+    pos += length_size + nal_size;
+  }
+
+  slices = g_array_new (FALSE, FALSE, sizeof (GstLibde265TilesSlice));
+  for (i = first; i < nals->len && ok; i++) {
+    GstLibde265TilesNal *nal = &g_array_index (nals, GstLibde265TilesNal, i);
+    const uint8_t *nal_data = data + nal->offset;
+    if (nal->size < 3) {
+      continue;
+    }
+
+    int nal_type = (nal_data[0] >> 1) & 0x3f;
+    if (nal_type <= NAL_TYPE_SLICE_MAX) {
+      GstLibde265TilesSlice slice;
+      slice.nal = i;
+      ok = _gst_libde265_tiles_parse_slice (tiles, nal_data, nal->size,
+          &slice);
+      g_array_append_val (slices, slice);
+    } else {
+      // parameter sets can be sent inband before the slices using them
+      gst_libde265_tiles_parse_nal (tiles, nal_data, nal->size);
+    }
+  }
+
+  // decide per slice (independent segment and its dependent segments)
+  for (i = 0; i < slices->len && ok; i++) {
+    GstLibde265TilesSlice *slice =
+        &g_array_index (slices, GstLibde265TilesSlice, i);
+    GstLibde265TilesLayout layout;
+    guint next;
+
+    if (slice->first_in_pic || slice->dependent) {
+      continue;
+    }
+
+    _gst_libde265_tiles_get_layout (tiles, slice->pps_id, &layout);
+    int start = _gst_libde265_tiles_rs_to_ts (&layout, slice->address);
+    int stop = layout.width_ctbs * layout.height_ctbs;
+    for (next = i + 1; next < slices->len; next++) {
+      GstLibde265TilesSlice *other =
+          &g_array_index (slices, GstLibde265TilesSlice, next);
+      if (other->first_in_pic) {
+        break;
+      } else if (!other->dependent) {
+        stop = _gst_libde265_tiles_rs_to_ts (&layout, other->address);
+        break;
+      }
+    }
+
+    int ctb_shift = layout.log2_ctb_size;
+    if (!_gst_libde265_tiles_range_intersects (&layout, start, stop,
+            x >> ctb_shift, y >> ctb_shift, (x + width - 1) >> ctb_shift,
+            (y + height - 1) >> ctb_shift)) {
+      guint j;
+      for (j = i; j < next; j++) {
+        GstLibde265TilesSlice *drop =
+            &g_array_index (slices, GstLibde265TilesSlice, j);
+        g_array_index (nals, GstLibde265TilesNal, drop->nal).keep = FALSE;
+      }
+    }
+  }
+
+  if (!ok) {
+    // unknown parameter sets or broken headers, decode everything
+    for (i = first; i < nals->len; i++) {
+      g_array_index (nals, GstLibde265TilesNal, i).keep = TRUE;
+    }
+  }
+  g_array_free (slices, TRUE);
+  return TRUE;
+}
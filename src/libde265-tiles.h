@@ -0,0 +1,71 @@
+/*
+ * GStreamer HEVC/H.265 video codec.
+ *
+ * Copyright (c) 2014 struktur AG, Joachim Bauch <bauch@struktur.de>
+ *
+ * This file is part of gstreamer-libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GST_LIBDE265_TILES_H__
+#define __GST_LIBDE265_TILES_H__
+
+#include <stdint.h>
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Minimal parser for the parts of the SPS, PPS and slice segment headers
+ * that describe the picture size, the tile layout and where each slice
+ * starts. Used to find the slices that don't cover a region of interest.
+ */
+typedef struct _GstLibde265Tiles GstLibde265Tiles;
+
+typedef struct _GstLibde265TilesNal {
+    gsize                   offset;
+    gsize                   size;
+    gboolean                keep;
+} GstLibde265TilesNal;
+
+GstLibde265Tiles *gst_libde265_tiles_new (void);
+void gst_libde265_tiles_free (GstLibde265Tiles * tiles);
+
+/*
+ * Update the known parameter sets if the NAL unit is a SPS or PPS.
+ */
+void gst_libde265_tiles_parse_nal (GstLibde265Tiles * tiles,
+    const uint8_t * data, gsize size);
+
+/*
+ * Update the known parameter sets from "hvcC" codec data.
+ */
+void gst_libde265_tiles_parse_codec_data (GstLibde265Tiles * tiles,
+    const uint8_t * data, gsize size);
+
+/*
+ * Split a packetized access unit into its NAL units (appended to "nals")
+ * and mark slices that don't intersect the given rectangle (in luma pixels)
+ * as not to be kept. The first slice of a picture and all non-VCL NAL
+ * units are always kept. Returns FALSE if the length fields are invalid.
+ */
+gboolean gst_libde265_tiles_filter (GstLibde265Tiles * tiles,
+    const uint8_t * data, gsize size, int length_size, int x, int y,
+    int width, int height, GArray * nals);
+
+G_END_DECLS
+
+#endif  // __GST_LIBDE265_TILES_H__
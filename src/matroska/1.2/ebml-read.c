@@ -55,10 +55,10 @@ GstFlowReturn
 gst_ebml_peek_id_length (guint32 * _id, guint64 * _length, guint * _needed,
     GstPeekData peek, gpointer * ctx, GstElement * el, guint64 offset)
 {
-  guint needed;
+  guint needed, peeked;
   const guint8 *buf;
-  gint len_mask = 0x80, read = 1, n = 1, num_ffs = 0;
-  guint64 total;
+  guint id_len, len_len, i;
+  guint32 id;
   guint8 b;
   GstFlowReturn ret;
 
@@ -71,64 +71,41 @@ gst_ebml_peek_id_length (guint32 * _id, guint64 * _length, guint * _needed,
   *_length = GST_EBML_SIZE_UNKNOWN;
 
   /* read element id */
-  needed = 2;
+  needed = peeked = 2;
   ret = peek (ctx, needed, &buf);
   if (ret != GST_FLOW_OK)
     goto peek_error;
   b = GST_READ_UINT8 (buf);
-  total = (guint64) b;
-  while (read <= 4 && !(total & len_mask)) {
-    read++;
-    len_mask >>= 1;
-  }
-  if (G_UNLIKELY (read > 4))
+  id_len = gst_ebml_vint_length (b);
+  if (G_UNLIKELY (id_len == 0 || id_len > 4))
     goto invalid_id;
 
   /* need id and at least something for subsequent length */
-  needed = read + 1;
-  ret = peek (ctx, needed, &buf);
-  if (ret != GST_FLOW_OK)
-    goto peek_error;
-  while (n < read) {
-    b = GST_READ_UINT8 (buf + n);
-    total = (total << 8) | b;
-    ++n;
+  needed = id_len + 1;
+  if (needed > peeked) {
+    ret = peek (ctx, needed, &buf);
+    if (ret != GST_FLOW_OK)
+      goto peek_error;
+    peeked = needed;
   }
-  *_id = (guint32) total;
+  id = b;
+  for (i = 1; i < id_len; i++)
+    id = (id << 8) | GST_READ_UINT8 (buf + i);
+  *_id = id;
 
   /* read element length */
-  b = GST_READ_UINT8 (buf + n);
-  total = (guint64) b;
-  len_mask = 0x80;
-  read = 1;
-  while (read <= 8 && !(total & len_mask)) {
-    read++;
-    len_mask >>= 1;
-  }
-  if (G_UNLIKELY (read > 8))
+  b = GST_READ_UINT8 (buf + id_len);
+  len_len = gst_ebml_vint_length (b);
+  if (G_UNLIKELY (len_len == 0))
     goto invalid_length;
-  if ((total &= (len_mask - 1)) == len_mask - 1)
-    num_ffs++;
 
-  needed += read - 1;
-  ret = peek (ctx, needed, &buf);
-  if (ret != GST_FLOW_OK)
-    goto peek_error;
-  buf += (needed - read);
-  n = 1;
-  while (n < read) {
-    guint8 b = GST_READ_UINT8 (buf + n);
-
-    if (G_UNLIKELY (b == 0xff))
-      num_ffs++;
-    total = (total << 8) | b;
-    ++n;
+  needed = id_len + len_len;
+  if (needed > peeked) {
+    ret = peek (ctx, needed, &buf);
+    if (ret != GST_FLOW_OK)
+      goto peek_error;
   }
-
-  if (G_UNLIKELY (read == num_ffs))
-    *_length = G_MAXUINT64;
-  else
-    *_length = total;
+  gst_ebml_read_vint (buf + id_len, len_len, _length);
 
   *_needed = needed;
 
@@ -166,6 +166,77 @@ gst_ebml_read_has_remaining (GstEbmlRead * ebml, guint64 bytes_needed,
   return G_LIKELY (res);
 }
 
+/* Returns the number of bytes of the EBML variable size integer (or id)
+ * starting with @first, or 0 if @first can't start one */
+static inline guint
+gst_ebml_vint_length (guint8 first)
+{
+#ifdef __GNUC__
+  return first ? __builtin_clz ((guint) first) - (sizeof (guint) * 8 - 8) + 1
+      : 0;
+#else
+  guint len = 1;
+
+  if (!first)
+    return 0;
+  while (!(first & 0x80)) {
+    first <<= 1;
+    len++;
+  }
+  return len;
+#endif
+}
+
+/* Reads the EBML variable size integer at @data, of which @size bytes are
+ * available, into @num. The reserved all ones value (unknown size) is
+ * returned as G_MAXUINT64.
+ * Returns the number of bytes used, or -1 if invalid or incomplete. */
+static inline gint
+gst_ebml_read_vint (const guint8 * data, guint size, guint64 * num)
+{
+  guint len, i;
+  guint64 value, max;
+
+  if (G_UNLIKELY (size == 0))
+    return -1;
+  len = gst_ebml_vint_length (data[0]);
+  if (G_UNLIKELY (len == 0 || len > size))
+    return -1;
+
+  if (size >= 8) {
+    value = GST_READ_UINT64_BE (data) >> (64 - 8 * len);
+  } else {
+    value = data[0];
+    for (i = 1; i < len; i++)
+      value = (value << 8) | data[i];
+  }
+
+  max = (G_GUINT64_CONSTANT (1) << (7 * len)) - 1;
+  value &= max;
+  *num = G_UNLIKELY (value == max) ? G_MAXUINT64 : value;
+
+  return len;
+}
+
+/* Signed version of gst_ebml_read_vint(), as used for lace sizes; the
+ * reserved value is returned as G_MAXINT64 */
+static inline gint
+gst_ebml_read_svint (const guint8 * data, guint size, gint64 * num)
+{
+  guint64 unum;
+  gint len;
+
+  if ((len = gst_ebml_read_vint (data, size, &unum)) < 0)
+    return -1;
+
+  if (unum == G_MAXUINT64)
+    *num = G_MAXINT64;
+  else
+    *num = unum - ((G_GUINT64_CONSTANT (1) << (7 * len - 1)) - 1);
+
+  return len;
+}
+
 G_END_DECLS
 
 #endif /* __GST_EBML_READ_H__ */
@@ -33,19 +33,55 @@
 GST_DEBUG_CATEGORY_STATIC (gst_ebml_write_debug);
 #define GST_CAT_DEFAULT gst_ebml_write_debug
 
-#define _do_init \
-      GST_DEBUG_CATEGORY_INIT (gst_ebml_write_debug, "ebmlwrite", 0, "Write EBML structured data")
-#define parent_class gst_ebml_write_parent_class
-G_DEFINE_TYPE_WITH_CODE (GstEbmlWrite, gst_ebml_write, GST_TYPE_OBJECT,
-    _do_init);
+/* largest element that is written through the scratch buffer */
+#define GST_EBML_WRITE_SCRATCH_SIZE 256
 
+/* part of the collected output, either a buffer or a range of the arena */
+typedef struct
+{
+  GstBuffer *buffer;
+  gsize arena_offset;
+  gsize arena_size;
+  guint64 offset;
+  GstClockTime timestamp;
+  gboolean is_keyframe;
+} GstEbmlWriteChunk;
+
+static gpointer parent_class;   /* NULL */
+
+static void gst_ebml_write_class_init (GstEbmlWriteClass * klass);
+static void gst_ebml_write_init (GstEbmlWrite * ebml);
 static void gst_ebml_write_finalize (GObject * object);
 
+/* Not using the boilerplate macros, the type needs a name that doesn't
+ * clash with the ebml writer of the system matroska plugin */
+GType
+gst_ebml_write_get_type (void)
+{
+  static volatile gsize type = 0;
+
+  if (g_once_init_enter (&type)) {
+    GType _type;
+
+    _type = g_type_register_static_simple (GST_TYPE_OBJECT,
+        g_intern_static_string ("GstEbmlWriteH265"),
+        sizeof (GstEbmlWriteClass),
+        (GClassInitFunc) gst_ebml_write_class_init, sizeof (GstEbmlWrite),
+        (GInstanceInitFunc) gst_ebml_write_init, 0);
+    GST_DEBUG_CATEGORY_INIT (gst_ebml_write_debug, "ebmlwrite", 0,
+        "Write EBML structured data");
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
 static void
 gst_ebml_write_class_init (GstEbmlWriteClass * klass)
 {
   GObjectClass *object = G_OBJECT_CLASS (klass);
 
+  parent_class = g_type_class_peek_parent (klass);
+
   object->finalize = gst_ebml_write_finalize;
 }
 
@@ -57,12 +93,61 @@ gst_ebml_write_init (GstEbmlWrite * ebml)
   ebml->last_pos = G_MAXUINT64; /* force segment event */
 
   ebml->cache = NULL;
+  ebml->cache_offset = 0;
+  ebml->chunks = NULL;
+  ebml->arena = gst_byte_writer_new ();
+  ebml->patch_chunk = -1;
+  ebml->scratch = gst_buffer_new_allocate (NULL, GST_EBML_WRITE_SCRATCH_SIZE,
+      NULL);
   ebml->streamheader = NULL;
   ebml->streamheader_pos = 0;
   ebml->writing_streamheader = FALSE;
   ebml->caps = NULL;
 }
 
+static void
+gst_ebml_write_free_chunks (GstEbmlWrite * ebml)
+{
+  guint i;
+
+  if (!ebml->chunks)
+    return;
+
+  for (i = 0; i < ebml->chunks->len; i++) {
+    GstEbmlWriteChunk *chunk =
+        &g_array_index (ebml->chunks, GstEbmlWriteChunk, i);
+
+    if (chunk->buffer)
+      gst_buffer_unref (chunk->buffer);
+  }
+  g_array_free (ebml->chunks, TRUE);
+  ebml->chunks = NULL;
+  ebml->patch_chunk = -1;
+  gst_byte_writer_reset (ebml->arena);
+}
+
+/* find the collected header bytes that contain the given range */
+static gint
+gst_ebml_write_find_chunk (GstEbmlWrite * ebml, guint64 pos, guint64 size)
+{
+  guint i;
+
+  if (!ebml->chunks)
+    return -1;
+
+  /* usually one of the last ones */
+  for (i = ebml->chunks->len; i > 0; i--) {
+    GstEbmlWriteChunk *chunk =
+        &g_array_index (ebml->chunks, GstEbmlWriteChunk, i - 1);
+
+    if (chunk->buffer == NULL && pos >= chunk->offset &&
+        pos + size <= chunk->offset + chunk->arena_size)
+      return i - 1;
+  }
+
+  return -1;
+}
+
 static void
 gst_ebml_write_finalize (GObject * object)
 {
@@ -71,10 +156,15 @@ gst_ebml_write_finalize (GObject * object)
   gst_object_unref (ebml->srcpad);
 
   if (ebml->cache) {
-    gst_byte_writer_free (ebml->cache);
+    if (ebml->cache != ebml->arena)
+      gst_byte_writer_free (ebml->cache);
     ebml->cache = NULL;
   }
 
+  gst_ebml_write_free_chunks (ebml);
+  gst_byte_writer_free (ebml->arena);
+  gst_buffer_unref (ebml->scratch);
+
   if (ebml->streamheader) {
     gst_byte_writer_free (ebml->streamheader);
     ebml->streamheader = NULL;
@@ -125,10 +215,13 @@ gst_ebml_write_reset (GstEbmlWrite * ebml)
   ebml->last_pos = G_MAXUINT64; /* force segment event */
 
   if (ebml->cache) {
-    gst_byte_writer_free (ebml->cache);
+    if (ebml->cache != ebml->arena)
+      gst_byte_writer_free (ebml->cache);
     ebml->cache = NULL;
   }
 
+  gst_ebml_write_free_chunks (ebml);
+
   if (ebml->caps) {
     gst_caps_unref (ebml->caps);
     ebml->caps = NULL;
@@ -203,10 +296,32 @@ gst_ebml_write_set_cache (GstEbmlWrite * ebml, guint size)
   g_return_if_fail (ebml->cache == NULL);
 
   GST_DEBUG ("Starting cache at %" G_GUINT64_FORMAT, ebml->pos);
-  ebml->cache = gst_byte_writer_new_with_size (size, FALSE);
+  if (ebml->chunks) {
+    /* append to the arena, it is split up when the list is pushed */
+    ebml->cache = ebml->arena;
+    ebml->cache_offset = gst_byte_writer_get_size (ebml->arena);
+    gst_byte_writer_set_pos (ebml->arena, ebml->cache_offset);
+  } else {
+    ebml->cache = gst_byte_writer_new_with_size (size, FALSE);
+    ebml->cache_offset = 0;
+  }
   ebml->cache_pos = ebml->pos;
 }
 
+static void
+gst_ebml_write_push_buffer_list (GstEbmlWrite * ebml, GstBufferList * list)
+{
+  if (gst_buffer_list_length (list) == 0) {
+    gst_buffer_list_unref (list);
+    return;
+  }
+
+  if (ebml->last_write_result == GST_FLOW_OK)
+    ebml->last_write_result = gst_pad_push_list (ebml->srcpad, list);
+  else
+    gst_buffer_list_unref (list);
+}
+
 static gboolean
 gst_ebml_writer_send_segment_event (GstEbmlWrite * ebml, guint64 new_pos)
 {
@@ -244,6 +359,21 @@ gst_ebml_write_flush_cache (GstEbmlWrite * ebml, gboolean is_keyframe,
   if (!ebml->cache)
     return;
 
+  if (ebml->cache == ebml->arena) {
+    GstEbmlWriteChunk chunk = { NULL, };
+
+    chunk.arena_offset = ebml->cache_offset;
+    chunk.arena_size = gst_byte_writer_get_size (ebml->arena) -
+        ebml->cache_offset;
+    chunk.offset = ebml->cache_pos;
+    chunk.timestamp = timestamp;
+    chunk.is_keyframe = is_keyframe;
+    ebml->cache = NULL;
+    if (chunk.arena_size > 0)
+      g_array_append_val (ebml->chunks, chunk);
+    return;
+  }
+
   buffer = gst_byte_writer_free_and_get_buffer (ebml->cache);
   ebml->cache = NULL;
   GST_DEBUG ("Flushing cache of size %" G_GSIZE_FORMAT,
@@ -270,6 +400,115 @@ gst_ebml_write_flush_cache (GstEbmlWrite * ebml, gboolean is_keyframe,
 }
 
 
+/**
+ * gst_ebml_write_start_list:
+ * @ebml: a #GstEbmlWrite.
+ *
+ * Collect all following output instead of pushing it, until
+ * gst_ebml_write_push_list is called.
+ */
+void
+gst_ebml_write_start_list (GstEbmlWrite * ebml)
+{
+  g_return_if_fail (ebml->cache == NULL);
+
+  if (ebml->chunks)
+    return;
+
+  ebml->chunks = g_array_sized_new (FALSE, FALSE, sizeof (GstEbmlWriteChunk),
+      64);
+}
+
+/**
+ * gst_ebml_write_push_list:
+ * @ebml: a #GstEbmlWrite.
+ *
+ * Push the output collected since gst_ebml_write_start_list as one buffer
+ * list, or several if it was not written in one go, and stop collecting.
+ * The cached parts share the memory of the arena, other buffers are
+ * pushed as they were written.
+ */
+void
+gst_ebml_write_push_list (GstEbmlWrite * ebml)
+{
+  GstBufferList *list;
+  GstMemory *arena = NULL;
+  gsize arena_size;
+  guint i;
+
+  if (!ebml->chunks)
+    return;
+
+  gst_ebml_write_flush_cache (ebml, FALSE, GST_CLOCK_TIME_NONE);
+
+  arena_size = gst_byte_writer_get_size (ebml->arena);
+  if (arena_size > 0) {
+    guint8 *data = gst_byte_writer_reset_and_get_data (ebml->arena);
+
+    arena = gst_memory_new_wrapped (0, data, arena_size, 0, arena_size, data,
+        g_free);
+    /* the next cluster will likely need about the same */
+    gst_byte_writer_init_with_size (ebml->arena, arena_size, FALSE);
+  }
+
+  GST_DEBUG ("pushing %u buffers with %" G_GSIZE_FORMAT " bytes of headers",
+      ebml->chunks->len, arena_size);
+
+  list = gst_buffer_list_new_sized (ebml->chunks->len);
+  for (i = 0; i < ebml->chunks->len; i++) {
+    GstEbmlWriteChunk *chunk =
+        &g_array_index (ebml->chunks, GstEbmlWriteChunk, i);
+    GstBuffer *buf = chunk->buffer;
+
+    chunk->buffer = NULL;
+    if (buf == NULL) {
+      buf = gst_buffer_new ();
+      gst_buffer_append_memory (buf, gst_memory_share (arena,
+              chunk->arena_offset, chunk->arena_size));
+      GST_BUFFER_TIMESTAMP (buf) = chunk->timestamp;
+      GST_BUFFER_OFFSET (buf) = chunk->offset;
+      GST_BUFFER_OFFSET_END (buf) = chunk->offset + chunk->arena_size;
+      if (!chunk->is_keyframe)
+        GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+
+    /* written out of order, the seek needs to happen in between */
+    if (GST_BUFFER_OFFSET (buf) != ebml->last_pos) {
+      gst_ebml_write_push_buffer_list (ebml, list);
+      list = gst_buffer_list_new ();
+      if (ebml->last_write_result == GST_FLOW_OK)
+        gst_ebml_writer_send_segment_event (ebml, GST_BUFFER_OFFSET (buf));
+      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+    }
+    ebml->last_pos = GST_BUFFER_OFFSET_END (buf);
+    gst_buffer_list_add (list, buf);
+  }
+  gst_ebml_write_push_buffer_list (ebml, list);
+
+  if (arena)
+    gst_memory_unref (arena);
+  gst_ebml_write_free_chunks (ebml);
+}
+
+
+/**
+ * gst_ebml_write_is_pending:
+ * @ebml: a #GstEbmlWrite.
+ * @pos: position of the data.
+ * @size: size of the data.
+ *
+ * Check if the given range was written to a cache and is still collected,
+ * rewriting it after a seek then doesn't need a seek downstream.
+ *
+ * Returns: TRUE if the range can be rewritten in place.
+ */
+gboolean
+gst_ebml_write_is_pending (GstEbmlWrite * ebml, guint64 pos, guint64 size)
+{
+  return gst_ebml_write_find_chunk (ebml, pos, size) >= 0;
+}
+
+
 /**
  * gst_ebml_write_element_new:
  * @ebml: a #GstEbmlWrite.
@@ -289,6 +528,13 @@ gst_ebml_write_element_new (GstEbmlWrite * ebml, GstMapInfo * map, guint size)
   /* length, ID */
   size += 12;
 
+  /* the data is copied to the cache right away */
+  if (ebml->cache && size <= GST_EBML_WRITE_SCRATCH_SIZE) {
+    gst_buffer_set_size (ebml->scratch, size);
+    gst_buffer_map (ebml->scratch, map, GST_MAP_WRITE);
+    return ebml->scratch;
+  }
+
   buf = gst_buffer_new_and_alloc (size);
   GST_BUFFER_TIMESTAMP (buf) = ebml->timestamp;
 
@@ -439,14 +685,48 @@ gst_ebml_write_element_push (GstEbmlWrite * ebml, GstBuffer * buf,
       GST_WARNING ("Error writing data to cache");
     if (map.data)
       gst_buffer_unmap (buf, &map);
-    gst_buffer_unref (buf);
+    if (buf != ebml->scratch)
+      gst_buffer_unref (buf);
     return;
   }
 
+  /* rewriting collected bytes, e.g. the size of a master element */
+  if (ebml->patch_chunk >= 0) {
+    GstEbmlWriteChunk *chunk =
+        &g_array_index (ebml->chunks, GstEbmlWriteChunk, ebml->patch_chunk);
+    guint64 start = ebml->pos - data_size;
+
+    if (start + data_size <= chunk->offset + chunk->arena_size) {
+      if (!buf_data) {
+        gst_buffer_map (buf, &map, GST_MAP_READ);
+        buf_data = map.data;
+      }
+      gst_byte_writer_set_pos (ebml->arena,
+          chunk->arena_offset + start - chunk->offset);
+      if (!gst_byte_writer_put_data (ebml->arena, buf_data, data_size))
+        GST_WARNING ("Error rewriting collected data");
+      gst_byte_writer_set_pos (ebml->arena,
+          gst_byte_writer_get_size (ebml->arena));
+      if (map.data)
+        gst_buffer_unmap (buf, &map);
+      gst_buffer_unref (buf);
+      return;
+    }
+    ebml->patch_chunk = -1;
+  }
+
   if (buf_data && map.data)
     gst_buffer_unmap (buf, &map);
 
-  if (ebml->last_write_result == GST_FLOW_OK) {
+  if (ebml->chunks && ebml->last_write_result == GST_FLOW_OK) {
+    GstEbmlWriteChunk chunk = { NULL, };
+
+    chunk.buffer = gst_buffer_make_writable (buf);
+    GST_BUFFER_OFFSET (chunk.buffer) = ebml->pos - data_size;
+    GST_BUFFER_OFFSET_END (chunk.buffer) = ebml->pos;
+    GST_BUFFER_FLAG_SET (chunk.buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    g_array_append_val (ebml->chunks, chunk);
+  } else if (ebml->last_write_result == GST_FLOW_OK) {
     buf = gst_buffer_make_writable (buf);
     GST_BUFFER_OFFSET (buf) = ebml->pos - data_size;
     GST_BUFFER_OFFSET_END (buf) = ebml->pos;
@@ -477,6 +757,8 @@ gst_ebml_write_element_push (GstEbmlWrite * ebml, GstBuffer * buf,
 void
 gst_ebml_write_seek (GstEbmlWrite * ebml, guint64 pos)
 {
+  ebml->patch_chunk = -1;
+
   if (ebml->writing_streamheader) {
     GST_DEBUG ("wanting to seek to pos %" G_GUINT64_FORMAT, pos);
     if (pos >= ebml->streamheader_pos &&
@@ -495,10 +777,12 @@ gst_ebml_write_seek (GstEbmlWrite * ebml, guint64 pos)
   if (ebml->cache) {
     /* within bounds? */
     if (pos >= ebml->cache_pos &&
-        pos <= ebml->cache_pos + ebml->cache->parent.size) {
+        pos <= ebml->cache_pos + gst_byte_writer_get_size (ebml->cache) -
+        ebml->cache_offset) {
       GST_DEBUG ("seeking in cache to %" G_GUINT64_FORMAT, pos);
       ebml->pos = pos;
-      gst_byte_writer_set_pos (ebml->cache, ebml->pos - ebml->cache_pos);
+      gst_byte_writer_set_pos (ebml->cache,
+          ebml->cache_offset + ebml->pos - ebml->cache_pos);
       return;
     } else {
       GST_LOG ("Seek outside cache range. Clearing...");
@@ -506,6 +790,14 @@ gst_ebml_write_seek (GstEbmlWrite * ebml, guint64 pos)
     }
   }
 
+  /* no need to seek downstream if the data wasn't pushed yet */
+  ebml->patch_chunk = gst_ebml_write_find_chunk (ebml, pos, 1);
+  if (ebml->patch_chunk >= 0) {
+    GST_DEBUG ("seeking in collected data to %" G_GUINT64_FORMAT, pos);
+    ebml->pos = pos;
+    return;
+  }
+
   GST_INFO ("scheduling seek to %" G_GUINT64_FORMAT, pos);
   ebml->pos = pos;
 }
@@ -52,6 +52,17 @@ typedef struct _GstEbmlWrite {
 
   GstByteWriter *cache;
   guint64 cache_pos;
+  gsize cache_offset;
+
+  /* output collected by gst_ebml_write_start_list, the cached bytes of
+   * all elements go to the arena and are only split into buffers when
+   * the list is pushed */
+  GArray *chunks;
+  GstByteWriter *arena;
+  /* chunk that is being rewritten after seeking back into it, or -1 */
+  gint patch_chunk;
+  /* reused for elements that are written to the cache */
+  GstBuffer *scratch;
 
   GstFlowReturn last_write_result;
 
@@ -87,6 +98,16 @@ void    gst_ebml_write_flush_cache   (GstEbmlWrite *ebml,
                                       gboolean is_keyframe,
                                       GstClockTime timestamp);
 
+/*
+ * Collect the output until gst_ebml_write_push_list and
+ * push it as one buffer list then.
+ */
+void    gst_ebml_write_start_list    (GstEbmlWrite *ebml);
+void    gst_ebml_write_push_list     (GstEbmlWrite *ebml);
+gboolean gst_ebml_write_is_pending   (GstEbmlWrite *ebml,
+                                      guint64       pos,
+                                      guint64       size);
+
 /*
  * Seeking.
  */
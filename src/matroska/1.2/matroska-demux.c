@@ -51,6 +51,9 @@
 
 #include <math.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <glib/gprintf.h>
 
 /* For AVI compatibility mode
@@ -67,6 +70,7 @@
 #include "matroska-demux.h"
 #include "matroska-ids.h"
 #include "../../common/codec-utils.h"
+#include "../../common/file-map.h"
 
 GST_DEBUG_CATEGORY_STATIC (matroskademux_debug);
 #define GST_CAT_DEFAULT matroskademux_debug
@@ -84,10 +88,31 @@ enum
   ARG_0,
   ARG_METADATA,
   ARG_STREAMINFO,
-  ARG_MAX_GAP_TIME
+  ARG_MAX_GAP_TIME,
+  ARG_BUILD_INDEX,
+  ARG_READ_AHEAD,
+  ARG_USE_MMAP,
+  ARG_MAX_QUEUE_TIME,
+  ARG_INDEX_CACHE_DIR,
+  ARG_LAZY_INDEX
 };
 
 #define  DEFAULT_MAX_GAP_TIME      (2 * GST_SECOND)
+#define  DEFAULT_BUILD_INDEX       FALSE
+#define  DEFAULT_READ_AHEAD        (4 * 1024 * 1024)
+#define  DEFAULT_USE_MMAP          FALSE
+#define  DEFAULT_MAX_QUEUE_TIME    0
+#define  DEFAULT_INDEX_CACHE_DIR   NULL
+#define  DEFAULT_LAZY_INDEX        FALSE
+
+/* sidecar table of the known clusters, GstSeekIndexEntry with track 0 */
+#define SIDECAR_CLUSTERS GST_MAKE_FOURCC ('c','l','s','t')
+
+/* bounds the output queues of streams without timestamps */
+#define GST_MATROSKA_DEMUX_MAX_QUEUE_ITEMS 1000
+
+/* delay before retrying reads while upstream is flushing */
+#define  INDEX_BUILDER_RETRY_DELAY (10 * G_USEC_PER_SEC / 1000)
 
 static GstStaticPadTemplate sink_templ = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -172,6 +197,8 @@ static GstCaps
 
 /* stream methods */
 static void gst_matroska_demux_reset (GstElement * element);
+static void gst_matroska_demux_stop_index_builder (GstMatroskaDemuxH265 *
+    demux);
 static gboolean perform_seek_to_offset (GstMatroskaDemuxH265 * demux,
     gdouble rate, guint64 offset, guint32 seqnum);
 
@@ -201,6 +228,7 @@ gst_matroska_demux_finalize (GObject * object)
   }
 
   g_object_unref (demux->common.adapter);
+  g_free (demux->index_cache_dir);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -225,6 +253,48 @@ gst_matroska_demux_class_init (GstMatroskaDemuxH265Class * klass)
           "gaps longer than this (0 = disabled).", 0, G_MAXUINT64,
           DEFAULT_MAX_GAP_TIME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, ARG_BUILD_INDEX,
+      g_param_spec_boolean ("build-index", "Build index",
+          "Build a seek index in a background thread for files without "
+          "Cues (pull mode only).", DEFAULT_BUILD_INDEX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_READ_AHEAD,
+      g_param_spec_uint ("read-ahead", "Read ahead",
+          "Maximum number of bytes to read at once up to the end of the "
+          "current Cluster, the following bytes are prefetched in the "
+          "background (pull mode only, 0 = disabled).", 0, G_MAXINT,
+          DEFAULT_READ_AHEAD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_USE_MMAP,
+      g_param_spec_boolean ("use-mmap", "Use mmap",
+          "Map the file when reading from a local file in pull mode and "
+          "output buffers sharing the mapping. The file must not be "
+          "truncated while it is being played.", DEFAULT_USE_MMAP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_MAX_QUEUE_TIME,
+      g_param_spec_uint64 ("max-queue-time", "Maximum queue time",
+          "Queue up to this much data (in ns) for each source pad and push "
+          "it from a separate thread per pad, so one slow consumer does not "
+          "stall the others; applies to pads created afterwards "
+          "(0 = push all pads from the streaming thread).", 0, G_MAXUINT64,
+          DEFAULT_MAX_QUEUE_TIME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_INDEX_CACHE_DIR,
+      g_param_spec_string ("index-cache-dir", "Index cache directory",
+          "Directory for sidecar seek index files of local files read in "
+          "pull mode. A file's index and cluster positions are loaded from "
+          "there if the file has not changed, and saved there when it is "
+          "closed (NULL = disabled).", DEFAULT_INDEX_CACHE_DIR,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_LAZY_INDEX,
+      g_param_spec_boolean ("lazy-index", "Lazy index",
+          "Don't parse the Cues when opening the file, but only the parts "
+          "of them each seek needs (pull mode only).", DEFAULT_LAZY_INDEX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_matroska_demux_change_state);
   gstelement_class->send_event =
@@ -280,6 +350,15 @@ gst_matroska_demux_init (GstMatroskaDemuxH265 * demux)
 
   /* property defaults */
   demux->max_gap_time = DEFAULT_MAX_GAP_TIME;
+  demux->build_index = DEFAULT_BUILD_INDEX;
+  demux->index_builder = NULL;
+  demux->common.read_ahead = DEFAULT_READ_AHEAD;
+  demux->use_mmap = DEFAULT_USE_MMAP;
+  demux->max_queue_time = DEFAULT_MAX_QUEUE_TIME;
+  demux->index_cache_dir = g_strdup (DEFAULT_INDEX_CACHE_DIR);
+  demux->sidecar = NULL;
+  demux->lazy_index = DEFAULT_LAZY_INDEX;
+  demux->built_index = NULL;
 
   GST_OBJECT_FLAG_SET (demux, GST_ELEMENT_FLAG_INDEXABLE);
 
@@ -305,7 +384,7 @@ gst_matroska_track_free (GstMatroskaTrackContext * track)
           GstMatroskaTrackEncoding,
           i);
 
-      g_free (enc->comp_settings);
+      gst_matroska_track_encoding_clear (enc);
     }
     g_array_free (track->encodings, TRUE);
   }
@@ -314,11 +393,14 @@ gst_matroska_track_free (GstMatroskaTrackContext * track)
     gst_tag_list_unref (track->pending_tags);
 
   if (track->index_table)
-    g_array_free (track->index_table, TRUE);
+    gst_matroska_index_table_free (track->index_table);
 
   if (track->stream_headers)
     gst_buffer_list_unref (track->stream_headers);
 
+  if (track->queue)
+    g_object_unref (track->queue);
+
   g_free (track);
 }
 
@@ -374,12 +456,25 @@ gst_matroska_demux_reset (GstElement * element)
 
   GST_DEBUG_OBJECT (demux, "Resetting state");
 
+  /* the index builder uses the tracks and the index */
+  gst_matroska_demux_stop_index_builder (demux);
+
   /* reset input */
   demux->common.state = GST_MATROSKA_READ_STATE_START;
 
   /* clean up existing streams */
   if (demux->common.src) {
     g_assert (demux->common.src->len == demux->common.num_streams);
+    /* output tasks look at all streams */
+    for (i = 0; i < demux->common.src->len; i++) {
+      GstMatroskaTrackContext *context = g_ptr_array_index (demux->common.src,
+          i);
+
+      if (context->pad != NULL && context->queue != NULL) {
+        gst_data_queue_set_flushing (context->queue, TRUE);
+        gst_pad_stop_task (context->pad);
+      }
+    }
     for (i = 0; i < demux->common.src->len; i++) {
       GstMatroskaTrackContext *context = g_ptr_array_index (demux->common.src,
           i);
@@ -410,9 +505,10 @@ gst_matroska_demux_reset (GstElement * element)
 
   /* reset indexes */
   if (demux->common.index) {
-    g_array_free (demux->common.index, TRUE);
+    gst_matroska_index_table_free (demux->common.index);
     demux->common.index = NULL;
   }
+  gst_matroska_read_common_clear_deferred_index (&demux->common);
 
   if (demux->clusters) {
     g_array_free (demux->clusters, TRUE);
@@ -455,6 +551,7 @@ gst_matroska_demux_reset (GstElement * element)
   demux->need_segment = FALSE;
   demux->segment_seqnum = 0;
   demux->requested_seek_time = GST_CLOCK_TIME_NONE;
+  demux->block_latency = 0;
   demux->seek_offset = -1;
   demux->building_index = FALSE;
   if (demux->seek_event) {
@@ -464,6 +561,7 @@ gst_matroska_demux_reset (GstElement * element)
 
   demux->seek_index = NULL;
   demux->seek_entry = 0;
+  demux->trick_jump = FALSE;
 
   if (demux->new_segment) {
     gst_event_unref (demux->new_segment);
@@ -483,14 +581,8 @@ gst_matroska_demux_reset (GstElement * element)
   demux->common.global_tags = gst_tag_list_new_empty ();
   gst_tag_list_set_scope (demux->common.global_tags, GST_TAG_SCOPE_GLOBAL);
 
-  if (demux->common.cached_buffer) {
-    if (demux->common.cached_data) {
-      gst_buffer_unmap (demux->common.cached_buffer, &demux->common.cached_map);
-      demux->common.cached_data = NULL;
-    }
-    gst_buffer_unref (demux->common.cached_buffer);
-    demux->common.cached_buffer = NULL;
-  }
+  gst_matroska_read_common_free_cache (&demux->common);
+  demux->common.read_ahead_end = 0;
 
   /* free chapters TOC if any */
   if (demux->common.toc) {
@@ -505,6 +597,7 @@ static GstBuffer *
 gst_matroska_decode_buffer (GstMatroskaTrackContext * context, GstBuffer * buf)
 {
   GstMapInfo map;
+  GstBuffer *stripped;
   gpointer data;
   gsize size;
 
@@ -512,6 +605,11 @@ gst_matroska_decode_buffer (GstMatroskaTrackContext * context, GstBuffer * buf)
 
   GST_DEBUG ("decoding buffer %p", buf);
 
+  /* restoring stripped headers doesn't need a copy of the frame */
+  stripped = gst_matroska_decode_stripped_buffer (context->encodings, buf);
+  if (stripped != NULL)
+    return stripped;
+
   gst_buffer_map (buf, &map, GST_MAP_READ);
   data = map.data;
   size = map.size;
@@ -556,6 +654,234 @@ gst_matroska_demux_add_stream_headers_to_caps (GstMatroskaDemuxH265 * demux,
   g_value_unset (&buf_val);
 }
 
+/* output queues:
+ * with "max-queue-time" set, every source pad gets a queue that is filled
+ * by the streaming thread and emptied by a task of the pad */
+
+static void
+gst_matroska_demux_queue_item_free (GstDataQueueItem * item)
+{
+  if (item->object)
+    gst_mini_object_unref (item->object);
+  g_slice_free (GstDataQueueItem, item);
+}
+
+/* only called from the streaming thread, which is the only one filling
+ * the queues */
+static gboolean
+gst_matroska_demux_queue_full (GstDataQueue * queue, guint visible,
+    guint bytes, guint64 time, gpointer checkdata)
+{
+  GstMatroskaDemuxH265 *demux = GST_MATROSKA_DEMUX (checkdata);
+  guint i;
+
+  if (time < demux->max_queue_time
+      && visible < GST_MATROSKA_DEMUX_MAX_QUEUE_ITEMS)
+    return FALSE;
+
+  /* don't wait for this queue to drain while another (non-sparse) one
+   * ran dry, its consumer may be waiting for data before it continues,
+   * e.g. to preroll; this happens with badly interleaved files */
+  for (i = 0; i < demux->common.src->len; i++) {
+    GstMatroskaTrackContext *stream = g_ptr_array_index (demux->common.src,
+        i);
+
+    if (stream->queue == NULL || stream->queue == queue || stream->eos ||
+        stream->type == GST_MATROSKA_TRACK_TYPE_SUBTITLE)
+      continue;
+    if (gst_data_queue_is_empty (stream->queue)) {
+      GST_LOG_OBJECT (demux, "stream %d is empty, growing queue",
+          stream->index);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* called by the streaming thread without the queue lock before it waits
+ * for room in @queue */
+static void
+gst_matroska_demux_queue_filled (GstDataQueue * queue, gpointer checkdata)
+{
+  GstMatroskaDemuxH265 *demux = GST_MATROSKA_DEMUX (checkdata);
+
+  GST_OBJECT_LOCK (demux);
+  demux->blocked_queue = queue;
+  GST_OBJECT_UNLOCK (demux);
+}
+
+/* called from the task of a pad without the queue lock */
+static void
+gst_matroska_demux_queue_empty (GstDataQueue * queue, gpointer checkdata)
+{
+  GstMatroskaDemuxH265 *demux = GST_MATROSKA_DEMUX (checkdata);
+  GstDataQueue *blocked;
+
+  /* wake up the streaming thread if it waits for room in another queue,
+   * the queues are only freed after all tasks stopped */
+  GST_OBJECT_LOCK (demux);
+  blocked = demux->blocked_queue;
+  GST_OBJECT_UNLOCK (demux);
+
+  if (blocked != NULL && blocked != queue)
+    gst_data_queue_limits_changed (blocked);
+}
+
+static void
+gst_matroska_demux_output_loop (GstPad * pad)
+{
+  GstMatroskaTrackContext *stream = gst_pad_get_element_private (pad);
+  GstDataQueueItem *item;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (!gst_data_queue_pop (stream->queue, &item)) {
+    GST_DEBUG_OBJECT (pad, "flushing, pausing task");
+    gst_pad_pause_task (pad);
+    return;
+  }
+
+  /* keep going whatever the outcome, the streaming thread combines the
+   * flow returns and stops if needed */
+  if (GST_IS_BUFFER (item->object))
+    ret = gst_pad_push (pad, GST_BUFFER_CAST (item->object));
+  else
+    gst_pad_push_event (pad, GST_EVENT_CAST (item->object));
+  item->object = NULL;
+  item->destroy (item);
+
+  if (ret != GST_FLOW_OK)
+    GST_LOG_OBJECT (pad, "pushing buffer returned %s",
+        gst_flow_get_name (ret));
+
+  GST_OBJECT_LOCK (pad);
+  stream->queue_flow = ret;
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static gboolean
+gst_matroska_demux_src_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstMatroskaTrackContext *stream = gst_pad_get_element_private (pad);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+
+  if (active) {
+    stream->queue_last_ts = GST_CLOCK_TIME_NONE;
+    stream->queue_flow = GST_FLOW_OK;
+    gst_data_queue_set_flushing (stream->queue, FALSE);
+    return gst_pad_start_task (pad,
+        (GstTaskFunction) gst_matroska_demux_output_loop, pad, NULL);
+  } else {
+    /* unblocks both the streaming thread and the task */
+    gst_data_queue_set_flushing (stream->queue, TRUE);
+    return gst_pad_stop_task (pad);
+  }
+}
+
+/* returns FALSE if the queue is flushing, takes ownership of @object */
+static gboolean
+gst_matroska_demux_queue_object (GstMatroskaDemuxH265 * demux,
+    GstMatroskaTrackContext * stream, GstMiniObject * object)
+{
+  GstDataQueueItem *item;
+  gboolean res;
+
+  item = g_slice_new0 (GstDataQueueItem);
+  item->object = object;
+  item->destroy = (GDestroyNotify) gst_matroska_demux_queue_item_free;
+
+  if (GST_IS_BUFFER (object)) {
+    GstClockTime ts = GST_BUFFER_TIMESTAMP (object);
+
+    item->visible = TRUE;
+    item->size = gst_buffer_get_size (GST_BUFFER_CAST (object));
+    /* the queue level is the time span it covers */
+    if (GST_CLOCK_TIME_IS_VALID (ts)) {
+      if (!GST_CLOCK_TIME_IS_VALID (stream->queue_last_ts)) {
+        stream->queue_last_ts = ts;
+      } else if (ts > stream->queue_last_ts) {
+        item->duration = ts - stream->queue_last_ts;
+        stream->queue_last_ts = ts;
+      }
+    }
+  }
+
+  res = gst_data_queue_push (stream->queue, item);
+  if (!res)
+    item->destroy (item);
+
+  GST_OBJECT_LOCK (demux);
+  demux->blocked_queue = NULL;
+  GST_OBJECT_UNLOCK (demux);
+
+  return res;
+}
+
+static GstFlowReturn
+gst_matroska_demux_push_buffer (GstMatroskaDemuxH265 * demux,
+    GstMatroskaTrackContext * stream, GstBuffer * buf)
+{
+  GstFlowReturn ret;
+
+  if (stream->queue == NULL)
+    return gst_pad_push (stream->pad, buf);
+
+  if (!gst_matroska_demux_queue_object (demux, stream,
+          GST_MINI_OBJECT_CAST (buf)))
+    return GST_FLOW_FLUSHING;
+
+  GST_OBJECT_LOCK (stream->pad);
+  ret = stream->queue_flow;
+  GST_OBJECT_UNLOCK (stream->pad);
+
+  return ret;
+}
+
+/* serialized events go through the queue, flushing flushes the queue */
+static gboolean
+gst_matroska_demux_push_stream_event (GstMatroskaDemuxH265 * demux,
+    GstMatroskaTrackContext * stream, GstEvent * event)
+{
+  gboolean res;
+
+  if (stream->queue == NULL)
+    return gst_pad_push_event (stream->pad, event);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      gst_data_queue_set_flushing (stream->queue, TRUE);
+      res = gst_pad_push_event (stream->pad, event);
+      gst_pad_pause_task (stream->pad);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_data_queue_flush (stream->queue);
+      res = gst_pad_push_event (stream->pad, event);
+      stream->queue_last_ts = GST_CLOCK_TIME_NONE;
+      GST_OBJECT_LOCK (stream->pad);
+      stream->queue_flow = GST_FLOW_OK;
+      GST_OBJECT_UNLOCK (stream->pad);
+      if (GST_PAD_MODE (stream->pad) == GST_PAD_MODE_PUSH) {
+        gst_data_queue_set_flushing (stream->queue, FALSE);
+        gst_pad_start_task (stream->pad,
+            (GstTaskFunction) gst_matroska_demux_output_loop, stream->pad,
+            NULL);
+      }
+      break;
+    default:
+      if (GST_EVENT_IS_SERIALIZED (event))
+        res = gst_matroska_demux_queue_object (demux, stream,
+            GST_MINI_OBJECT_CAST (event));
+      else
+        res = gst_pad_push_event (stream->pad, event);
+      break;
+  }
+
+  return res;
+}
+
 static GstFlowReturn
 gst_matroska_demux_add_stream (GstMatroskaDemuxH265 * demux, GstEbmlRead * ebml)
 {
@@ -1374,6 +1700,15 @@ gst_matroska_demux_add_stream (GstMatroskaDemuxH265 * demux, GstEbmlRead * ebml)
   gst_pad_set_element_private (context->pad, context);
 
   gst_pad_use_fixed_caps (context->pad);
+
+  if (demux->max_queue_time > 0) {
+    context->queue = gst_data_queue_new (gst_matroska_demux_queue_full,
+        gst_matroska_demux_queue_filled, gst_matroska_demux_queue_empty,
+        demux);
+    gst_pad_set_activatemode_function (context->pad,
+        GST_DEBUG_FUNCPTR (gst_matroska_demux_src_activate_mode));
+  }
+
   gst_pad_set_active (context->pad, TRUE);
 
   stream_id =
@@ -1528,6 +1863,31 @@ gst_matroska_demux_query (GstMatroskaDemuxH265 * demux, GstPad * pad,
       res = TRUE;
       break;
     }
+    case GST_QUERY_LATENCY:
+    {
+      gboolean live;
+      GstClockTime min, max, latency;
+
+      /* frames are pushed as soon as their block is complete, laced blocks
+       * delay their first frames by the duration of the others */
+      res = gst_pad_peer_query (demux->common.sinkpad, query);
+      if (res) {
+        gst_query_parse_latency (query, &live, &min, &max);
+        GST_OBJECT_LOCK (demux);
+        latency = demux->block_latency;
+        GST_OBJECT_UNLOCK (demux);
+        if (live) {
+          min += latency;
+          if (GST_CLOCK_TIME_IS_VALID (max))
+            max += latency;
+        }
+        GST_DEBUG_OBJECT (demux, "latency query: live %d, min %"
+            GST_TIME_FORMAT ", max %" GST_TIME_FORMAT, live,
+            GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+        gst_query_set_latency (query, live, min, max);
+      }
+      break;
+    }
     default:
       if (pad)
         res = gst_pad_query_default (pad, (GstObject *) demux, query);
@@ -1579,7 +1939,7 @@ gst_matroska_demux_send_event (GstMatroskaDemuxH265 * demux, GstEvent * event)
 
     stream = g_ptr_array_index (demux->common.src, i);
     gst_event_ref (event);
-    gst_pad_push_event (stream->pad, event);
+    gst_matroska_demux_push_stream_event (demux, stream, event);
     ret = TRUE;
 
     /* FIXME: send global tags before stream tags */
@@ -1587,7 +1947,7 @@ gst_matroska_demux_send_event (GstMatroskaDemuxH265 * demux, GstEvent * event)
       GST_DEBUG_OBJECT (demux, "Sending pending_tags %p for pad %s:%s : %"
           GST_PTR_FORMAT, stream->pending_tags,
           GST_DEBUG_PAD_NAME (stream->pad), stream->pending_tags);
-      gst_pad_push_event (stream->pad,
+      gst_matroska_demux_push_stream_event (demux, stream,
           gst_event_new_tag (stream->pending_tags));
       stream->pending_tags = NULL;
     }
@@ -1606,7 +1966,8 @@ gst_matroska_demux_send_event (GstMatroskaDemuxH265 * demux, GstEvent * event)
       GstMatroskaTrackContext *stream;
 
       stream = g_ptr_array_index (demux->common.src, i);
-      gst_pad_push_event (stream->pad, gst_event_ref (tag_event));
+      gst_matroska_demux_push_stream_event (demux, stream,
+          gst_event_ref (tag_event));
     }
 
     gst_event_unref (tag_event);
@@ -1649,6 +2010,7 @@ gst_matroska_demux_move_to_entry (GstMatroskaDemuxH265 * demux,
     /* position might be invalid; will error when streaming resumes ... */
     demux->common.offset = entry->pos + demux->common.ebml_segment_start;
     demux->next_cluster_offset = 0;
+    gst_matroska_read_common_reset_read_ahead (&demux->common);
 
     GST_DEBUG_OBJECT (demux,
         "Seeked to offset %" G_GUINT64_FORMAT ", block %d, " "time %"
@@ -1692,19 +2054,441 @@ gst_matroska_cluster_compare (gint64 * i1, gint64 * i2)
     return 0;
 }
 
-/* searches for a cluster start from @pos,
+/* remember a cluster position (and time, if known) */
+static void
+gst_matroska_demux_add_cluster (GstMatroskaDemuxH265 * demux, gint64 pos,
+    GstClockTime time)
+{
+  GstMatroskaClusterEntry entry, *found;
+  guint i;
+
+  if (G_UNLIKELY (!demux->clusters))
+    demux->clusters = g_array_sized_new (TRUE, TRUE,
+        sizeof (GstMatroskaClusterEntry), 100);
+
+  found = gst_util_array_binary_search (demux->clusters->data,
+      demux->clusters->len, sizeof (GstMatroskaClusterEntry),
+      (GCompareDataFunc) gst_matroska_cluster_compare,
+      GST_SEARCH_MODE_AFTER, &pos, NULL);
+  if (found && found->pos == pos) {
+    if (GST_CLOCK_TIME_IS_VALID (time))
+      found->time = time;
+    return;
+  }
+
+  i = found ? found - (GstMatroskaClusterEntry *) demux->clusters->data :
+      demux->clusters->len;
+  entry.pos = pos;
+  entry.time = time;
+  g_array_insert_val (demux->clusters, i, entry);
+}
+
+/* find next entry with a known time in [@from, @to], searching
+ * forward or backward, returns -1 if there is none */
+static gint
+gst_matroska_demux_next_timed_cluster (GstMatroskaDemuxH265 * demux,
+    gint from, gint to)
+{
+  GstMatroskaClusterEntry *entries =
+      (GstMatroskaClusterEntry *) demux->clusters->data;
+  gint step = from <= to ? 1 : -1;
+
+  for (; from != to + step; from += step) {
+    if (GST_CLOCK_TIME_IS_VALID (entries[from].time))
+      return from;
+  }
+  return -1;
+}
+
+/* interpolation search for the last known cluster starting at or before
+ * @time, @next is set to the first known cluster after @time (or NULL) */
+static GstMatroskaClusterEntry *
+gst_matroska_demux_search_clusters (GstMatroskaDemuxH265 * demux,
+    GstClockTime time, GstMatroskaClusterEntry ** next)
+{
+  GstMatroskaClusterEntry *entries;
+  gint lo, hi, mid;
+
+  *next = NULL;
+  if (!demux->clusters || demux->clusters->len == 0)
+    return NULL;
+
+  entries = (GstMatroskaClusterEntry *) demux->clusters->data;
+  lo = gst_matroska_demux_next_timed_cluster (demux, 0,
+      demux->clusters->len - 1);
+  if (lo < 0)
+    return NULL;
+  hi = gst_matroska_demux_next_timed_cluster (demux, demux->clusters->len - 1,
+      lo);
+
+  if (time < entries[lo].time) {
+    *next = &entries[lo];
+    return NULL;
+  }
+  if (time >= entries[hi].time)
+    return &entries[hi];
+
+  /* entries[lo].time <= time < entries[hi].time */
+  while (hi - lo > 1) {
+    mid = lo + gst_util_uint64_scale (hi - lo, time - entries[lo].time,
+        entries[hi].time - entries[lo].time);
+    mid = CLAMP (mid, lo + 1, hi - 1);
+    /* skip SeekHead entries that were not parsed yet */
+    if (!GST_CLOCK_TIME_IS_VALID (entries[mid].time)) {
+      gint found = gst_matroska_demux_next_timed_cluster (demux, mid, hi - 1);
+      if (found < 0)
+        found = gst_matroska_demux_next_timed_cluster (demux, mid, lo + 1);
+      if (found < 0)
+        break;
+      mid = found;
+    }
+    if (entries[mid].time <= time)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  *next = &entries[hi];
+  return &entries[lo];
+}
+
+/* pick up the cluster positions and the index of an earlier run from the
+ * sidecar, the index replaces the Cues */
+static void
+gst_matroska_demux_load_sidecar (GstMatroskaDemuxH265 * demux)
+{
+  const GstSeekIndexEntry *entries;
+  guint i, n;
+
+  if (!gst_seek_index_load (demux->sidecar))
+    return;
+
+  entries = gst_seek_index_get_table (demux->sidecar, SIDECAR_CLUSTERS,
+      sizeof (GstSeekIndexEntry), &n);
+  for (i = 0; entries && i < n; i++)
+    gst_matroska_demux_add_cluster (demux, entries[i].offset, entries[i].time);
+  demux->sidecar_clusters_len = demux->clusters ? demux->clusters->len : 0;
+
+  entries = gst_seek_index_get_table (demux->sidecar,
+      GST_SEEK_INDEX_KEYFRAMES, sizeof (GstSeekIndexEntry), &n);
+  if (entries && n > 0) {
+    /* set up once the tracks are known */
+    demux->sidecar_index_len = n;
+    demux->common.index_parsed = TRUE;
+  }
+
+  GST_DEBUG_OBJECT (demux, "sidecar has %u clusters and %u index entries",
+      demux->sidecar_clusters_len, demux->sidecar_index_len);
+}
+
+static void
+gst_matroska_demux_install_sidecar_index (GstMatroskaDemuxH265 * demux)
+{
+  const GstSeekIndexEntry *entries;
+  GstMatroskaIndex idx;
+  GArray *index;
+  guint i, n;
+
+  entries = gst_seek_index_get_table (demux->sidecar,
+      GST_SEEK_INDEX_KEYFRAMES, sizeof (GstSeekIndexEntry), &n);
+  if (!entries)
+    return;
+
+  index = g_array_sized_new (FALSE, FALSE, sizeof (GstMatroskaIndex), n);
+  for (i = 0; i < n; i++) {
+    idx.pos = entries[i].offset;
+    idx.track = entries[i].track;
+    idx.time = entries[i].time;
+    idx.block = entries[i].sample;
+    g_array_append_val (index, idx);
+  }
+  gst_matroska_read_common_finish_index (&demux->common, index);
+  g_array_free (index, TRUE);
+}
+
+/* write the index and the clusters seen to the sidecar, if there are more
+ * than were loaded from it */
+static void
+gst_matroska_demux_save_sidecar (GstMatroskaDemuxH265 * demux)
+{
+  GstSeekIndexEntry *entries;
+  guint i, n_index, n_clusters;
+
+  GST_OBJECT_LOCK (demux);
+  /* not with only parts of the Cues decoded */
+  n_index = demux->common.index
+      && !gst_matroska_read_common_index_is_deferred (&demux->common) ?
+      demux->common.index->len : 0;
+  n_clusters = demux->clusters ? demux->clusters->len : 0;
+  if (n_index <= demux->sidecar_index_len
+      && n_clusters <= demux->sidecar_clusters_len) {
+    GST_OBJECT_UNLOCK (demux);
+    return;
+  }
+
+  entries = g_new0 (GstSeekIndexEntry, MAX (n_index, n_clusters));
+  if (n_index > 0) {
+    GArray *index = gst_matroska_index_table_to_array (demux->common.index);
+
+    for (i = 0; i < n_index; i++) {
+      GstMatroskaIndex *idx = &g_array_index (index, GstMatroskaIndex, i);
+
+      entries[i].time = idx->time;
+      entries[i].offset = idx->pos;
+      entries[i].track = idx->track;
+      entries[i].sample = idx->block;
+    }
+    g_array_free (index, TRUE);
+  }
+  if (n_index > 0)
+    gst_seek_index_set_table (demux->sidecar, GST_SEEK_INDEX_KEYFRAMES,
+        sizeof (GstSeekIndexEntry), entries, n_index);
+  GST_OBJECT_UNLOCK (demux);
+
+  memset (entries, 0, n_clusters * sizeof (GstSeekIndexEntry));
+  for (i = 0; i < n_clusters; i++) {
+    GstMatroskaClusterEntry *cluster =
+        &g_array_index (demux->clusters, GstMatroskaClusterEntry, i);
+
+    entries[i].time = cluster->time;
+    entries[i].offset = cluster->pos;
+  }
+  gst_seek_index_set_table (demux->sidecar, SIDECAR_CLUSTERS,
+      sizeof (GstSeekIndexEntry), entries, n_clusters);
+  g_free (entries);
+
+  gst_seek_index_save (demux->sidecar);
+}
+
+/* decode the Cues around @time, back to an entry of the track seeking will
+ * use, or all of them */
+static void
+gst_matroska_demux_load_index (GstMatroskaDemuxH265 * demux,
+    GstMatroskaTrackContext * track, GstClockTime time, gboolean all)
+{
+  GArray *entries;
+  GstFlowReturn ret;
+  guint i;
+
+  /* like gst_matroska_read_common_get_seek_track(), but the video track
+   * may have no index yet */
+  track = gst_matroska_read_common_get_seek_track (&demux->common, track);
+  for (i = 0; (!track || track->type != GST_MATROSKA_TRACK_TYPE_VIDEO)
+      && i < demux->common.src->len; i++) {
+    GstMatroskaTrackContext *stream;
+
+    stream = g_ptr_array_index (demux->common.src, i);
+    if (stream->type == GST_MATROSKA_TRACK_TYPE_VIDEO)
+      track = stream;
+  }
+
+  entries = g_array_new (FALSE, FALSE, sizeof (GstMatroskaIndex));
+  ret = gst_matroska_read_common_load_index (&demux->common,
+      GST_ELEMENT_CAST (demux), track, time, all, entries);
+  if (ret != GST_FLOW_OK)
+    GST_WARNING_OBJECT (demux, "failed to load Cues: %s",
+        gst_flow_get_name (ret));
+
+  if (entries->len > 0) {
+    GST_OBJECT_LOCK (demux);
+    gst_matroska_read_common_merge_index (&demux->common, entries);
+    GST_OBJECT_UNLOCK (demux);
+  }
+  g_array_free (entries, TRUE);
+}
+
+/* returns the offset of the first possible cluster id in @data, or -1 */
+static gint
+gst_matroska_demux_scan_cluster_id (const guint8 * data, gsize size)
+{
+  const guint8 *p = data, *end = data + size;
+
+  if (size < 4)
+    return -1;
+
+#if defined(__SSE2__)
+  {
+    const __m128i id0 = _mm_set1_epi8 ((GST_MATROSKA_ID_CLUSTER >> 24) & 0xff);
+    const __m128i id1 = _mm_set1_epi8 ((GST_MATROSKA_ID_CLUSTER >> 16) & 0xff);
+
+    /* match the first two id bytes at 16 positions at once,
+     * the rare hits are then compared in full */
+    for (; end - p >= 17; p += 16) {
+      __m128i a = _mm_loadu_si128 ((const __m128i *) p);
+      __m128i b = _mm_loadu_si128 ((const __m128i *) (p + 1));
+      guint mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (a, id0),
+              _mm_cmpeq_epi8 (b, id1)));
+
+      while (mask) {
+        guint i = g_bit_nth_lsf (mask, -1);
+
+        if (p + i + 4 <= end
+            && GST_READ_UINT32_BE (p + i) == GST_MATROSKA_ID_CLUSTER)
+          return p + i - data;
+        mask &= mask - 1;
+      }
+    }
+  }
+#endif
+
+  /* memchr is vectorized by most C libraries as well */
+  while (end - p >= 4) {
+    p = memchr (p, (GST_MATROSKA_ID_CLUSTER >> 24) & 0xff, end - p - 3);
+    if (p == NULL)
+      break;
+    if (GST_READ_UINT32_BE (p) == GST_MATROSKA_ID_CLUSTER)
+      return p - data;
+    p++;
+  }
+
+  return -1;
+}
+
+/* reads the id and size of the element at @data, returns the number of
+ * header bytes or -1 if invalid or incomplete */
+static gint
+gst_matroska_demux_read_element_header (const guint8 * data, gsize size,
+    guint32 * id, guint64 * length)
+{
+  guint id_len, i;
+  gint len;
+
+  if (size == 0)
+    return -1;
+  id_len = gst_ebml_vint_length (data[0]);
+  if (id_len == 0 || id_len > 4 || id_len >= size)
+    return -1;
+  *id = 0;
+  for (i = 0; i < id_len; i++)
+    *id = (*id << 8) | data[i];
+
+  len = gst_ebml_read_vint (data + id_len, MIN (size - id_len, G_MAXUINT),
+      length);
+  if (len < 0)
+    return -1;
+
+  return id_len + len;
+}
+
+static inline gboolean
+gst_matroska_demux_is_block_id (guint32 id)
+{
+  switch (id) {
+    case GST_MATROSKA_ID_SIMPLEBLOCK:
+    case GST_MATROSKA_ID_BLOCKGROUP:
+    case GST_MATROSKA_ID_ENCRYPTEDBLOCK:
+    case GST_MATROSKA_ID_POSITION:
+    case GST_MATROSKA_ID_PREVSIZE:
+    case GST_MATROSKA_ID_SILENTTRACKS:
+    case GST_EBML_ID_VOID:
+    case GST_EBML_ID_CRC32:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/* cheap checks on the cluster candidate at the start of @data (at @offset
+ * in the file) before it is verified by pulling the following element:
+ * the size has to fit the file, the timecode must not be below
+ * @min_timecode and the timecode has to be followed by a block (or another
+ * cluster child).  Returns FALSE if the candidate is certainly bogus, and
+ * TRUE if it is plausible or if there is not enough data to tell. */
+static gboolean
+gst_matroska_demux_check_cluster_candidate (GstMatroskaDemuxH265 * demux,
+    const guint8 * data, gsize size, gint64 offset, gint64 upstream_length,
+    guint64 min_timecode)
+{
+  guint64 length, timecode;
+  guint32 id;
+  gsize pos;
+  gint len;
+  guint i;
+
+  len = gst_matroska_demux_read_element_header (data, size, &id, &length);
+  if (len < 0)
+    return size < 12;
+  if (length != G_MAXUINT64) {
+    if (length < 3 || (upstream_length > 0
+            && offset + len + length > (guint64) upstream_length)) {
+      GST_LOG_OBJECT (demux, "invalid cluster size %" G_GUINT64_FORMAT,
+          length);
+      return FALSE;
+    }
+    if (length < size - len)
+      size = len + length;
+  }
+  pos = len;
+
+  /* skip CRC-32 and Void elements before the first real child */
+  while (1) {
+    len = gst_matroska_demux_read_element_header (data + pos, size - pos,
+        &id, &length);
+    if (len < 0)
+      return size - pos < 12;
+    if (id == GST_MATROSKA_ID_CLUSTERTIMECODE)
+      break;
+    if (!gst_matroska_demux_is_block_id (id)) {
+      GST_LOG_OBJECT (demux, "unexpected cluster child 0x%x", id);
+      return FALSE;
+    }
+    if (id != GST_EBML_ID_VOID && id != GST_EBML_ID_CRC32)
+      return TRUE;
+    if (length == G_MAXUINT64)
+      return FALSE;
+    if (len + length >= size - pos)
+      return TRUE;
+    pos += len + length;
+  }
+
+  if (length == 0 || length > 8) {
+    GST_LOG_OBJECT (demux, "invalid cluster timecode size %" G_GUINT64_FORMAT,
+        length);
+    return FALSE;
+  }
+  pos += len;
+  if (size - pos < length)
+    return TRUE;
+  timecode = 0;
+  for (i = 0; i < length; i++)
+    timecode = (timecode << 8) | data[pos + i];
+  if (min_timecode != GST_CLOCK_TIME_NONE && timecode < min_timecode) {
+    GST_LOG_OBJECT (demux, "cluster timecode %" G_GUINT64_FORMAT
+        " goes back from %" G_GUINT64_FORMAT, timecode, min_timecode);
+    return FALSE;
+  }
+  pos += length;
+
+  len = gst_matroska_demux_read_element_header (data + pos, size - pos,
+      &id, &length);
+  if (len < 0)
+    return size - pos < 12;
+  if (!gst_matroska_demux_is_block_id (id)) {
+    GST_LOG_OBJECT (demux, "cluster timecode followed by 0x%x", id);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* searches for a cluster start from @pos, skipping candidates whose
+ * timecode is below @min_timecode (in cluster timecode units, or
+ * GST_CLOCK_TIME_NONE for any),
  * return GST_FLOW_OK and cluster position in @pos if found */
 static GstFlowReturn
-gst_matroska_demux_search_cluster (GstMatroskaDemuxH265 * demux, gint64 * pos)
+gst_matroska_demux_search_cluster (GstMatroskaDemuxH265 * demux, gint64 * pos,
+    guint64 min_timecode)
 {
   gint64 newpos = *pos;
   gint64 orig_offset;
+  gint64 upstream_length;
   GstFlowReturn ret = GST_FLOW_OK;
   const guint chunk = 64 * 1024;
   GstBuffer *buf = NULL;
   GstMapInfo map;
-  gpointer data = NULL;
-  gsize size;
+  const guint8 *data = NULL;
+  gsize size, skip;
+  gint64 bufpos;
   guint64 length;
   guint32 id;
   guint needed;
@@ -1718,7 +2502,7 @@ gst_matroska_demux_search_cluster (GstMatroskaDemuxH265 * demux, gint64 * pos)
     gint64 *cpos;
 
     cpos = gst_util_array_binary_search (demux->clusters->data,
-        demux->clusters->len, sizeof (gint64),
+        demux->clusters->len, sizeof (GstMatroskaClusterEntry),
         (GCompareDataFunc) gst_matroska_cluster_compare,
         GST_SEARCH_MODE_AFTER, pos, NULL);
     /* sanity check */
@@ -1735,9 +2519,10 @@ gst_matroska_demux_search_cluster (GstMatroskaDemuxH265 * demux, gint64 * pos)
     }
   }
 
+  upstream_length = gst_matroska_read_common_get_length (&demux->common);
+
   /* read in at newpos and scan for ebml cluster id */
   while (1) {
-    GstByteReader reader;
     gint cluster_pos;
 
     if (buf != NULL) {
@@ -1754,17 +2539,16 @@ gst_matroska_demux_search_cluster (GstMatroskaDemuxH265 * demux, gint64 * pos)
     gst_buffer_map (buf, &map, GST_MAP_READ);
     data = map.data;
     size = map.size;
-    gst_byte_reader_init (&reader, data, size);
+    bufpos = newpos;
+    skip = 0;
   resume:
-    cluster_pos = gst_byte_reader_masked_scan_uint32 (&reader, 0xffffffff,
-        GST_MATROSKA_ID_CLUSTER, 0, gst_byte_reader_get_remaining (&reader));
+    cluster_pos = gst_matroska_demux_scan_cluster_id (data + skip,
+        size - skip);
     if (cluster_pos >= 0) {
-      newpos += cluster_pos;
+      skip += cluster_pos;
+      newpos = bufpos + skip;
       /* prepare resuming at next byte */
-      if (!gst_byte_reader_skip (&reader, cluster_pos + 1)) {
-        GST_DEBUG_OBJECT (demux, "Need more data -> continue");
-        continue;
-      }
+      skip++;
       GST_DEBUG_OBJECT (demux,
           "found cluster ebml id at offset %" G_GINT64_FORMAT, newpos);
       /* extra checks whether we really sync'ed to a cluster:
@@ -1777,6 +2561,13 @@ gst_matroska_demux_search_cluster (GstMatroskaDemuxH265 * demux, gint64 * pos)
         GST_DEBUG_OBJECT (demux, "cluster is first cluster -> OK");
         break;
       }
+      /* weed out most false positives without pulling more data */
+      if (!gst_matroska_demux_check_cluster_candidate (demux,
+              data + skip - 1, size - skip + 1, newpos, upstream_length,
+              min_timecode)) {
+        GST_DEBUG_OBJECT (demux, "not a valid cluster, resume");
+        goto resume;
+      }
       demux->common.offset = newpos;
       ret = gst_matroska_read_common_peek_id_length_pull (&demux->common,
           GST_ELEMENT_CAST (demux), &id, &length, &needed);
@@ -1806,7 +2597,7 @@ gst_matroska_demux_search_cluster (GstMatroskaDemuxH265 * demux, gint64 * pos)
       goto resume;
     } else {
       /* partial cluster id may have been in tail of buffer */
-      newpos += MAX (gst_byte_reader_get_remaining (&reader), 4) - 3;
+      newpos = bufpos + MAX (size, 4) - 3;
     }
   }
 
@@ -1822,6 +2613,34 @@ exit:
   return ret;
 }
 
+/* look up @time in the index that is being built in the background,
+ * only succeeds if the index covers @time already */
+static gboolean
+gst_matroska_demux_search_built_index (GstMatroskaDemuxH265 * demux,
+    GstClockTime time, GstMatroskaIndex * entry)
+{
+  GstMatroskaIndex *found = NULL;
+
+  GST_OBJECT_LOCK (demux);
+  if (demux->built_index && GST_CLOCK_TIME_IS_VALID (demux->built_index_time)
+      && time < demux->built_index_time) {
+    found = gst_util_array_binary_search (demux->built_index->data,
+        demux->built_index->len, sizeof (GstMatroskaIndex),
+        (GCompareDataFunc) gst_matroska_index_seek_find,
+        GST_SEARCH_MODE_BEFORE, &time, NULL);
+    if (found)
+      *entry = *found;
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  if (found)
+    GST_DEBUG_OBJECT (demux, "built index entry for %" GST_TIME_FORMAT
+        ": time %" GST_TIME_FORMAT ", pos %" G_GUINT64_FORMAT,
+        GST_TIME_ARGS (time), GST_TIME_ARGS (entry->time), entry->pos);
+
+  return found != NULL;
+}
+
 /* bisect and scan through file for cluster starting before @time,
  * returns fake index entry with corresponding info on cluster */
 static GstMatroskaIndex *
@@ -1832,7 +2651,9 @@ gst_matroska_demux_search_pos (GstMatroskaDemuxH265 * demux, GstClockTime time)
   GstClockTime otime, prev_cluster_time, current_cluster_time, cluster_time;
   gint64 opos, newpos, startpos = 0, current_offset;
   gint64 prev_cluster_offset = -1, current_cluster_offset, cluster_offset;
+  gint64 before_pos = -1, after_pos = -1;
   const guint chunk = 64 * 1024;
+  GstMatroskaClusterEntry *before, *after;
   GstFlowReturn ret;
   guint64 length;
   guint32 id;
@@ -1853,6 +2674,7 @@ gst_matroska_demux_search_pos (GstMatroskaDemuxH265 * demux, GstClockTime time)
   current_offset = demux->common.offset;
 
   demux->common.state = GST_MATROSKA_READ_STATE_SCANNING;
+  gst_matroska_read_common_reset_read_ahead (&demux->common);
 
   /* estimate using start and current position */
   GST_OBJECT_LOCK (demux);
@@ -1868,6 +2690,36 @@ gst_matroska_demux_search_pos (GstMatroskaDemuxH265 * demux, GstClockTime time)
     otime = time;
 
 retry:
+  /* clusters seen so far bracket the target */
+  before = gst_matroska_demux_search_clusters (demux, time, &after);
+  if (before && after) {
+    if ((before->pos == before_pos && after->pos == after_pos)
+        || after->pos - before->pos <= chunk) {
+      /* no better guess possible, scan forward from the known cluster */
+      GST_DEBUG_OBJECT (demux, "scanning from known cluster at offset %"
+          G_GINT64_FORMAT, before->pos);
+      newpos = before->pos;
+      goto scan;
+    }
+    newpos = before->pos + gst_util_uint64_scale (after->pos - before->pos,
+        time - before->time, after->time - before->time);
+    GST_DEBUG_OBJECT (demux, "interpolated offset for %" GST_TIME_FORMAT
+        " between clusters at %" G_GINT64_FORMAT " and %" G_GINT64_FORMAT
+        ": %" G_GINT64_FORMAT, GST_TIME_ARGS (time), before->pos, after->pos,
+        newpos);
+    before_pos = before->pos;
+    after_pos = after->pos;
+    ret = gst_matroska_demux_search_cluster (demux, &newpos,
+        GST_CLOCK_TIME_NONE);
+    if (ret != GST_FLOW_OK)
+      newpos = before_pos;
+    goto scan;
+  } else if (before) {
+    /* target lies beyond the known clusters, extrapolate from the last one */
+    opos = before->pos;
+    otime = before->time;
+  }
+
   GST_LOG_OBJECT (demux,
       "opos: %" G_GUINT64_FORMAT ", otime: %" GST_TIME_FORMAT ", %"
       GST_TIME_FORMAT " in stream time (start %" GST_TIME_FORMAT "), time %"
@@ -1898,11 +2750,18 @@ retry:
   if (startpos && startpos < newpos)
     newpos = startpos;
 
+  /* but no need to scan clusters that are known already */
+  if (before && newpos <= before->pos) {
+    newpos = before->pos;
+    goto scan;
+  }
+
   /* read in at newpos and scan for ebml cluster id */
   startpos = newpos;
   while (1) {
 
-    ret = gst_matroska_demux_search_cluster (demux, &newpos);
+    ret = gst_matroska_demux_search_cluster (demux, &newpos,
+        GST_CLOCK_TIME_NONE);
     if (ret == GST_FLOW_EOS) {
       /* heuristic HACK */
       newpos = startpos * 80 / 100;
@@ -1918,8 +2777,10 @@ retry:
     }
   }
 
+scan:
   /* then start scanning and parsing for cluster time,
    * re-estimate if overshoot, otherwise next cluster and so on */
+  prev_cluster_time = GST_CLOCK_TIME_NONE;
   demux->common.offset = newpos;
   demux->cluster_time = cluster_time = GST_CLOCK_TIME_NONE;
   while (1) {
@@ -2051,7 +2912,9 @@ gst_matroska_demux_handle_seek_event (GstMatroskaDemuxH265 * demux,
    * we might be playing a file that's still being recorded
    * so, invalidate our current duration, which is only a moving target,
    * and should not be used to clamp anything */
-  if (!demux->streaming && !demux->common.index && demux->invalid_duration) {
+  if (!demux->streaming && !demux->common.index
+      && !gst_matroska_read_common_index_is_deferred (&demux->common)
+      && demux->invalid_duration) {
     seeksegment.duration = GST_CLOCK_TIME_NONE;
   }
 
@@ -2080,6 +2943,13 @@ gst_matroska_demux_handle_seek_event (GstMatroskaDemuxH265 * demux,
    * would be determined again when parsing, but anyway ... */
   seeksegment.duration = demux->common.segment.duration;
 
+  /* decode the part of lazily loaded Cues this seek needs, reverse playback
+   * and trick modes step through the index and need all of it */
+  if (!demux->streaming
+      && gst_matroska_read_common_index_is_deferred (&demux->common))
+    gst_matroska_demux_load_index (demux, track, seeksegment.position,
+        rate < 0.0 || (flags & GST_SEEK_FLAG_SKIP));
+
   flush = ! !(flags & GST_SEEK_FLAG_FLUSH);
   keyunit = ! !(flags & GST_SEEK_FLAG_KEY_UNIT);
   after = ! !(flags & GST_SEEK_FLAG_SNAP_AFTER);
@@ -2097,9 +2967,12 @@ gst_matroska_demux_handle_seek_event (GstMatroskaDemuxH265 * demux,
     snap_next = !snap_next;
   GST_OBJECT_LOCK (demux);
   track = gst_matroska_read_common_get_seek_track (&demux->common, track);
-  if ((entry = gst_matroska_read_common_do_index_seek (&demux->common, track,
-              seeksegment.position, &demux->seek_index, &demux->seek_entry,
-              snap_next)) == NULL) {
+  /* the entry is copied out, lazily loaded Cues may replace the index */
+  if (gst_matroska_read_common_do_index_seek (&demux->common, track,
+          seeksegment.position, &demux->seek_index, &demux->seek_entry,
+          snap_next, &scan_entry)) {
+    entry = &scan_entry;
+  } else {
     /* pull mode without index can scan later on */
     if (demux->streaming) {
       GST_DEBUG_OBJECT (demux, "No matching seek entry in index");
@@ -2165,9 +3038,15 @@ next:
       gst_event_set_seqnum (flush_event, seqnum);
       gst_pad_push_event (demux->common.sinkpad, flush_event);
     }
-    entry = gst_matroska_demux_search_pos (demux, seeksegment.position);
+    if (gst_matroska_demux_search_built_index (demux, seeksegment.position,
+            &scan_entry))
+      entry = &scan_entry;
+    else
+      entry = gst_matroska_demux_search_pos (demux, seeksegment.position);
     /* keep local copy */
-    if (entry) {
+    if (entry == &scan_entry) {
+      GST_DEBUG_OBJECT (demux, "using background index");
+    } else if (entry) {
       scan_entry = *entry;
       g_free (entry);
       entry = &scan_entry;
@@ -2207,6 +3086,13 @@ finish:
   }
 
 exit:
+  /* streaming is stopped, index arrays replaced while loading Cues can go */
+  GST_OBJECT_LOCK (demux);
+  if (g_list_find (demux->common.index_retired, demux->seek_index))
+    demux->seek_index = NULL;
+  GST_OBJECT_UNLOCK (demux);
+  gst_matroska_read_common_free_retired_index (&demux->common);
+
   if (flush) {
     GstEvent *flush_event = gst_event_new_flush_stop (TRUE);
     gst_event_set_seqnum (flush_event, seqnum);
@@ -2219,6 +3105,7 @@ exit:
   /* now update the real segment info */
   GST_DEBUG_OBJECT (demux, "Committing new seek segment");
   memcpy (&demux->common.segment, &seeksegment, sizeof (GstSegment));
+  demux->trick_jump = FALSE;
   GST_OBJECT_UNLOCK (demux);
 
   /* update some (segment) state */
@@ -2490,11 +3377,11 @@ gst_matroska_demux_seek_to_previous_keyframe (GstMatroskaDemuxH265 * demux)
   }
 
   if (!done) {
-    GstMatroskaIndex *entry;
+    GstMatroskaIndex entry;
 
-    entry = &g_array_index (demux->seek_index, GstMatroskaIndex,
-        --demux->seek_entry);
-    if (!gst_matroska_demux_move_to_entry (demux, entry, FALSE, TRUE))
+    gst_matroska_index_table_get (demux->seek_index, --demux->seek_entry,
+        &entry);
+    if (!gst_matroska_demux_move_to_entry (demux, &entry, FALSE, TRUE))
       goto exit;
 
     ret = GST_FLOW_OK;
@@ -2504,6 +3391,49 @@ exit:
   return ret;
 }
 
+/* In key unit trick mode (the SKIP seek flag), only keyframes of video
+ * tracks are pushed. Instead of reading all the delta units in between,
+ * continue with the index entry after the keyframe that was just pushed,
+ * or the one before it for reverse playback. */
+static GstFlowReturn
+gst_matroska_demux_trick_mode_jump (GstMatroskaDemuxH265 * demux)
+{
+  GstMatroskaIndex entry;
+  gboolean found = FALSE;
+  gint i;
+
+  if (demux->common.segment.rate < 0.0) {
+    if (demux->seek_entry <= 0) {
+      GST_DEBUG_OBJECT (demux, "no earlier index entry");
+      return GST_FLOW_EOS;
+    }
+    gst_matroska_index_table_get (demux->seek_index, --demux->seek_entry,
+        &entry);
+  } else {
+    /* the index may have entries of several tracks for the same cluster */
+    for (i = demux->seek_entry + 1; i < demux->seek_index->len; i++) {
+      gst_matroska_index_table_get (demux->seek_index, i, &entry);
+
+      if (entry.pos + demux->common.ebml_segment_start >
+          demux->cluster_offset) {
+        found = TRUE;
+        demux->seek_entry = i;
+        break;
+      }
+    }
+    /* past the last entry, just read on */
+    if (!found)
+      return GST_FLOW_OK;
+  }
+
+  GST_LOG_OBJECT (demux, "trick mode jump to entry %d at %" GST_TIME_FORMAT,
+      demux->seek_entry, GST_TIME_ARGS (entry.time));
+  gst_matroska_demux_move_to_entry (demux, &entry,
+      demux->common.segment.rate > 0.0, TRUE);
+
+  return GST_FLOW_OK;
+}
+
 static GstFlowReturn
 gst_matroska_demux_parse_tracks (GstMatroskaDemuxH265 * demux,
     GstEbmlRead * ebml)
@@ -2542,64 +3472,275 @@ gst_matroska_demux_parse_tracks (GstMatroskaDemuxH265 * demux,
 }
 
 /*
- * Read signed/unsigned "EBML" numbers.
- * Return: number of bytes processed.
+ * Background index building: walk the cluster headers with a reader of
+ * our own, only peeking at the block headers until the first keyframe of
+ * the seek track in each cluster is found.
  */
 
-static gint
-gst_matroska_ebmlnum_uint (guint8 * data, guint size, guint64 * num)
+static GstFlowReturn
+gst_matroska_demux_index_builder_peek (GstMatroskaDemuxH265 * demux,
+    GstMatroskaReadCommon * reader, guint32 * id, guint64 * length,
+    guint * needed)
 {
-  gint len_mask = 0x80, read = 1, n = 1, num_ffs = 0;
-  guint64 total;
+  GstFlowReturn ret;
 
-  if (size <= 0) {
-    return -1;
+  /* upstream is flushing while the streaming thread seeks */
+  while ((ret = gst_matroska_read_common_peek_id_length_pull (reader,
+              GST_ELEMENT_CAST (demux), id, length, needed))
+      == GST_FLOW_FLUSHING
+      && !g_atomic_int_get (&demux->index_builder_stop))
+    g_usleep (INDEX_BUILDER_RETRY_DELAY);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_matroska_demux_index_builder_peek_bytes (GstMatroskaDemuxH265 * demux,
+    GstMatroskaReadCommon * reader, guint size, guint8 ** data)
+{
+  GstFlowReturn ret;
+
+  while ((ret = gst_matroska_read_common_peek_bytes (reader, reader->offset,
+              size, NULL, data)) == GST_FLOW_FLUSHING
+      && !g_atomic_int_get (&demux->index_builder_stop))
+    g_usleep (INDEX_BUILDER_RETRY_DELAY);
+
+  return ret;
+}
+
+/* parse track number and relative timecode of the (Simple)Block at the
+ * reader's offset */
+static gboolean
+gst_matroska_demux_index_builder_block_header (GstMatroskaDemuxH265 * demux,
+    GstMatroskaReadCommon * reader, guint64 length, guint64 * track,
+    gint16 * timecode, guint8 * flags)
+{
+  guint8 *data;
+  guint size = MIN (length, 12);
+  gint n;
+
+  if (gst_matroska_demux_index_builder_peek_bytes (demux, reader, size,
+          &data) != GST_FLOW_OK)
+    return FALSE;
+
+  if ((n = gst_ebml_read_vint (data, size, track)) < 0 || size < n + 3)
+    return FALSE;
+
+  *timecode = GST_READ_UINT16_BE (data + n);
+  *flags = data[n + 2];
+  return TRUE;
+}
+
+/* scan a cluster until @end for the first keyframe of track @track_num,
+ * returns TRUE and fills @entry if one was found */
+static gboolean
+gst_matroska_demux_index_builder_scan_cluster (GstMatroskaDemuxH265 * demux,
+    GstMatroskaReadCommon * reader, guint64 end, guint64 track_num,
+    guint64 time_scale, GstMatroskaIndex * entry)
+{
+  GstClockTime cluster_time = GST_CLOCK_TIME_NONE;
+  guint32 block = 0;
+  guint64 length, track = 0;
+  guint32 id;
+  guint needed;
+  gint16 timecode = 0;
+  guint8 flags;
+
+  while (reader->offset < end) {
+    guint64 element_end;
+    gboolean keyframe = FALSE;
+
+    if (gst_matroska_demux_index_builder_peek (demux, reader, &id, &length,
+            &needed) != GST_FLOW_OK || length == G_MAXUINT64)
+      return FALSE;
+    element_end = reader->offset + needed + length;
+    reader->offset += needed;
+
+    switch (id) {
+      case GST_MATROSKA_ID_CLUSTERTIMECODE:
+      {
+        guint8 *data;
+        guint64 num = 0;
+        guint i;
+
+        if (length > 8 || gst_matroska_demux_index_builder_peek_bytes (demux,
+                reader, length, &data) != GST_FLOW_OK)
+          return FALSE;
+        for (i = 0; i < length; i++)
+          num = (num << 8) | data[i];
+        cluster_time = num;
+
+        /* all clusters before this one are indexed now */
+        GST_OBJECT_LOCK (demux);
+        demux->built_index_time = cluster_time * time_scale;
+        GST_OBJECT_UNLOCK (demux);
+        break;
+      }
+
+      case GST_MATROSKA_ID_SIMPLEBLOCK:
+        block++;
+        if (gst_matroska_demux_index_builder_block_header (demux, reader,
+                length, &track, &timecode, &flags))
+          keyframe = (flags & 0x80) != 0;
+        break;
+
+      case GST_MATROSKA_ID_BLOCKGROUP:
+      {
+        gboolean have_block = FALSE, have_reference = FALSE;
+
+        block++;
+        while (reader->offset < element_end) {
+          guint64 child_end;
+
+          if (gst_matroska_demux_index_builder_peek (demux, reader, &id,
+                  &length, &needed) != GST_FLOW_OK || length == G_MAXUINT64)
+            return FALSE;
+          child_end = reader->offset + needed + length;
+          reader->offset += needed;
+          if (id == GST_MATROSKA_ID_BLOCK)
+            have_block = gst_matroska_demux_index_builder_block_header (demux,
+                reader, length, &track, &timecode, &flags);
+          else if (id == GST_MATROSKA_ID_REFERENCEBLOCK)
+            have_reference = TRUE;
+          reader->offset = child_end;
+        }
+        keyframe = have_block && !have_reference;
+        break;
+      }
+
+      default:
+        break;
+    }
+
+    if (keyframe && track == track_num
+        && GST_CLOCK_TIME_IS_VALID (cluster_time)) {
+      entry->track = track_num;
+      entry->block = block;
+      entry->time = MAX ((gint64) cluster_time + timecode, 0) * time_scale;
+      return TRUE;
+    }
+
+    reader->offset = element_end;
   }
 
-  total = data[0];
-  while (read <= 8 && !(total & len_mask)) {
-    read++;
-    len_mask >>= 1;
+  return FALSE;
+}
+
+static gpointer
+gst_matroska_demux_index_builder_thread (GstMatroskaDemuxH265 * demux)
+{
+  GstMatroskaReadCommon reader;
+  GstMatroskaTrackContext *track = NULL;
+  GstMatroskaIndex entry;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint64 track_num, time_scale, segment_start, length;
+  guint32 id;
+  guint needed, i;
+
+  memset (&reader, 0, sizeof (reader));
+  reader.sinkpad = demux->common.sinkpad;
+  reader.offset = demux->first_cluster_offset;
+
+  /* index the first video track, or the first track if there is none */
+  GST_OBJECT_LOCK (demux);
+  for (i = 0; i < demux->common.src->len; i++) {
+    GstMatroskaTrackContext *stream = g_ptr_array_index (demux->common.src, i);
+    if (track == NULL || (stream->type == GST_MATROSKA_TRACK_TYPE_VIDEO
+            && track->type != GST_MATROSKA_TRACK_TYPE_VIDEO))
+      track = stream;
   }
-  if (read > 8)
-    return -1;
+  track_num = track ? track->num : 0;
+  time_scale = demux->common.time_scale;
+  segment_start = demux->common.ebml_segment_start;
+  GST_OBJECT_UNLOCK (demux);
 
-  if ((total &= (len_mask - 1)) == len_mask - 1)
-    num_ffs++;
-  if (size < read)
-    return -1;
-  while (n < read) {
-    if (data[n] == 0xff)
-      num_ffs++;
-    total = (total << 8) | data[n];
-    n++;
+  GST_DEBUG_OBJECT (demux, "building index for track %" G_GUINT64_FORMAT
+      " from offset %" G_GUINT64_FORMAT, track_num, reader.offset);
+
+  while (track_num > 0 && !g_atomic_int_get (&demux->index_builder_stop)) {
+    guint64 element = reader.offset;
+
+    ret = gst_matroska_demux_index_builder_peek (demux, &reader, &id, &length,
+        &needed);
+    if (ret != GST_FLOW_OK)
+      break;
+    if (length == G_MAXUINT64) {
+      GST_DEBUG_OBJECT (demux, "element with unknown size at offset %"
+          G_GUINT64_FORMAT ", can't build index", element);
+      ret = GST_FLOW_ERROR;
+      break;
+    }
+
+    if (id == GST_MATROSKA_ID_CLUSTER) {
+      reader.offset += needed;
+      if (gst_matroska_demux_index_builder_scan_cluster (demux, &reader,
+              element + needed + length, track_num, time_scale, &entry)) {
+        GstMatroskaIndex *last = demux->built_index->len ?
+            &g_array_index (demux->built_index, GstMatroskaIndex,
+            demux->built_index->len - 1) : NULL;
+
+        entry.pos = element - segment_start;
+        /* the index is searched by time, clusters out of order can't go in */
+        GST_OBJECT_LOCK (demux);
+        if (last == NULL || entry.time >= last->time)
+          g_array_append_val (demux->built_index, entry);
+        GST_OBJECT_UNLOCK (demux);
+      }
+    }
+    reader.offset = element + needed + length;
+
+    /* playback has priority */
+    g_thread_yield ();
   }
 
-  if (read == num_ffs && total != 0)
-    *num = G_MAXUINT64;
-  else
-    *num = total;
+  GST_OBJECT_LOCK (demux);
+  if (ret == GST_FLOW_EOS && !demux->common.index
+      && demux->built_index->len > 0) {
+    GST_DEBUG_OBJECT (demux, "index complete with %u entries",
+        demux->built_index->len);
+    demux->common.index =
+        gst_matroska_index_table_new_from_array (demux->built_index,
+        demux->common.time_scale);
+    g_array_free (demux->built_index, TRUE);
+    demux->built_index = NULL;
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  gst_matroska_read_common_free_cache (&reader);
 
-  return read;
+  return NULL;
 }
 
-static gint
-gst_matroska_ebmlnum_sint (guint8 * data, guint size, gint64 * num)
+static void
+gst_matroska_demux_start_index_builder (GstMatroskaDemuxH265 * demux)
 {
-  guint64 unum;
-  gint res;
+  if (demux->index_builder)
+    return;
 
-  /* read as unsigned number first */
-  if ((res = gst_matroska_ebmlnum_uint (data, size, &unum)) < 0)
-    return -1;
+  demux->built_index =
+      g_array_sized_new (FALSE, FALSE, sizeof (GstMatroskaIndex), 128);
+  demux->built_index_time = GST_CLOCK_TIME_NONE;
+  g_atomic_int_set (&demux->index_builder_stop, 0);
+  demux->index_builder = g_thread_new ("matroskademux-index",
+      (GThreadFunc) gst_matroska_demux_index_builder_thread, demux);
+}
 
-  /* make signed */
-  if (unum == G_MAXUINT64)
-    *num = G_MAXINT64;
-  else
-    *num = unum - ((1 << ((7 * res) - 1)) - 1);
+static void
+gst_matroska_demux_stop_index_builder (GstMatroskaDemuxH265 * demux)
+{
+  if (demux->index_builder) {
+    g_atomic_int_set (&demux->index_builder_stop, 1);
+    g_thread_join (demux->index_builder);
+    demux->index_builder = NULL;
+  }
 
-  return res;
+  GST_OBJECT_LOCK (demux);
+  if (demux->built_index) {
+    g_array_free (demux->built_index, TRUE);
+    demux->built_index = NULL;
+  }
+  demux->built_index_time = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (demux);
 }
 
 /*
@@ -2652,7 +3793,7 @@ gst_matroska_demux_sync_streams (GstMatroskaDemuxH265 * demux)
 
       event = gst_event_new_gap (start, stop - start);
       GST_OBJECT_UNLOCK (demux);
-      gst_pad_push_event (context->pad, event);
+      gst_matroska_demux_push_stream_event (demux, context, event);
       GST_OBJECT_LOCK (demux);
     }
   }
@@ -2684,7 +3825,7 @@ gst_matroska_demux_push_stream_headers (GstMatroskaDemuxH265 * demux,
     }
 
     /* push out all headers in one go and use last flow return */
-    ret = gst_pad_push (stream->pad, buf);
+    ret = gst_matroska_demux_push_buffer (demux, stream, buf);
   }
 
   /* don't need these any  longer */
@@ -2757,7 +3898,7 @@ gst_matroska_demux_push_dvd_clut_change_event (GstMatroskaDemuxH265 * demux,
           G_TYPE_INT, clut[13], "clut14", G_TYPE_INT, clut[14], "clut15",
           G_TYPE_INT, clut[15], NULL);
 
-      gst_pad_push_event (stream->pad,
+      gst_matroska_demux_push_stream_event (demux, stream,
           gst_event_new_custom (GST_EVENT_CUSTOM_DOWNSTREAM, s));
     }
   }
@@ -3149,6 +4290,11 @@ gst_matroska_demux_align_buffer (GstMatroskaDemuxH265 * demux,
 {
   GstMapInfo map;
 
+  /* any address will do, so don't map the sub-buffer at all (which
+   * would merge its memory if it spans several upstream buffers) */
+  if (alignment <= 1)
+    return buffer;
+
   gst_buffer_map (buffer, &map, GST_MAP_READ);
 
   if (map.size < sizeof (guintptr)) {
@@ -3181,10 +4327,52 @@ gst_matroska_demux_align_buffer (GstMatroskaDemuxH265 * demux,
   return buffer;
 }
 
+/* raises the latency we report for live streams to @latency and tells the
+ * application to reconfigure the pipeline latency */
+static void
+gst_matroska_demux_update_latency (GstMatroskaDemuxH265 * demux,
+    GstClockTime latency)
+{
+  GST_OBJECT_LOCK (demux);
+  if (latency <= demux->block_latency) {
+    GST_OBJECT_UNLOCK (demux);
+    return;
+  }
+  demux->block_latency = latency;
+  GST_OBJECT_UNLOCK (demux);
+
+  GST_DEBUG_OBJECT (demux, "block latency now %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (latency));
+  gst_element_post_message (GST_ELEMENT_CAST (demux),
+      gst_message_new_latency (GST_OBJECT_CAST (demux)));
+}
+
+/* track number, timecode and flags of a block */
+#define GST_MATROSKA_BLOCK_HEADER_MAX_SIZE  (8 + 2 + 1)
+
+/* maps the first @header_size bytes of @buf, or all of it if shorter;
+ * only the memories covering the header are merged if needed */
+static gboolean
+gst_matroska_demux_map_block_header (GstBuffer * buf, gsize header_size,
+    GstMapInfo * map)
+{
+  guint idx, length;
+  gsize skip;
+
+  header_size = MIN (header_size, gst_buffer_get_size (buf));
+  if (header_size > 0 && gst_buffer_n_memory (buf) > 1 &&
+      gst_buffer_find_memory (buf, 0, header_size, &idx, &length, &skip))
+    return gst_buffer_map_range (buf, idx, length, map, GST_MAP_READ);
+
+  return gst_buffer_map (buf, map, GST_MAP_READ);
+}
+
+/* @block, if not NULL, is the payload of the SimpleBlock whose prefix is
+ * in @ebml, it is taken over */
 static GstFlowReturn
 gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
-    demux, GstEbmlRead * ebml, guint64 cluster_time, guint64 cluster_offset,
-    gboolean is_simpleblock)
+    demux, GstEbmlRead * ebml, GstBuffer * block, guint64 cluster_time,
+    guint64 cluster_offset, gboolean is_simpleblock)
 {
   GstMatroskaTrackContext *stream = NULL;
   GstFlowReturn ret = GST_FLOW_OK;
@@ -3227,15 +4415,22 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
           gst_buffer_unref (buf);
           buf = NULL;
         }
-        if ((ret = gst_ebml_read_buffer (ebml, &id, &buf)) != GST_FLOW_OK)
+        if (block) {
+          buf = block;
+          block = NULL;
+        } else if ((ret = gst_ebml_read_buffer (ebml, &id, &buf)) !=
+            GST_FLOW_OK)
           break;
 
-        gst_buffer_map (buf, &map, GST_MAP_READ);
+        /* the frames are referenced as sub-buffers, so only the header
+         * has to be mapped unless there are lace sizes to parse */
+        gst_matroska_demux_map_block_header (buf,
+            GST_MATROSKA_BLOCK_HEADER_MAX_SIZE, &map);
         data = map.data;
-        size = map.size;
+        size = gst_buffer_get_size (buf);
 
         /* first byte(s): blocknum */
-        if ((n = gst_matroska_ebmlnum_uint (data, size, &num)) < 0)
+        if ((n = gst_ebml_read_vint (data, size, &num)) < 0)
           goto data_error;
         data += n;
         size -= n;
@@ -3282,6 +4477,13 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
           case 0x3:            /* EBML lacing */
             if (size == 0)
               goto invalid_lacing;
+            if (map.size < gst_buffer_get_size (buf)) {
+              gsize pos = data - map.data;
+
+              gst_buffer_unmap (buf, &map);
+              gst_buffer_map (buf, &map, GST_MAP_READ);
+              data = map.data + pos;
+            }
             laces = GST_READ_UINT8 (data) + 1;
             data += 1;
             size -= 1;
@@ -3316,7 +4518,7 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
               case 0x3:        /* EBML lacing */  {
                 guint total;
 
-                if ((n = gst_matroska_ebmlnum_uint (data, size, &num)) < 0)
+                if ((n = gst_ebml_read_vint (data, size, &num)) < 0)
                   goto data_error;
                 data += n;
                 size -= n;
@@ -3325,7 +4527,7 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
                   gint64 snum;
                   gint r;
 
-                  if ((r = gst_matroska_ebmlnum_sint (data, size, &snum)) < 0)
+                  if ((r = gst_ebml_read_svint (data, size, &snum)) < 0)
                     goto data_error;
                   data += r;
                   size -= r;
@@ -3512,6 +4714,10 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
     }
     /* else duration is diff between timecode of this and next block */
 
+    /* the first lace is only output once the whole block arrived */
+    if (demux->streaming && laces > 1 && duration)
+      gst_matroska_demux_update_latency (demux, duration - duration / laces);
+
     /* For SimpleBlock, look at the keyframe bit in flags. Otherwise,
        a ReferenceBlock implies that this is not a keyframe. In either
        case, it only makes sense for video streams. */
@@ -3531,6 +4737,17 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
       goto done;
     }
 
+    if ((demux->common.segment.flags & GST_SEGMENT_FLAG_SKIP) &&
+        stream->type == GST_MATROSKA_TRACK_TYPE_VIDEO) {
+      if (delta_unit) {
+        GST_LOG_OBJECT (demux, "skipping delta unit in trick mode");
+        goto done;
+      }
+      /* after this keyframe, continue with the next index entry */
+      if (!demux->streaming && demux->seek_index)
+        demux->trick_jump = TRUE;
+    }
+
     for (n = 0; n < laces; n++) {
       GstBuffer *sub;
 
@@ -3547,11 +4764,15 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
           stream->index_table && demux->common.segment.rate > 0.0) {
         GstMatroskaTrackVideoContext *videocontext =
             (GstMatroskaTrackVideoContext *) stream;
+        GstMatroskaIndexTable *index_table;
         GstClockTime earliest_time;
         GstClockTime earliest_stream_time;
 
+        /* a seek may merge lazily loaded Cues meanwhile, the table read
+         * here stays valid until the seek takes the stream lock */
         GST_OBJECT_LOCK (demux);
         earliest_time = videocontext->earliest_time;
+        index_table = stream->index_table;
         GST_OBJECT_UNLOCK (demux);
         earliest_stream_time = gst_segment_to_position (&demux->common.segment,
             GST_FORMAT_TIME, earliest_time);
@@ -3560,17 +4781,14 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
             GST_CLOCK_TIME_IS_VALID (earliest_stream_time) &&
             lace_time <= earliest_stream_time) {
           /* find index entry (keyframe) <= earliest_stream_time */
-          GstMatroskaIndex *entry =
-              gst_util_array_binary_search (stream->index_table->data,
-              stream->index_table->len, sizeof (GstMatroskaIndex),
-              (GCompareDataFunc) gst_matroska_index_seek_find,
-              GST_SEARCH_MODE_BEFORE, &earliest_stream_time, NULL);
+          GstMatroskaIndex entry;
 
           /* if that entry (keyframe) is after the current the current
              buffer, we can skip pushing (and thus decoding) all
              buffers until that keyframe. */
-          if (entry && GST_CLOCK_TIME_IS_VALID (entry->time) &&
-              entry->time > lace_time) {
+          if (index_table && gst_matroska_index_table_search (index_table,
+                  earliest_stream_time, FALSE, &entry) >= 0 &&
+              entry.time > lace_time) {
             GST_LOG_OBJECT (demux, "Skipping lace before late keyframe");
             stream->set_discont = TRUE;
             goto next_lace;
@@ -3768,7 +4986,7 @@ gst_matroska_demux_parse_blockgroup_or_simpleblock (GstMatroskaDemuxH265 *
           stream->pos += GST_BUFFER_DURATION (sub);
       }
 
-      ret = gst_pad_push (stream->pad, sub);
+      ret = gst_matroska_demux_push_buffer (demux, stream, sub);
 
       if (demux->common.segment.rate < 0) {
         if (lace_time > demux->common.segment.stop && ret == GST_FLOW_EOS) {
@@ -3796,6 +5014,8 @@ done:
     gst_buffer_unmap (buf, &map);
     gst_buffer_unref (buf);
   }
+  if (block)
+    gst_buffer_unref (block);
   g_free (lace_size);
 
   return ret;
@@ -3980,9 +5200,7 @@ gst_matroska_demux_parse_contents_seekentry (GstMatroskaDemuxH265 * demux,
       guint64 pos = seek_pos + demux->common.ebml_segment_start;
 
       GST_LOG_OBJECT (demux, "Cluster position");
-      if (G_UNLIKELY (!demux->clusters))
-        demux->clusters = g_array_sized_new (TRUE, TRUE, sizeof (guint64), 100);
-      g_array_append_val (demux->clusters, pos);
+      gst_matroska_demux_add_cluster (demux, pos, GST_CLOCK_TIME_NONE);
       break;
     }
 
@@ -4034,10 +5252,6 @@ gst_matroska_demux_parse_contents (GstMatroskaDemuxH265 * demux,
 
   DEBUG_ELEMENT_STOP (demux, ebml, "SeekHead", ret);
 
-  /* Sort clusters by position for easier searching */
-  if (demux->clusters)
-    g_array_sort (demux->clusters, (GCompareFunc) gst_matroska_cluster_compare);
-
   return ret;
 }
 
@@ -4086,7 +5300,8 @@ gst_matroska_demux_check_parse_error (GstMatroskaDemuxH265 * demux)
      * search for cluster mark following current pos */
     pos = demux->common.offset;
     GST_WARNING_OBJECT (demux, "parse error, looking for next cluster");
-    if (gst_matroska_demux_search_cluster (demux, &pos) != GST_FLOW_OK) {
+    if (gst_matroska_demux_search_cluster (demux, &pos,
+            demux->cluster_time) != GST_FLOW_OK) {
       /* did not work, give up */
       return TRUE;
     } else {
@@ -4159,6 +5374,38 @@ exit:
   return ret;
 }
 
+/* push mode version of gst_matroska_demux_take() for a SimpleBlock:
+ * @ebml only gets the @prefix bytes (id and size), the payload is returned
+ * in @block as it came in from upstream, without merging the input buffers
+ * it is spread over */
+static inline GstFlowReturn
+gst_matroska_demux_take_block (GstMatroskaDemuxH265 * demux, guint64 bytes,
+    guint prefix, GstEbmlRead * ebml, GstBuffer ** block)
+{
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  GST_LOG_OBJECT (demux, "taking %" G_GUINT64_FORMAT " bytes of block",
+      bytes);
+  ret = gst_matroska_demux_check_read_size (demux, bytes);
+  if (G_UNLIKELY (ret != GST_FLOW_OK))
+    return GST_FLOW_ERROR;
+  if (gst_adapter_available (demux->common.adapter) < bytes)
+    return GST_FLOW_EOS;
+
+  buffer = gst_adapter_take_buffer (demux->common.adapter, prefix);
+  gst_ebml_read_init (ebml, GST_ELEMENT_CAST (demux), buffer,
+      demux->common.offset);
+  if (bytes > prefix)
+    *block = gst_adapter_take_buffer_fast (demux->common.adapter,
+        bytes - prefix);
+  else
+    *block = gst_buffer_new ();
+  demux->common.offset += bytes;
+
+  return GST_FLOW_OK;
+}
+
 static void
 gst_matroska_demux_check_seekability (GstMatroskaDemuxH265 * demux)
 {
@@ -4298,6 +5545,8 @@ gst_matroska_demux_parse_id (GstMatroskaDemuxH265 * demux, guint32 id,
            * after the segment ID/length */
           demux->common.ebml_segment_start = demux->common.offset;
           demux->common.state = GST_MATROSKA_READ_STATE_HEADER;
+          if (demux->sidecar && !demux->common.index_parsed)
+            gst_matroska_demux_load_sidecar (demux);
           break;
         default:
           GST_WARNING_OBJECT (demux,
@@ -4348,6 +5597,14 @@ gst_matroska_demux_parse_id (GstMatroskaDemuxH265 * demux, guint32 id,
                   == GST_MATROSKA_READ_STATE_HEADER)) {
             demux->common.state = GST_MATROSKA_READ_STATE_DATA;
             demux->first_cluster_offset = demux->common.offset;
+            if (demux->sidecar && demux->sidecar_index_len > 0
+                && !demux->common.index)
+              gst_matroska_demux_install_sidecar_index (demux);
+            /* without Cues, build an index while playing */
+            if (!demux->streaming && !demux->common.index
+                && !gst_matroska_read_common_index_is_deferred (&demux->common)
+                && demux->build_index)
+              gst_matroska_demux_start_index_builder (demux);
             GST_DEBUG_OBJECT (demux, "signaling no more pads");
             gst_element_no_more_pads (GST_ELEMENT (demux));
             /* send initial segment - we wait till we know the first
@@ -4367,6 +5624,9 @@ gst_matroska_demux_parse_id (GstMatroskaDemuxH265 * demux, guint32 id,
           /* record next cluster for recovery */
           if (read != G_MAXUINT64)
             demux->next_cluster_offset = demux->cluster_offset + read;
+          /* and read ahead up to its end */
+          demux->common.read_ahead_end = (read != G_MAXUINT64) ?
+              demux->cluster_offset + read : G_MAXUINT64;
           /* eat cluster prefix */
           gst_matroska_demux_flush (demux, needed);
           break;
@@ -4379,6 +5639,11 @@ gst_matroska_demux_parse_id (GstMatroskaDemuxH265 * demux, guint32 id,
             goto parse_failed;
           GST_DEBUG_OBJECT (demux, "ClusterTimeCode: %" G_GUINT64_FORMAT, num);
           demux->cluster_time = num;
+          /* index clusters as we go for faster seeking in files without
+           * Cues */
+          if (!demux->streaming)
+            gst_matroska_demux_add_cluster (demux, demux->cluster_offset,
+                num * demux->common.time_scale);
 #if 0
           if (demux->common.element_index) {
             if (demux->common.element_index_writer_id == -1)
@@ -4404,19 +5669,29 @@ gst_matroska_demux_parse_id (GstMatroskaDemuxH265 * demux, guint32 id,
           DEBUG_ELEMENT_START (demux, &ebml, "BlockGroup");
           if ((ret = gst_ebml_read_master (&ebml, &id)) == GST_FLOW_OK) {
             ret = gst_matroska_demux_parse_blockgroup_or_simpleblock (demux,
-                &ebml, demux->cluster_time, demux->cluster_offset, FALSE);
+                &ebml, NULL, demux->cluster_time, demux->cluster_offset,
+                FALSE);
           }
           DEBUG_ELEMENT_STOP (demux, &ebml, "BlockGroup", ret);
           break;
         case GST_MATROSKA_ID_SIMPLEBLOCK:
+        {
+          GstBuffer *block = NULL;
+
           if (!gst_matroska_demux_seek_block (demux))
             goto skip;
-          GST_READ_CHECK (gst_matroska_demux_take (demux, read, &ebml));
+          if (demux->streaming) {
+            GST_READ_CHECK (gst_matroska_demux_take_block (demux, read,
+                    needed, &ebml, &block));
+          } else {
+            GST_READ_CHECK (gst_matroska_demux_take (demux, read, &ebml));
+          }
           DEBUG_ELEMENT_START (demux, &ebml, "SimpleBlock");
           ret = gst_matroska_demux_parse_blockgroup_or_simpleblock (demux,
-              &ebml, demux->cluster_time, demux->cluster_offset, TRUE);
+              &ebml, block, demux->cluster_time, demux->cluster_offset, TRUE);
           DEBUG_ELEMENT_STOP (demux, &ebml, "SimpleBlock", ret);
           break;
+        }
         case GST_MATROSKA_ID_ATTACHMENTS:
           if (!demux->common.attachments_parsed) {
             GST_READ_CHECK (gst_matroska_demux_take (demux, read, &ebml));
@@ -4453,6 +5728,13 @@ gst_matroska_demux_parse_id (GstMatroskaDemuxH265 * demux, guint32 id,
             GST_READ_CHECK (gst_matroska_demux_flush (demux, read));
             break;
           }
+          if (!demux->streaming && demux->lazy_index
+              && length != G_MAXUINT64) {
+            gst_matroska_read_common_defer_index (&demux->common,
+                demux->common.offset + needed, length);
+            GST_READ_CHECK (gst_matroska_demux_flush (demux, read));
+            break;
+          }
           GST_READ_CHECK (gst_matroska_demux_take (demux, read, &ebml));
           ret = gst_matroska_read_common_parse_index (&demux->common, &ebml);
           /* only push based; delayed index building */
@@ -4580,6 +5862,13 @@ gst_matroska_demux_loop (GstPad * pad)
   if (ret != GST_FLOW_OK)
     goto pause;
 
+  if (G_UNLIKELY (demux->trick_jump)) {
+    demux->trick_jump = FALSE;
+    ret = gst_matroska_demux_trick_mode_jump (demux);
+    if (ret == GST_FLOW_EOS)
+      goto eos;
+  }
+
   /* check if we're at the end of a configured segment */
   if (G_LIKELY (demux->common.src->len)) {
     guint i;
@@ -4866,6 +6155,15 @@ gst_matroska_demux_handle_sink_event (GstPad * pad, GstObject * parent,
       GST_OBJECT_UNLOCK (demux);
       /* fall-through */
     }
+    case GST_EVENT_FLUSH_START:
+      /* the output queues have to be flushed as well */
+      if (demux->common.num_streams > 0 && ((GstMatroskaTrackContext *)
+              g_ptr_array_index (demux->common.src, 0))->queue) {
+        gst_matroska_demux_send_event (demux, event);
+        res = TRUE;
+        break;
+      }
+      /* fall-through */
     default:
       res = gst_pad_event_default (pad, parent, event);
       break;
@@ -4904,14 +6202,45 @@ static gboolean
 gst_matroska_demux_sink_activate_mode (GstPad * sinkpad, GstObject * parent,
     GstPadMode mode, gboolean active)
 {
+  GstMatroskaDemuxH265 *demux = GST_MATROSKA_DEMUX (parent);
+  gboolean use_mmap;
+  gchar *cache_dir;
+
   switch (mode) {
     case GST_PAD_MODE_PULL:
       if (active) {
+        GST_OBJECT_LOCK (demux);
+        use_mmap = demux->use_mmap;
+        cache_dir = g_strdup (demux->index_cache_dir);
+        GST_OBJECT_UNLOCK (demux);
+        if (use_mmap)
+          demux->common.file_map = gst_file_map_new_for_pad (sinkpad);
+        if (cache_dir) {
+          demux->sidecar = gst_seek_index_new_for_pad (sinkpad, cache_dir,
+              "mkv");
+          demux->sidecar_index_len = 0;
+          demux->sidecar_clusters_len = 0;
+          g_free (cache_dir);
+        }
+        /* nothing to prefetch when the file is mapped */
+        if (!demux->common.file_map)
+          gst_matroska_read_common_start_prefetch (&demux->common);
         /* if we have a scheduler we can start the task */
         gst_pad_start_task (sinkpad, (GstTaskFunction) gst_matroska_demux_loop,
             sinkpad, NULL);
       } else {
         gst_pad_stop_task (sinkpad);
+        gst_matroska_read_common_stop_prefetch (&demux->common);
+        gst_matroska_read_common_free_cache (&demux->common);
+        if (demux->sidecar) {
+          gst_matroska_demux_save_sidecar (demux);
+          gst_seek_index_free (demux->sidecar);
+          demux->sidecar = NULL;
+        }
+        if (demux->common.file_map) {
+          gst_memory_unref (demux->common.file_map);
+          demux->common.file_map = NULL;
+        }
       }
       return TRUE;
     case GST_PAD_MODE_PUSH:
@@ -5817,6 +7146,37 @@ gst_matroska_demux_set_property (GObject * object,
       demux->max_gap_time = g_value_get_uint64 (value);
       GST_OBJECT_UNLOCK (demux);
       break;
+    case ARG_BUILD_INDEX:
+      GST_OBJECT_LOCK (demux);
+      demux->build_index = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_READ_AHEAD:
+      GST_OBJECT_LOCK (demux);
+      demux->common.read_ahead = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_USE_MMAP:
+      GST_OBJECT_LOCK (demux);
+      demux->use_mmap = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_MAX_QUEUE_TIME:
+      GST_OBJECT_LOCK (demux);
+      demux->max_queue_time = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_INDEX_CACHE_DIR:
+      GST_OBJECT_LOCK (demux);
+      g_free (demux->index_cache_dir);
+      demux->index_cache_dir = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_LAZY_INDEX:
+      GST_OBJECT_LOCK (demux);
+      demux->lazy_index = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -5838,6 +7198,36 @@ gst_matroska_demux_get_property (GObject * object,
       g_value_set_uint64 (value, demux->max_gap_time);
       GST_OBJECT_UNLOCK (demux);
       break;
+    case ARG_BUILD_INDEX:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_boolean (value, demux->build_index);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_READ_AHEAD:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->common.read_ahead);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_USE_MMAP:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_boolean (value, demux->use_mmap);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_MAX_QUEUE_TIME:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->max_queue_time);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_INDEX_CACHE_DIR:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_string (value, demux->index_cache_dir);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_LAZY_INDEX:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_boolean (value, demux->lazy_index);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -28,6 +28,7 @@
 #include "ebml-read.h"
 #include "matroska-ids.h"
 #include "matroska-read-common.h"
+#include "../../common/seek-index.h"
 
 G_BEGIN_DECLS
 
@@ -42,6 +43,14 @@ G_BEGIN_DECLS
 #define GST_IS_MATROSKA_DEMUX_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_MATROSKA_DEMUX))
 
+/* position (absolute, first member so entries sort by it) and start
+ * time of a cluster, time is GST_CLOCK_TIME_NONE until the cluster
+ * has been parsed */
+typedef struct _GstMatroskaClusterEntry {
+  gint64                   pos;
+  GstClockTime             time;
+} GstMatroskaClusterEntry;
+
 typedef struct _GstMatroskaDemuxH265 {
   GstElement              parent;
 
@@ -68,7 +77,8 @@ typedef struct _GstMatroskaDemuxH265 {
   gboolean                 tracks_parsed;
   GList                   *seek_parsed;
 
-  /* cluster positions (optional) */
+  /* cluster positions from the SeekHead and the clusters seen so far,
+   * sorted by position */
   GArray                  *clusters;
 
   /* keeping track of playback position */
@@ -96,12 +106,46 @@ typedef struct _GstMatroskaDemuxH265 {
   guint32                  segment_seqnum;
 
   /* reverse playback */
-  GArray                  *seek_index;
+  GstMatroskaIndexTable   *seek_index;
   gint                     seek_entry;
 
+  /* key unit trick mode: a keyframe was pushed, continue with the next
+   * (previous for reverse playback) entry of seek_index */
+  gboolean                 trick_jump;
+
   /* gap handling */
   guint64                  max_gap_time;
 
+  /* index built in the background for files without Cues (pull mode),
+   * built_index and built_index_time are protected by the object lock */
+  gboolean                 build_index;
+  GThread                 *index_builder;
+  volatile gint            index_builder_stop;
+  GArray                  *built_index;
+  GstClockTime             built_index_time;
+
+  /* map local files in pull mode */
+  gboolean                 use_mmap;
+
+  /* only note where the Cues are and decode them as seeks need them */
+  gboolean                 lazy_index;
+
+  /* sidecar seek index of a local file in pull mode and the number of
+   * index entries and clusters that came from it */
+  gchar                   *index_cache_dir;
+  GstSeekIndex            *sidecar;
+  guint                    sidecar_index_len;
+  guint                    sidecar_clusters_len;
+
+  /* per pad output queues and push tasks, 0 = disabled */
+  guint64                  max_queue_time;
+  /* output queue the streaming thread waits on, protected by the object
+   * lock */
+  GstDataQueue            *blocked_queue;
+
+  /* added to the upstream latency when live, protected by the object lock */
+  GstClockTime             block_latency;
+
   /* for non-finalized files, with invalid segment duration */
   gboolean                 invalid_duration;
 } GstMatroskaDemuxH265;
@@ -266,3 +266,226 @@ gst_matroska_parse_flac_stream_headers (gpointer codec_data,
   }
   return list;
 }
+
+GstMatroskaIndexTable *
+gst_matroska_index_table_new (guint64 time_unit)
+{
+  GstMatroskaIndexTable *table;
+
+  table = g_new0 (GstMatroskaIndexTable, 1);
+  table->time_unit = MAX (time_unit, 1);
+  table->data = g_byte_array_new ();
+  table->skip_time = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+  table->skip_offset = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  return table;
+}
+
+/* @entries must be sorted by time */
+GstMatroskaIndexTable *
+gst_matroska_index_table_new_from_array (GArray * entries, guint64 time_unit)
+{
+  GstMatroskaIndexTable *table;
+  guint i;
+
+  table = gst_matroska_index_table_new (time_unit);
+  for (i = 0; i < entries->len; i++)
+    gst_matroska_index_table_append (table,
+        &g_array_index (entries, GstMatroskaIndex, i));
+
+  return table;
+}
+
+void
+gst_matroska_index_table_free (GstMatroskaIndexTable * table)
+{
+  if (table == NULL)
+    return;
+
+  g_byte_array_free (table->data, TRUE);
+  g_array_free (table->skip_time, TRUE);
+  g_array_free (table->skip_offset, TRUE);
+  g_free (table);
+}
+
+static void
+gst_matroska_index_table_put_varint (GByteArray * data, guint64 v)
+{
+  guint8 buf[10];
+  guint n = 0;
+
+  do {
+    buf[n] = v & 0x7f;
+    v >>= 7;
+    if (v)
+      buf[n] |= 0x80;
+    n++;
+  } while (v);
+
+  g_byte_array_append (data, buf, n);
+}
+
+static guint64
+gst_matroska_index_table_get_varint (const guint8 * data, guint * offset)
+{
+  guint64 v = 0;
+  guint shift = 0;
+  guint8 b;
+
+  do {
+    b = data[(*offset)++];
+    v |= (guint64) (b & 0x7f) << shift;
+    shift += 7;
+  } while ((b & 0x80) && shift < 64);
+
+  return v;
+}
+
+void
+gst_matroska_index_table_append (GstMatroskaIndexTable * table,
+    const GstMatroskaIndex * entry)
+{
+  GstMatroskaIndex base = { 0, };
+  guint64 dtime;
+  gint64 dpos;
+
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (entry->time));
+  g_return_if_fail (table->len == 0 || entry->time >= table->last.time);
+
+  if (table->len % GST_MATROSKA_INDEX_SKIP == 0) {
+    guint32 offset = table->data->len;
+
+    g_array_append_val (table->skip_time, entry->time);
+    g_array_append_val (table->skip_offset, offset);
+  } else {
+    base = table->last;
+  }
+
+  /* the lowest bit tells whether the time is in time units */
+  dtime = entry->time - base.time;
+  if (dtime % table->time_unit == 0)
+    gst_matroska_index_table_put_varint (table->data,
+        (dtime / table->time_unit) << 1);
+  else
+    gst_matroska_index_table_put_varint (table->data, (dtime << 1) | 1);
+
+  /* entries of different tracks at the same time needn't be ordered by
+   * position, so that difference is zigzag coded */
+  dpos = (gint64) (entry->pos - base.pos);
+  gst_matroska_index_table_put_varint (table->data,
+      dpos < 0 ? ~((guint64) dpos << 1) : (guint64) dpos << 1);
+
+  gst_matroska_index_table_put_varint (table->data, entry->track);
+  gst_matroska_index_table_put_varint (table->data, entry->block);
+
+  table->last = *entry;
+  table->len++;
+}
+
+/* decodes entry @i at @offset; @entry holds entry @i - 1 unless @i starts
+ * a run */
+static void
+gst_matroska_index_table_decode (GstMatroskaIndexTable * table, guint i,
+    guint * offset, GstMatroskaIndex * entry)
+{
+  const guint8 *data = table->data->data;
+  guint64 v;
+
+  if (i % GST_MATROSKA_INDEX_SKIP == 0)
+    memset (entry, 0, sizeof (GstMatroskaIndex));
+
+  v = gst_matroska_index_table_get_varint (data, offset);
+  entry->time += (v & 1) ? v >> 1 : (v >> 1) * table->time_unit;
+  v = gst_matroska_index_table_get_varint (data, offset);
+  entry->pos += (v & 1) ? ~(v >> 1) : v >> 1;
+  entry->track = gst_matroska_index_table_get_varint (data, offset);
+  entry->block = gst_matroska_index_table_get_varint (data, offset);
+}
+
+gboolean
+gst_matroska_index_table_get (GstMatroskaIndexTable * table, guint i,
+    GstMatroskaIndex * entry)
+{
+  guint run, j, offset;
+
+  if (i >= table->len)
+    return FALSE;
+
+  run = i / GST_MATROSKA_INDEX_SKIP;
+  offset = g_array_index (table->skip_offset, guint32, run);
+  for (j = run * GST_MATROSKA_INDEX_SKIP; j <= i; j++)
+    gst_matroska_index_table_decode (table, j, &offset, entry);
+
+  return TRUE;
+}
+
+/* returns the index of the last entry at or before @time, or with @after
+ * the first one at or after it, and -1 if there is none */
+gint
+gst_matroska_index_table_search (GstMatroskaIndexTable * table,
+    GstClockTime time, gboolean after, GstMatroskaIndex * entry)
+{
+  GstMatroskaIndex cur;
+  guint lo, hi, mid, i, offset;
+  gint found = -1;
+
+  if (table->len == 0)
+    return -1;
+
+  /* count the runs starting before @time, or at it when looking back */
+  lo = 0;
+  hi = table->skip_time->len;
+  while (lo < hi) {
+    GstClockTime t;
+
+    mid = (lo + hi) / 2;
+    t = g_array_index (table->skip_time, GstClockTime, mid);
+    if (t < time || (!after && t == time))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0) {
+    if (!after)
+      return -1;
+  } else {
+    lo--;
+  }
+
+  offset = g_array_index (table->skip_offset, guint32, lo);
+  for (i = lo * GST_MATROSKA_INDEX_SKIP; i < table->len; i++) {
+    gst_matroska_index_table_decode (table, i, &offset, &cur);
+    if (after) {
+      if (cur.time >= time) {
+        found = i;
+        *entry = cur;
+        break;
+      }
+    } else {
+      if (cur.time > time)
+        break;
+      found = i;
+      *entry = cur;
+    }
+  }
+
+  return found;
+}
+
+GArray *
+gst_matroska_index_table_to_array (GstMatroskaIndexTable * table)
+{
+  GstMatroskaIndex entry;
+  GArray *entries;
+  guint i, offset = 0;
+
+  entries = g_array_sized_new (FALSE, FALSE, sizeof (GstMatroskaIndex),
+      table->len);
+  for (i = 0; i < table->len; i++) {
+    gst_matroska_index_table_decode (table, i, &offset, &entry);
+    g_array_append_val (entries, entry);
+  }
+
+  return entries;
+}
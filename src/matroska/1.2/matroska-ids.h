@@ -23,6 +23,7 @@
 #define __GST_MATROSKA_IDS_H__
 
 #include <gst/gst.h>
+#include <gst/base/gstdataqueue.h>
 
 #include "ebml-ids.h"
 
@@ -490,6 +491,7 @@ typedef enum {
 
 
 typedef struct _GstMatroskaTrackContext GstMatroskaTrackContext;
+typedef struct _GstMatroskaIndexTable GstMatroskaIndexTable;
 
 /* TODO: check if all fields are used */
 struct _GstMatroskaTrackContext {
@@ -502,7 +504,7 @@ struct _GstMatroskaTrackContext {
   gint64                   from_offset;
   gint64                   to_offset;
 
-  GArray       *index_table;
+  GstMatroskaIndexTable *index_table;
 
   gint          index_writer_id;
 
@@ -551,6 +553,13 @@ struct _GstMatroskaTrackContext {
 
   /* any alignment we need our output buffers to have */
   gint          alignment;
+
+  /* Output queue pushed from a task of the pad, used by the demuxer;
+   * queue_flow is the last flow return of the task, protected by the
+   * object lock of the pad */
+  GstDataQueue *queue;
+  GstClockTime  queue_last_ts;
+  GstFlowReturn queue_flow;
 };
 
 typedef struct _GstMatroskaTrackVideoContext {
@@ -593,6 +602,28 @@ typedef struct _GstMatroskaIndex {
   guint32        block;    /* number of the block in the cluster */
 } GstMatroskaIndex;
 
+/* Index entries ordered by time, stored compactly for long recordings.
+ * Each entry is coded as varints of its differences to the previous one,
+ * times in units of the segment's timecode scale where they fit. Every
+ * GST_MATROSKA_INDEX_SKIP entries the coding restarts from zero, and the
+ * time and byte offset of that entry go into the skip table, so a lookup
+ * is a binary search of the skip table and decoding at most one run. */
+#define GST_MATROSKA_INDEX_SKIP 32
+
+struct _GstMatroskaIndexTable {
+  guint          len;
+  guint64        time_unit;
+
+  GByteArray    *data;
+
+  /* skip table, one entry per run */
+  GArray        *skip_time;    /* GstClockTime */
+  GArray        *skip_offset;  /* guint32, into data */
+
+  /* the last entry appended, the base of the next one */
+  GstMatroskaIndex last;
+};
+
 typedef struct _Wavpack4Header {
   guchar  ck_id [4];     /* "wvpk"                                         */
   guint32 ck_size;       /* size of entire frame (minus 8, of course)      */
@@ -626,6 +657,12 @@ typedef struct _GstMatroskaTrackEncoding {
   guint   comp_algo : 2;
   guint8 *comp_settings;
   guint   comp_settings_length;
+
+  /* decompressor state kept between blocks (the shared memory with the
+   * stripped bytes for header stripping) and the largest decompressed
+   * size so far */
+  gpointer comp_context;
+  guint   comp_size_hint;
 } GstMatroskaTrackEncoding;
 
 gboolean gst_matroska_track_init_video_context    (GstMatroskaTrackContext ** p_context);
@@ -643,4 +680,16 @@ GstBufferList * gst_matroska_parse_speex_stream_headers (gpointer codec_data,
 GstBufferList * gst_matroska_parse_flac_stream_headers  (gpointer codec_data,
                                                          gsize codec_data_size);
 
+GstMatroskaIndexTable * gst_matroska_index_table_new (guint64 time_unit);
+GstMatroskaIndexTable * gst_matroska_index_table_new_from_array (
+    GArray * entries, guint64 time_unit);
+void gst_matroska_index_table_free (GstMatroskaIndexTable * table);
+void gst_matroska_index_table_append (GstMatroskaIndexTable * table,
+    const GstMatroskaIndex * entry);
+gboolean gst_matroska_index_table_get (GstMatroskaIndexTable * table,
+    guint i, GstMatroskaIndex * entry);
+gint gst_matroska_index_table_search (GstMatroskaIndexTable * table,
+    GstClockTime time, gboolean after, GstMatroskaIndex * entry);
+GArray * gst_matroska_index_table_to_array (GstMatroskaIndexTable * table);
+
 #endif /* __GST_MATROSKA_IDS_H__ */
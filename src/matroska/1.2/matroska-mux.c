@@ -68,13 +68,33 @@ enum
   ARG_WRITING_APP,
   ARG_DOCTYPE_VERSION,
   ARG_MIN_INDEX_INTERVAL,
-  ARG_STREAMABLE
+  ARG_STREAMABLE,
+  ARG_MIN_CLUSTER_DURATION,
+  ARG_MAX_CLUSTER_DURATION,
+  ARG_INDEX_FLUSH_INTERVAL,
+  ARG_MAX_INDEX_ENTRIES,
+  ARG_BUFFER_LIST
 };
 
 #define  DEFAULT_DOCTYPE_VERSION         2
 #define  DEFAULT_WRITING_APP             "GStreamer Matroska muxer"
 #define  DEFAULT_MIN_INDEX_INTERVAL      0
 #define  DEFAULT_STREAMABLE              FALSE
+#define  DEFAULT_MIN_CLUSTER_DURATION    0
+#define  DEFAULT_MAX_CLUSTER_DURATION    0
+#define  DEFAULT_INDEX_FLUSH_INTERVAL    0
+#define  DEFAULT_MAX_INDEX_ENTRIES       0
+#define  DEFAULT_BUFFER_LIST             FALSE
+
+/* index entries that fit into the reserved region if the maximum number of
+ * entries isn't limited */
+#define GST_MATROSKA_MUX_RESERVED_INDEX_ENTRIES 8192
+
+/* largest CuePoint written by gst_matroska_mux_write_cues: 8 byte sizes for
+ * the masters and up to a 2 byte track number */
+#define GST_MATROSKA_MUX_CUEPOINT_MAX_SIZE 42
+/* Cues ID and size, and the Void header after the Cues */
+#define GST_MATROSKA_MUX_CUES_OVERHEAD (12 + 9)
 
 /* WAVEFORMATEX is gst_riff_strf_auds + an extra guint16 extension size */
 #define WAVEFORMATEX_SIZE  (2 + sizeof (gst_riff_strf_auds))
@@ -103,6 +123,8 @@ static GstStaticPadTemplate videosink_templ =
         COMMON_VIDEO_CAPS "; "
         "video/x-h264, stream-format=avc, alignment=au, "
         COMMON_VIDEO_CAPS "; "
+        "video/x-h265, stream-format = (string) { hvc1, hev1 }, "
+        "alignment=au, " COMMON_VIDEO_CAPS "; "
         "video/x-divx, "
         COMMON_VIDEO_CAPS "; "
         "video/x-huffyuv, "
@@ -264,7 +286,7 @@ gst_matroska_mux_get_type (void)
     const GInterfaceInfo iface_info = { NULL };
 
     object_type = g_type_register_static (GST_TYPE_ELEMENT,
-        "GstMatroskaMux", &object_info, (GTypeFlags) 0);
+        "GstMatroskaMuxH265", &object_info, (GTypeFlags) 0);
 
     g_type_add_interface_static (object_type, GST_TYPE_TAG_SETTER, &iface_info);
     g_type_add_interface_static (object_type, GST_TYPE_TOC_SETTER, &iface_info);
@@ -323,6 +345,43 @@ gst_matroska_mux_class_init (GstMatroskaMuxClass * klass)
           "to be streamed and hence no indexes written or duration written.",
           DEFAULT_STREAMABLE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, ARG_MIN_CLUSTER_DURATION,
+      g_param_spec_int64 ("min-cluster-duration", "Minimum cluster duration",
+          "A video keyframe only starts a new cluster once the current one "
+          "is at least this long (in nanoseconds).",
+          0, G_MAXINT64, DEFAULT_MIN_CLUSTER_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, ARG_MAX_CLUSTER_DURATION,
+      g_param_spec_int64 ("max-cluster-duration", "Maximum cluster duration",
+          "Start a new cluster after this long (in nanoseconds) even if "
+          "there was no video keyframe, 0 to only split when the relative "
+          "block timestamps would overflow.",
+          0, G_MAXINT64, DEFAULT_MAX_CLUSTER_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, ARG_INDEX_FLUSH_INTERVAL,
+      g_param_spec_int64 ("index-flush-interval", "Index flush interval",
+          "If not 0 and the output is seekable, space for the index is "
+          "reserved in front of the clusters and the index is rewritten "
+          "there this often (in nanoseconds), so files stay seekable if "
+          "recording is interrupted.",
+          0, G_MAXINT64, DEFAULT_INDEX_FLUSH_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, ARG_MAX_INDEX_ENTRIES,
+      g_param_spec_uint ("max-index-entries", "Maximum index entries",
+          "Maximum number of index entries kept, every other entry is "
+          "dropped when it is reached (0 = unlimited, or "
+          G_STRINGIFY (GST_MATROSKA_MUX_RESERVED_INDEX_ENTRIES)
+          " with index-flush-interval, which fixes it when the recording "
+          "starts).",
+          0, G_MAXUINT, DEFAULT_MAX_INDEX_ENTRIES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, ARG_BUFFER_LIST,
+      g_param_spec_boolean ("buffer-list", "Buffer list",
+          "Collect each cluster and push it as one buffer list once it is "
+          "complete, with its size filled in, instead of pushing every block "
+          "right away. Memory use and, for live output, latency depend on "
+          "the cluster duration.",
+          DEFAULT_BUFFER_LIST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_matroska_mux_change_state);
@@ -362,7 +421,8 @@ gst_matroskamux_pad_get_type (void)
 
   if (G_UNLIKELY (type == 0)) {
     type = g_type_register_static_simple (GST_TYPE_PAD,
-        g_intern_static_string ("GstMatroskamuxPad"), sizeof (GstPadClass),
+        g_intern_static_string ("GstMatroskamuxPadH265"),
+        sizeof (GstPadClass),
         (GClassInitFunc) gst_matroskamux_pad_class_init,
         sizeof (GstMatroskamuxPad), NULL, 0);
   }
@@ -461,6 +521,11 @@ gst_matroska_mux_init (GstMatroskaMux * mux, gpointer g_class)
   mux->writing_app = g_strdup (DEFAULT_WRITING_APP);
   mux->min_index_interval = DEFAULT_MIN_INDEX_INTERVAL;
   mux->streamable = DEFAULT_STREAMABLE;
+  mux->min_cluster_duration = DEFAULT_MIN_CLUSTER_DURATION;
+  mux->max_cluster_duration = DEFAULT_MAX_CLUSTER_DURATION;
+  mux->index_flush_interval = DEFAULT_INDEX_FLUSH_INTERVAL;
+  mux->max_index_entries = DEFAULT_MAX_INDEX_ENTRIES;
+  mux->buffer_list = DEFAULT_BUFFER_LIST;
 
   /* initialize internal variables */
   mux->index = NULL;
@@ -647,10 +712,15 @@ gst_matroska_mux_reset (GstElement * element)
   mux->num_indexes = 0;
   g_free (mux->index);
   mux->index = NULL;
+  mux->index_interval = 0;
+  mux->cues_pos = 0;
+  mux->cues_reserved_size = 0;
+  mux->cues_reserved_entries = 0;
+  mux->last_index_flush = 0;
 
   /* reset timers */
   mux->time_scale = GST_MSECOND;
-  mux->max_cluster_duration = G_MAXINT16 * mux->time_scale;
+  mux->max_cluster_timecode_span = G_MAXINT16 * mux->time_scale;
   mux->duration = 0;
 
   /* reset cluster */
@@ -897,6 +967,48 @@ gst_matroska_mux_set_codec_id (GstMatroskaTrackContext * context,
   context->codec_id = g_strdup (id);
 }
 
+/* check that the codec data is a complete HEVCDecoderConfigurationRecord
+ * (ISO/IEC 14496-15), which is what goes into the CodecPrivate of
+ * V_MPEGH/ISO/HEVC tracks */
+static gboolean
+gst_matroska_mux_hevc_codec_data_is_valid (GstBuffer * buf)
+{
+  GstMapInfo map;
+  gsize offset;
+  guint i, j, num_arrays, num_nals, nal_size;
+  gboolean valid = FALSE;
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READ))
+    return FALSE;
+
+  /* configurationVersion 1, the length size can't be 3 bytes */
+  if (map.size < 23 || map.data[0] != 1 || (map.data[21] & 0x03) == 2)
+    goto done;
+
+  num_arrays = map.data[22];
+  offset = 23;
+  for (i = 0; i < num_arrays; i++) {
+    if (map.size - offset < 3)
+      goto done;
+    num_nals = GST_READ_UINT16_BE (map.data + offset + 1);
+    offset += 3;
+    for (j = 0; j < num_nals; j++) {
+      if (map.size - offset < 2)
+        goto done;
+      nal_size = GST_READ_UINT16_BE (map.data + offset);
+      offset += 2;
+      if (map.size - offset < nal_size)
+        goto done;
+      offset += nal_size;
+    }
+  }
+  valid = TRUE;
+
+done:
+  gst_buffer_unmap (buf, &map);
+  return valid;
+}
+
 /**
  * gst_matroska_mux_video_pad_setcaps:
  * @pad: Pad which got the caps.
@@ -1115,6 +1227,37 @@ skip_details:
       context->codec_priv = g_malloc0 (context->codec_priv_size);
       gst_buffer_extract (codec_buf, 0, context->codec_priv, -1);
     }
+  } else if (!strcmp (mimetype, "video/x-h265")) {
+    const gchar *stream_format;
+
+    /* hvcC is mandatory, with hev1 it may still be updated in-band */
+    if (codec_buf == NULL
+        || !gst_matroska_mux_hevc_codec_data_is_valid (codec_buf)) {
+      GST_WARNING_OBJECT (mux, "missing or invalid hvcC codec_data");
+      goto refuse_caps;
+    }
+    stream_format = gst_structure_get_string (structure, "stream-format");
+
+    /* the track header with the CodecPrivate was already written and can't
+     * be rewritten without seeking, only accept new parameter sets if the
+     * stream repeats them in-band */
+    if (mux->state != GST_MATROSKA_MUX_STATE_START && context->codec_priv
+        && (context->codec_priv_size != gst_buffer_get_size (codec_buf)
+            || gst_buffer_memcmp (codec_buf, 0, context->codec_priv,
+                context->codec_priv_size) != 0)) {
+      if (g_strcmp0 (stream_format, "hev1") != 0) {
+        GST_WARNING_OBJECT (mux, "hvcC changed after the header was written");
+        goto refuse_caps;
+      }
+      GST_DEBUG_OBJECT (mux, "hvcC changed, relying on in-band parameters");
+    } else {
+      gst_matroska_mux_set_codec_id (context,
+          GST_MATROSKA_CODEC_ID_VIDEO_MPEGH_HEVC);
+      gst_matroska_mux_free_codec_priv (context);
+      context->codec_priv_size = gst_buffer_get_size (codec_buf);
+      context->codec_priv = g_malloc0 (context->codec_priv_size);
+      gst_buffer_extract (codec_buf, 0, context->codec_priv, -1);
+    }
   } else if (!strcmp (mimetype, "video/x-theora")) {
     const GValue *streamheader;
 
@@ -2816,6 +2959,163 @@ gst_matroska_mux_write_toc_entry_tags (GstMatroskaMux * mux,
 }
 #endif
 
+/* the number of index entries that is kept, 0 if unlimited; once the
+ * region for the index is reserved that is what fits in there, whatever
+ * the property is changed to */
+static guint
+gst_matroska_mux_index_capacity (GstMatroskaMux * mux)
+{
+  if (mux->cues_reserved_size > 0)
+    return mux->cues_reserved_entries;
+
+  return mux->max_index_entries;
+}
+
+/* drop every other index entry of each track and only add new entries at
+ * the resulting spacing, so a long recording still gets an index covering
+ * all of it */
+static void
+gst_matroska_mux_thin_index (GstMatroskaMux * mux)
+{
+  guint *count;
+  guint16 max_track = 0;
+  guint n, kept = 0, num_tracks = 0;
+
+  for (n = 0; n < mux->num_indexes; n++)
+    max_track = MAX (max_track, mux->index[n].track);
+
+  count = g_new0 (guint, max_track + 1);
+  for (n = 0; n < mux->num_indexes; n++) {
+    GstMatroskaIndex *idx = &mux->index[n];
+
+    if (count[idx->track] == 0)
+      num_tracks++;
+    if (count[idx->track]++ % 2 == 0)
+      mux->index[kept++] = *idx;
+  }
+  g_free (count);
+
+  if (kept > 0 && mux->index[kept - 1].time > mux->index[0].time) {
+    mux->index_interval = MAX (mux->index_interval,
+        (GstClockTimeDiff) gst_util_uint64_scale (mux->index[kept - 1].time -
+            mux->index[0].time, num_tracks, kept));
+  }
+
+  GST_DEBUG_OBJECT (mux, "thinned index from %u to %u entries, interval now %"
+      GST_TIME_FORMAT, mux->num_indexes, kept,
+      GST_TIME_ARGS (mux->index_interval));
+  mux->num_indexes = kept;
+}
+
+/* write the Cues element for the current index entries */
+static void
+gst_matroska_mux_write_cues (GstMatroskaMux * mux)
+{
+  GstEbmlWrite *ebml = mux->ebml_write;
+  guint n;
+  guint64 master, pointentry_master, trackpos_master;
+
+  master = gst_ebml_write_master_start (ebml, GST_MATROSKA_ID_CUES);
+
+  for (n = 0; n < mux->num_indexes; n++) {
+    GstMatroskaIndex *idx = &mux->index[n];
+
+    pointentry_master = gst_ebml_write_master_start (ebml,
+        GST_MATROSKA_ID_POINTENTRY);
+    gst_ebml_write_uint (ebml, GST_MATROSKA_ID_CUETIME,
+        idx->time / mux->time_scale);
+    trackpos_master = gst_ebml_write_master_start (ebml,
+        GST_MATROSKA_ID_CUETRACKPOSITIONS);
+    gst_ebml_write_uint (ebml, GST_MATROSKA_ID_CUETRACK, idx->track);
+    gst_ebml_write_uint (ebml, GST_MATROSKA_ID_CUECLUSTERPOSITION,
+        idx->pos - mux->segment_master);
+    gst_ebml_write_master_finish (ebml, trackpos_master);
+    gst_ebml_write_master_finish (ebml, pointentry_master);
+  }
+
+  gst_ebml_write_master_finish (ebml, master);
+}
+
+/* write the header of a Void element reaching up to @end, always with an
+ * 8 byte size so the same region can be rewritten later */
+static void
+gst_matroska_mux_write_void_header (GstEbmlWrite * ebml, guint64 end)
+{
+  guint8 *data = g_malloc (9);
+
+  data[0] = GST_EBML_ID_VOID;
+  GST_WRITE_UINT64_BE (data + 1,
+      (G_GINT64_CONSTANT (1) << 56) | (end - ebml->pos - 9));
+  gst_ebml_write_buffer (ebml, gst_buffer_new_wrapped (data, 9));
+}
+
+/* reserve the region the index is written to while recording */
+static void
+gst_matroska_mux_reserve_index (GstMatroskaMux * mux)
+{
+  GstEbmlWrite *ebml = mux->ebml_write;
+  GstBuffer *buf;
+  guint64 size;
+  guint entries;
+
+  entries = mux->max_index_entries ? mux->max_index_entries :
+      GST_MATROSKA_MUX_RESERVED_INDEX_ENTRIES;
+  size = GST_MATROSKA_MUX_CUES_OVERHEAD +
+      GST_MATROSKA_MUX_CUEPOINT_MAX_SIZE * (guint64) entries;
+
+  GST_DEBUG_OBJECT (mux, "reserving %" G_GUINT64_FORMAT " bytes for %u index "
+      "entries", size, entries);
+
+  mux->cues_pos = ebml->pos;
+  mux->cues_reserved_size = size;
+  mux->cues_reserved_entries = entries;
+  gst_matroska_mux_write_void_header (ebml, mux->cues_pos + size);
+  buf = gst_buffer_new_allocate (NULL, size - 9, NULL);
+  gst_buffer_memset (buf, 0, 0, size - 9);
+  gst_ebml_write_buffer (ebml, buf);
+}
+
+/* rewrite the index in the reserved region and point the seekhead to it */
+static void
+gst_matroska_mux_flush_index (GstMatroskaMux * mux)
+{
+  GstEbmlWrite *ebml = mux->ebml_write;
+  guint64 pos = ebml->pos;
+  guint num_indexes;
+
+  if (mux->num_indexes == 0)
+    return;
+
+  /* never write past the reserved region, that is cluster data */
+  while (GST_MATROSKA_MUX_CUES_OVERHEAD + GST_MATROSKA_MUX_CUEPOINT_MAX_SIZE *
+      (guint64) mux->num_indexes > mux->cues_reserved_size) {
+    num_indexes = mux->num_indexes;
+    gst_matroska_mux_thin_index (mux);
+    if (mux->num_indexes == num_indexes) {
+      GST_WARNING_OBJECT (mux, "%u index entries don't fit into %"
+          G_GUINT64_FORMAT " bytes, not writing them", num_indexes,
+          mux->cues_reserved_size);
+      return;
+    }
+  }
+
+  GST_DEBUG_OBJECT (mux, "writing %u index entries", mux->num_indexes);
+
+  /* see gst_matroska_mux_finish for the seekhead layout */
+  gst_ebml_replace_uint (ebml, mux->seekhead_pos + 116,
+      mux->cues_pos - mux->segment_master);
+
+  gst_ebml_write_seek (ebml, mux->cues_pos);
+  gst_ebml_write_set_cache (ebml, GST_MATROSKA_MUX_CUES_OVERHEAD +
+      GST_MATROSKA_MUX_CUEPOINT_MAX_SIZE * mux->num_indexes);
+  gst_matroska_mux_write_cues (mux);
+  /* what follows are stale entries of the previous flush */
+  gst_matroska_mux_write_void_header (ebml,
+      mux->cues_pos + mux->cues_reserved_size);
+  gst_ebml_write_flush_cache (ebml, FALSE, GST_CLOCK_TIME_NONE);
+  gst_ebml_write_seek (ebml, pos);
+}
+
 /**
  * gst_matroska_mux_finish:
  * @mux: #GstMatroskaMux
@@ -2837,31 +3137,13 @@ gst_matroska_mux_finish (GstMatroskaMux * mux)
   }
 
   /* cues */
-  if (mux->index != NULL) {
-    guint n;
-    guint64 master, pointentry_master, trackpos_master;
-
+  if (mux->cues_reserved_size > 0) {
+    gst_matroska_mux_flush_index (mux);
+  } else if (mux->index != NULL) {
     mux->cues_pos = ebml->pos;
-    gst_ebml_write_set_cache (ebml, 12 + 41 * mux->num_indexes);
-    master = gst_ebml_write_master_start (ebml, GST_MATROSKA_ID_CUES);
-
-    for (n = 0; n < mux->num_indexes; n++) {
-      GstMatroskaIndex *idx = &mux->index[n];
-
-      pointentry_master = gst_ebml_write_master_start (ebml,
-          GST_MATROSKA_ID_POINTENTRY);
-      gst_ebml_write_uint (ebml, GST_MATROSKA_ID_CUETIME,
-          idx->time / mux->time_scale);
-      trackpos_master = gst_ebml_write_master_start (ebml,
-          GST_MATROSKA_ID_CUETRACKPOSITIONS);
-      gst_ebml_write_uint (ebml, GST_MATROSKA_ID_CUETRACK, idx->track);
-      gst_ebml_write_uint (ebml, GST_MATROSKA_ID_CUECLUSTERPOSITION,
-          idx->pos - mux->segment_master);
-      gst_ebml_write_master_finish (ebml, trackpos_master);
-      gst_ebml_write_master_finish (ebml, pointentry_master);
-    }
-
-    gst_ebml_write_master_finish (ebml, master);
+    gst_ebml_write_set_cache (ebml, 12 +
+        GST_MATROSKA_MUX_CUEPOINT_MAX_SIZE * mux->num_indexes);
+    gst_matroska_mux_write_cues (mux);
     gst_ebml_write_flush_cache (ebml, FALSE, GST_CLOCK_TIME_NONE);
   }
 
@@ -3243,14 +3525,38 @@ gst_matroska_mux_write_data (GstMatroskaMux * mux, GstMatroskaPad * collect_pad,
   }
 
   if (mux->cluster) {
-    /* start a new cluster at every keyframe, at every GstForceKeyUnit event,
-     * or when we may be reaching the limit of the relative timestamp */
-    if (mux->cluster_time +
-        mux->max_cluster_duration < timestamp
-        || is_video_keyframe || mux->force_key_unit_event) {
-      if (!mux->streamable)
+    GstClockTime cluster_duration = 0;
+
+    if (timestamp > mux->cluster_time)
+      cluster_duration = timestamp - mux->cluster_time;
+
+    /* start a new cluster at every keyframe once the cluster reached the
+     * minimum duration, at every GstForceKeyUnit event, after the maximum
+     * duration or when we may be reaching the limit of the relative
+     * timestamp */
+    if (cluster_duration > mux->max_cluster_timecode_span
+        || (is_video_keyframe
+            && cluster_duration >= mux->min_cluster_duration)
+        || (mux->max_cluster_duration > 0
+            && cluster_duration >= mux->max_cluster_duration)
+        || mux->force_key_unit_event) {
+      /* a collected cluster gets its size without seeking downstream, so
+       * that works for streamable output as well */
+      if (!mux->streamable
+          || gst_ebml_write_is_pending (ebml, mux->cluster, 8))
         gst_ebml_write_master_finish (ebml, mux->cluster);
 
+      /* between clusters, update the index written so far */
+      if (mux->cues_reserved_size > 0 &&
+          GST_CLOCK_DIFF (mux->last_index_flush, timestamp) >=
+          mux->index_flush_interval) {
+        gst_matroska_mux_flush_index (mux);
+        mux->last_index_flush = timestamp;
+      }
+
+      /* the previous cluster is complete */
+      gst_ebml_write_push_list (ebml);
+
       /* Forward the GstForceKeyUnit event after finishing the cluster */
       if (mux->force_key_unit_event) {
         gst_pad_push_event (mux->srcpad, mux->force_key_unit_event);
@@ -3259,6 +3565,8 @@ gst_matroska_mux_write_data (GstMatroskaMux * mux, GstMatroskaPad * collect_pad,
 
       mux->prev_cluster_size = ebml->pos - mux->cluster_pos;
       mux->cluster_pos = ebml->pos;
+      if (mux->buffer_list)
+        gst_ebml_write_start_list (ebml);
       gst_ebml_write_set_cache (ebml, 0x20);
       mux->cluster =
           gst_ebml_write_master_start (ebml, GST_MATROSKA_ID_CLUSTER);
@@ -3266,7 +3574,10 @@ gst_matroska_mux_write_data (GstMatroskaMux * mux, GstMatroskaPad * collect_pad,
           gst_util_uint64_scale (timestamp, 1, mux->time_scale));
       GST_LOG_OBJECT (mux, "cluster timestamp %" G_GUINT64_FORMAT,
           gst_util_uint64_scale (timestamp, 1, mux->time_scale));
-      gst_ebml_write_flush_cache (ebml, TRUE, timestamp);
+      /* only clusters starting with a keyframe are sync points for
+       * clients joining a live stream */
+      gst_ebml_write_flush_cache (ebml, is_video_keyframe
+          || mux->num_v_streams == 0, timestamp);
       mux->cluster_time = timestamp;
       gst_ebml_write_uint (ebml, GST_MATROSKA_ID_PREVSIZE,
           mux->prev_cluster_size);
@@ -3275,11 +3586,14 @@ gst_matroska_mux_write_data (GstMatroskaMux * mux, GstMatroskaPad * collect_pad,
     /* first cluster */
 
     mux->cluster_pos = ebml->pos;
+    if (mux->buffer_list)
+      gst_ebml_write_start_list (ebml);
     gst_ebml_write_set_cache (ebml, 0x20);
     mux->cluster = gst_ebml_write_master_start (ebml, GST_MATROSKA_ID_CLUSTER);
     gst_ebml_write_uint (ebml, GST_MATROSKA_ID_CLUSTERTIMECODE,
         gst_util_uint64_scale (timestamp, 1, mux->time_scale));
-    gst_ebml_write_flush_cache (ebml, TRUE, timestamp);
+    gst_ebml_write_flush_cache (ebml, is_video_keyframe
+        || mux->num_v_streams == 0, timestamp);
     mux->cluster_time = timestamp;
   }
 
@@ -3307,17 +3621,25 @@ gst_matroska_mux_write_data (GstMatroskaMux * mux, GstMatroskaPad * collect_pad,
           ((collect_pad->track->type == GST_MATROSKA_TRACK_TYPE_AUDIO) &&
               (mux->num_streams == 1)))) {
     gint last_idx = -1;
+    GstClockTimeDiff interval;
+    guint capacity;
+
+    capacity = gst_matroska_mux_index_capacity (mux);
+    if (capacity > 0 && mux->num_indexes >= capacity)
+      gst_matroska_mux_thin_index (mux);
 
-    if (mux->min_index_interval != 0) {
+    interval = MAX (mux->min_index_interval, mux->index_interval);
+    if (interval != 0) {
       for (last_idx = mux->num_indexes - 1; last_idx >= 0; last_idx--) {
         if (mux->index[last_idx].track == collect_pad->track->num)
           break;
       }
     }
 
-    if (last_idx < 0 || mux->min_index_interval == 0 ||
-        (GST_CLOCK_DIFF (mux->index[last_idx].time, timestamp)
-            >= mux->min_index_interval)) {
+    if ((capacity == 0 || mux->num_indexes < capacity) &&
+        (last_idx < 0 || interval == 0 ||
+            (GST_CLOCK_DIFF (mux->index[last_idx].time, timestamp)
+                >= interval))) {
       GstMatroskaIndex *idx;
 
       if (mux->num_indexes % 32 == 0) {
@@ -3382,7 +3704,9 @@ gst_matroska_mux_write_data (GstMatroskaMux * mux, GstMatroskaPad * collect_pad,
 
     return gst_ebml_last_write_result (ebml);
   } else {
-    gst_ebml_write_set_cache (ebml, gst_buffer_get_size (buf) * 2);
+    /* only the headers go through the cache, the payload is pushed as is,
+     * so don't size the cache after the frame */
+    gst_ebml_write_set_cache (ebml, 0x40);
     /* write and call order slightly unnatural,
      * but avoids seek and minizes pushing */
     blockgroup = gst_ebml_write_master_start (ebml, GST_MATROSKA_ID_BLOCKGROUP);
@@ -3434,6 +3758,9 @@ gst_matroska_mux_handle_buffer (GstCollectPads * pads, GstCollectData * data,
     gst_ebml_start_streamheader (ebml);
     gst_matroska_mux_start (mux);
     gst_matroska_mux_stop_streamheader (mux);
+    /* not part of the stream headers */
+    if (!mux->streamable && mux->index_flush_interval > 0)
+      gst_matroska_mux_reserve_index (mux);
     mux->state = GST_MATROSKA_MUX_STATE_DATA;
   }
 
@@ -3443,6 +3770,11 @@ gst_matroska_mux_handle_buffer (GstCollectPads * pads, GstCollectData * data,
   /* if there is no best pad, we have reached EOS */
   if (best == NULL) {
     GST_DEBUG_OBJECT (mux, "No best pad finishing...");
+    if (mux->cluster && gst_ebml_write_is_pending (ebml, mux->cluster, 8)) {
+      gst_ebml_write_master_finish (ebml, mux->cluster);
+      mux->cluster = 0;
+    }
+    gst_ebml_write_push_list (ebml);
     if (!mux->streamable) {
       gst_matroska_mux_finish (mux);
     } else {
@@ -3568,6 +3900,21 @@ gst_matroska_mux_set_property (GObject * object,
     case ARG_STREAMABLE:
       mux->streamable = g_value_get_boolean (value);
       break;
+    case ARG_MIN_CLUSTER_DURATION:
+      mux->min_cluster_duration = g_value_get_int64 (value);
+      break;
+    case ARG_MAX_CLUSTER_DURATION:
+      mux->max_cluster_duration = g_value_get_int64 (value);
+      break;
+    case ARG_INDEX_FLUSH_INTERVAL:
+      mux->index_flush_interval = g_value_get_int64 (value);
+      break;
+    case ARG_MAX_INDEX_ENTRIES:
+      mux->max_index_entries = g_value_get_uint (value);
+      break;
+    case ARG_BUFFER_LIST:
+      mux->buffer_list = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -3596,8 +3943,32 @@ gst_matroska_mux_get_property (GObject * object,
     case ARG_STREAMABLE:
       g_value_set_boolean (value, mux->streamable);
       break;
+    case ARG_MIN_CLUSTER_DURATION:
+      g_value_set_int64 (value, mux->min_cluster_duration);
+      break;
+    case ARG_MAX_CLUSTER_DURATION:
+      g_value_set_int64 (value, mux->max_cluster_duration);
+      break;
+    case ARG_INDEX_FLUSH_INTERVAL:
+      g_value_set_int64 (value, mux->index_flush_interval);
+      break;
+    case ARG_MAX_INDEX_ENTRIES:
+      g_value_set_uint (value, mux->max_index_entries);
+      break;
+    case ARG_BUFFER_LIST:
+      g_value_set_boolean (value, mux->buffer_list);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
+
+gboolean
+gst_matroska_mux_plugin_init (GstPlugin * plugin)
+{
+  /* only registered under our own name, the HEVC support is what sets it
+   * apart from the system matroskamux */
+  return gst_element_register (plugin, "matroskamux-libde265",
+      GST_RANK_PRIMARY, GST_TYPE_MATROSKA_MUX);
+}
@@ -100,11 +100,26 @@ typedef struct _GstMatroskaMux {
   guint          num_indexes;
   GstClockTimeDiff min_index_interval;
   gboolean       streamable;
+  /* index kept in a reserved region while recording */
+  GstClockTimeDiff index_flush_interval;
+  guint          max_index_entries;
+  GstClockTimeDiff index_interval;
+  guint64        cues_reserved_size;
+  /* entries that fit into the reserved region */
+  guint          cues_reserved_entries;
+  GstClockTime   last_index_flush;
+
+  /* push clusters as buffer lists */
+  gboolean       buffer_list;
  
   /* timescale in the file */
   guint64        time_scale;
-  /* based on timescale, limit of nanoseconds you can have in a cluster */ 
-  guint64        max_cluster_duration;
+  /* based on timescale, limit of nanoseconds you can have in a cluster, as
+   * block timecodes are relative int16 */
+  guint64        max_cluster_timecode_span;
+  /* cluster splitting, in nanoseconds */
+  GstClockTime   min_cluster_duration;
+  GstClockTime   max_cluster_duration;
 
   /* length, position (time, ns) */
   guint64        duration;
@@ -137,6 +152,8 @@ typedef struct _GstMatroskaMuxClass {
 
 GType   gst_matroska_mux_get_type (void);
 
+gboolean gst_matroska_mux_plugin_init (GstPlugin *plugin);
+
 G_END_DECLS
 
 #endif /* __GST_MATROSKA_MUX_H__ */
@@ -81,9 +81,12 @@ enum
 {
   ARG_0,
   ARG_METADATA,
-  ARG_STREAMINFO
+  ARG_STREAMINFO,
+  ARG_PASSTHROUGH
 };
 
+#define  DEFAULT_PASSTHROUGH       FALSE
+
 static GstStaticPadTemplate sink_templ = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
@@ -125,6 +128,10 @@ static GstFlowReturn gst_matroska_parse_chain (GstPad * pad,
 static GstStateChangeReturn
 gst_matroska_parse_change_state (GstElement * element,
     GstStateChange transition);
+static void gst_matroska_parse_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_matroska_parse_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
 #if 0
 static void
 gst_matroska_parse_set_index (GstElement * element, GstIndex * index);
@@ -171,6 +178,16 @@ gst_matroska_parse_class_init (GstMatroskaParseH265Class * klass)
 
   gobject_class->finalize = gst_matroska_parse_finalize;
 
+  gobject_class->get_property = gst_matroska_parse_get_property;
+  gobject_class->set_property = gst_matroska_parse_set_property;
+
+  g_object_class_install_property (gobject_class, ARG_PASSTHROUGH,
+      g_param_spec_boolean ("passthrough", "Passthrough",
+          "Forward each Cluster of known size as a single buffer without "
+          "parsing its blocks, only the first video block is looked at to "
+          "flag clusters starting with a keyframe.", DEFAULT_PASSTHROUGH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_matroska_parse_change_state);
   gstelement_class->send_event =
@@ -226,6 +243,8 @@ gst_matroska_parse_init (GstMatroskaParseH265 * parse)
 
   parse->common.adapter = gst_adapter_new ();
 
+  parse->passthrough = DEFAULT_PASSTHROUGH;
+
   GST_OBJECT_FLAG_SET (parse, GST_ELEMENT_FLAG_INDEXABLE);
 
   /* finish off */
@@ -250,7 +269,7 @@ gst_matroska_track_free (GstMatroskaTrackContext * track)
           GstMatroskaTrackEncoding,
           i);
 
-      g_free (enc->comp_settings);
+      gst_matroska_track_encoding_clear (enc);
     }
     g_array_free (track->encodings, TRUE);
   }
@@ -259,7 +278,7 @@ gst_matroska_track_free (GstMatroskaTrackContext * track)
     gst_tag_list_unref (track->pending_tags);
 
   if (track->index_table)
-    g_array_free (track->index_table, TRUE);
+    gst_matroska_index_table_free (track->index_table);
 
   g_free (track);
 }
@@ -308,7 +327,7 @@ gst_matroska_parse_reset (GstElement * element)
 
   /* reset indexes */
   if (parse->common.index) {
-    g_array_free (parse->common.index, TRUE);
+    gst_matroska_index_table_free (parse->common.index);
     parse->common.index = NULL;
   }
 
@@ -374,10 +393,7 @@ gst_matroska_parse_reset (GstElement * element)
   }
   parse->common.global_tags = gst_tag_list_new_empty ();
 
-  if (parse->common.cached_buffer) {
-    gst_buffer_unref (parse->common.cached_buffer);
-    parse->common.cached_buffer = NULL;
-  }
+  gst_matroska_read_common_free_cache (&parse->common);
 
   if (parse->streamheader != NULL) {
     gst_buffer_unref (parse->streamheader);
@@ -1325,7 +1341,7 @@ static gboolean
 gst_matroska_parse_handle_seek_event (GstMatroskaParseH265 * parse,
     GstPad * pad, GstEvent * event)
 {
-  GstMatroskaIndex *entry = NULL;
+  GstMatroskaIndex entry;
   GstSeekFlags flags;
   GstSeekType cur_type, stop_type;
   GstFormat format;
@@ -1363,9 +1379,9 @@ gst_matroska_parse_handle_seek_event (GstMatroskaParseH265 * parse,
 
   /* check sanity before we start flushing and all that */
   GST_OBJECT_LOCK (parse);
-  if ((entry = gst_matroska_read_common_do_index_seek (&parse->common, track,
-              seeksegment.position, &parse->seek_index, &parse->seek_entry,
-              FALSE)) == NULL) {
+  if (!gst_matroska_read_common_do_index_seek (&parse->common, track,
+          seeksegment.position, &parse->seek_index, &parse->seek_entry,
+          FALSE, &entry)) {
     /* pull mode without index can scan later on */
     GST_DEBUG_OBJECT (parse, "No matching seek entry in index");
     GST_OBJECT_UNLOCK (parse);
@@ -1377,7 +1393,7 @@ gst_matroska_parse_handle_seek_event (GstMatroskaParseH265 * parse,
   /* need to seek to cluster start to pick up cluster time */
   /* upstream takes care of flushing and all that
    * ... and newsegment event handling takes care of the rest */
-  return perform_seek_to_offset (parse, entry->pos
+  return perform_seek_to_offset (parse, entry.pos
       + parse->common.ebml_segment_start);
 }
 
@@ -1556,67 +1572,6 @@ gst_matroska_parse_parse_tracks (GstMatroskaParseH265 * parse,
   return ret;
 }
 
-/*
- * Read signed/unsigned "EBML" numbers.
- * Return: number of bytes processed.
- */
-
-static gint
-gst_matroska_ebmlnum_uint (guint8 * data, guint size, guint64 * num)
-{
-  gint len_mask = 0x80, read = 1, n = 1, num_ffs = 0;
-  guint64 total;
-
-  if (size <= 0) {
-    return -1;
-  }
-
-  total = data[0];
-  while (read <= 8 && !(total & len_mask)) {
-    read++;
-    len_mask >>= 1;
-  }
-  if (read > 8)
-    return -1;
-
-  if ((total &= (len_mask - 1)) == len_mask - 1)
-    num_ffs++;
-  if (size < read)
-    return -1;
-  while (n < read) {
-    if (data[n] == 0xff)
-      num_ffs++;
-    total = (total << 8) | data[n];
-    n++;
-  }
-
-  if (read == num_ffs && total != 0)
-    *num = G_MAXUINT64;
-  else
-    *num = total;
-
-  return read;
-}
-
-static gint
-gst_matroska_ebmlnum_sint (guint8 * data, guint size, gint64 * num)
-{
-  guint64 unum;
-  gint res;
-
-  /* read as unsigned number first */
-  if ((res = gst_matroska_ebmlnum_uint (data, size, &unum)) < 0)
-    return -1;
-
-  /* make signed */
-  if (unum == G_MAXUINT64)
-    *num = G_MAXINT64;
-  else
-    *num = unum - ((1 << ((7 * res) - 1)) - 1);
-
-  return res;
-}
-
 static GstFlowReturn
 gst_matroska_parse_parse_blockgroup_or_simpleblock (GstMatroskaParseH265 *
     parse, GstEbmlRead * ebml, guint64 cluster_time, guint64 cluster_offset,
@@ -1667,7 +1622,7 @@ gst_matroska_parse_parse_blockgroup_or_simpleblock (GstMatroskaParseH265 *
         size = map.size;
 
         /* first byte(s): blocknum */
-        if ((n = gst_matroska_ebmlnum_uint (data, size, &num)) < 0)
+        if ((n = gst_ebml_read_vint (data, size, &num)) < 0)
           goto data_error;
         data += n;
         size -= n;
@@ -1748,7 +1703,7 @@ gst_matroska_parse_parse_blockgroup_or_simpleblock (GstMatroskaParseH265 *
               case 0x3:        /* EBML lacing */  {
                 guint total;
 
-                if ((n = gst_matroska_ebmlnum_uint (data, size, &num)) < 0)
+                if ((n = gst_ebml_read_vint (data, size, &num)) < 0)
                   goto data_error;
                 data += n;
                 size -= n;
@@ -1757,7 +1712,7 @@ gst_matroska_parse_parse_blockgroup_or_simpleblock (GstMatroskaParseH265 *
                   gint64 snum;
                   gint r;
 
-                  if ((r = gst_matroska_ebmlnum_sint (data, size, &snum)) < 0)
+                  if ((r = gst_ebml_read_svint (data, size, &snum)) < 0)
                     goto data_error;
                   data += r;
                   size -= r;
@@ -1937,17 +1892,14 @@ gst_matroska_parse_parse_blockgroup_or_simpleblock (GstMatroskaParseH265 *
             GST_CLOCK_TIME_IS_VALID (earliest_stream_time) &&
             lace_time <= earliest_stream_time) {
           /* find index entry (keyframe) <= earliest_stream_time */
-          GstMatroskaIndex *entry =
-              gst_util_array_binary_search (stream->index_table->data,
-              stream->index_table->len, sizeof (GstMatroskaIndex),
-              (GCompareDataFunc) gst_matroska_index_seek_find,
-              GST_SEARCH_MODE_BEFORE, &earliest_stream_time, NULL);
+          GstMatroskaIndex entry;
 
           /* if that entry (keyframe) is after the current the current
              buffer, we can skip pushing (and thus decoding) all
              buffers until that keyframe. */
-          if (entry && GST_CLOCK_TIME_IS_VALID (entry->time) &&
-              entry->time > lace_time) {
+          if (gst_matroska_index_table_search (stream->index_table,
+                  earliest_stream_time, FALSE, &entry) >= 0 &&
+              entry.time > lace_time) {
             GST_LOG_OBJECT (parse, "Skipping lace before late keyframe");
             stream->set_discont = TRUE;
             goto next_lace;
@@ -2581,6 +2533,178 @@ gst_matroska_parse_output (GstMatroskaParseH265 * parse, GstBuffer * buffer,
   return ret;
 }
 
+/* reads the id and size of the element at @offset of @buf,
+ * returns the number of header bytes or 0 if invalid or incomplete */
+static guint
+gst_matroska_parse_peek_element (GstBuffer * buf, gsize offset, guint32 * id,
+    guint64 * length)
+{
+  guint8 data[4 + 8];
+  gsize size;
+  guint id_len, i;
+  gint len;
+
+  size = gst_buffer_extract (buf, offset, data, sizeof (data));
+  if (size == 0)
+    return 0;
+  id_len = gst_ebml_vint_length (data[0]);
+  if (id_len == 0 || id_len > 4 || id_len >= size)
+    return 0;
+  *id = 0;
+  for (i = 0; i < id_len; i++)
+    *id = (*id << 8) | data[i];
+
+  len = gst_ebml_read_vint (data + id_len, size - id_len, length);
+  if (len < 0 || *length == G_MAXUINT64)
+    return 0;
+
+  return id_len + len;
+}
+
+/* returns whether the (Simple)Block of @size bytes at @offset of @buf
+ * belongs to a video track, and in @keyframe if it is a keyframe */
+static gboolean
+gst_matroska_parse_peek_video_block (GstMatroskaParseH265 * parse,
+    GstBuffer * buf, gsize offset, guint64 size, gboolean is_simpleblock,
+    gboolean * keyframe)
+{
+  GstMatroskaTrackContext *context;
+  guint8 data[8 + 3];
+  guint64 num;
+  gsize end = offset + size;
+  gint n, len;
+
+  *keyframe = TRUE;
+
+  if (!is_simpleblock) {
+    guint32 id;
+    guint64 length;
+    guint hdr;
+    gsize block = 0;
+
+    /* a ReferenceBlock makes a delta unit */
+    for (; offset < end; offset += hdr + length) {
+      if (!(hdr = gst_matroska_parse_peek_element (buf, offset, &id,
+                  &length)) || hdr > end - offset ||
+          length > end - offset - hdr)
+        return FALSE;
+      if (id == GST_MATROSKA_ID_BLOCK)
+        block = offset + hdr;
+      else if (id == GST_MATROSKA_ID_REFERENCEBLOCK)
+        *keyframe = FALSE;
+    }
+    if (block == 0)
+      return FALSE;
+    offset = block;
+  }
+
+  len = gst_buffer_extract (buf, offset, data, sizeof (data));
+  if ((n = gst_ebml_read_vint (data, len, &num)) < 0 || len < n + 3)
+    return FALSE;
+  if (is_simpleblock)
+    *keyframe = (data[n + 2] & 0x80) != 0;
+
+  n = gst_matroska_read_common_stream_from_num (&parse->common, num);
+  if (n < 0)
+    return FALSE;
+  context = g_ptr_array_index (parse->common.src, n);
+
+  return context->type == GST_MATROSKA_TRACK_TYPE_VIDEO;
+}
+
+/* looks up the timecode of the Cluster in @buf and whether it starts with
+ * a keyframe from the first video block, only the element headers are
+ * read */
+static gboolean
+gst_matroska_parse_peek_cluster (GstMatroskaParseH265 * parse,
+    GstBuffer * buf, guint prefix, guint64 * timecode)
+{
+  gsize pos, size = gst_buffer_get_size (buf);
+  gboolean keyframe, have_video = FALSE;
+  guint32 id;
+  guint64 length;
+  guint hdr, i;
+
+  *timecode = GST_CLOCK_TIME_NONE;
+
+  for (i = 0; i < parse->common.src->len; i++) {
+    GstMatroskaTrackContext *context =
+        g_ptr_array_index (parse->common.src, i);
+
+    if (context->type == GST_MATROSKA_TRACK_TYPE_VIDEO)
+      have_video = TRUE;
+  }
+
+  for (pos = prefix; pos < size; pos += hdr + length) {
+    if (!(hdr = gst_matroska_parse_peek_element (buf, pos, &id, &length)) ||
+        length > size - pos - hdr)
+      break;
+
+    switch (id) {
+      case GST_MATROSKA_ID_CLUSTERTIMECODE:
+      {
+        guint8 data[8];
+
+        if (length > 8 ||
+            gst_buffer_extract (buf, pos + hdr, data, length) != length)
+          break;
+        *timecode = 0;
+        for (i = 0; i < length; i++)
+          *timecode = (*timecode << 8) | data[i];
+        break;
+      }
+      case GST_MATROSKA_ID_SIMPLEBLOCK:
+      case GST_MATROSKA_ID_BLOCKGROUP:
+        if (!have_video)
+          return TRUE;
+        if (gst_matroska_parse_peek_video_block (parse, buf, pos + hdr,
+                length, id == GST_MATROSKA_ID_SIMPLEBLOCK, &keyframe))
+          return keyframe;
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* clusters without video can only be joined if there is none at all */
+  return !have_video;
+}
+
+/* passthrough: forwards the Cluster of @bytes bytes at the current offset
+ * as a single buffer, without merging or parsing its blocks */
+static GstFlowReturn
+gst_matroska_parse_forward_cluster (GstMatroskaParseH265 * parse,
+    guint64 bytes, guint prefix)
+{
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+  guint64 timecode;
+  gboolean keyframe;
+
+  if (gst_adapter_available (parse->common.adapter) < bytes)
+    return GST_FLOW_EOS;
+
+  buffer = gst_adapter_take_buffer_fast (parse->common.adapter, bytes);
+  parse->common.offset += bytes;
+
+  keyframe = gst_matroska_parse_peek_cluster (parse, buffer, prefix,
+      &timecode);
+  parse->cluster_time = timecode;
+  if (timecode != GST_CLOCK_TIME_NONE)
+    GST_BUFFER_TIMESTAMP (buffer) = timecode * parse->common.time_scale;
+  else
+    GST_BUFFER_TIMESTAMP (buffer) = GST_CLOCK_TIME_NONE;
+
+  GST_LOG_OBJECT (parse, "forwarding %skeyframe cluster of %" G_GUINT64_FORMAT
+      " bytes, timecode %" G_GUINT64_FORMAT, keyframe ? "" : "non-", bytes,
+      timecode);
+
+  ret = gst_matroska_parse_output (parse, buffer, keyframe);
+  gst_buffer_unref (buffer);
+
+  return ret;
+}
+
 static GstFlowReturn
 gst_matroska_parse_parse_id (GstMatroskaParseH265 * parse, guint32 id,
     guint64 length, guint needed)
@@ -2701,6 +2825,12 @@ gst_matroska_parse_parse_id (GstMatroskaParseH265 * parse, guint32 id,
           /* record next cluster for recovery */
           if (read != G_MAXUINT64)
             parse->next_cluster_offset = parse->cluster_offset + read;
+          if (parse->passthrough && read != G_MAXUINT64 &&
+              read <= MAX_BLOCK_SIZE && !parse->seek_block) {
+            GST_READ_CHECK (gst_matroska_parse_forward_cluster (parse, read,
+                    needed));
+            break;
+          }
           /* eat cluster prefix */
           GST_READ_CHECK (gst_matroska_parse_take (parse, needed, &ebml));
           ret = gst_matroska_parse_output (parse, ebml.buf, TRUE);
@@ -3232,6 +3362,48 @@ gst_matroska_parse_change_state (GstElement * element,
   return ret;
 }
 
+static void
+gst_matroska_parse_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstMatroskaParseH265 *parse;
+
+  g_return_if_fail (GST_IS_MATROSKA_PARSE (object));
+  parse = GST_MATROSKA_PARSE (object);
+
+  switch (prop_id) {
+    case ARG_PASSTHROUGH:
+      GST_OBJECT_LOCK (parse);
+      parse->passthrough = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (parse);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_matroska_parse_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstMatroskaParseH265 *parse;
+
+  g_return_if_fail (GST_IS_MATROSKA_PARSE (object));
+  parse = GST_MATROSKA_PARSE (object);
+
+  switch (prop_id) {
+    case ARG_PASSTHROUGH:
+      GST_OBJECT_LOCK (parse);
+      g_value_set_boolean (value, parse->passthrough);
+      GST_OBJECT_UNLOCK (parse);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 gboolean
 gst_matroska_parse_plugin_init (GstPlugin * plugin)
 {
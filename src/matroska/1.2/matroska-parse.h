@@ -91,8 +91,11 @@ typedef struct _GstMatroskaParseH265 {
   gboolean                 need_newsegment;
 
   /* reverse playback */
-  GArray                  *seek_index;
+  GstMatroskaIndexTable   *seek_index;
   gint                     seek_entry;
+
+  /* forward whole clusters without parsing the blocks */
+  gboolean                 passthrough;
 } GstMatroskaParseH265;
 
 typedef struct _GstMatroskaParseH265Class {
@@ -44,6 +44,7 @@
 
 #include "ebml-read.h"
 #include "matroska-read-common.h"
+#include "../../common/file-map.h"
 
 GST_DEBUG_CATEGORY (matroskareadcommon_debug);
 #define GST_CAT_DEFAULT matroskareadcommon_debug
@@ -69,6 +70,24 @@ typedef struct
 } TargetTypeContext;
 
 
+/* start output buffers at the largest size seen so far for the track and
+ * grow them geometrically, so large frames don't need a realloc per 4000
+ * bytes */
+static guint
+gst_matroska_decompress_initial_size (GstMatroskaTrackEncoding * enc,
+    guint size)
+{
+  return MAX (MAX (enc->comp_size_hint, size), 4000);
+}
+
+static void
+gst_matroska_decompress_update_size (GstMatroskaTrackEncoding * enc,
+    guint size)
+{
+  if (size > enc->comp_size_hint)
+    enc->comp_size_hint = size;
+}
+
 static gboolean
 gst_matroska_decompress_data (GstMatroskaTrackEncoding * enc,
     gpointer * data_out, gsize * size_out,
@@ -82,48 +101,49 @@ gst_matroska_decompress_data (GstMatroskaTrackEncoding * enc,
 
   if (algo == GST_MATROSKA_TRACK_COMPRESSION_ALGORITHM_ZLIB) {
 #ifdef HAVE_ZLIB
-    /* zlib encoded data */
-    z_stream zstream;
-    guint orig_size;
+    /* zlib encoded data, the inflate state is kept for the next block */
+    z_stream *zstream = enc->comp_context;
     int result;
 
-    orig_size = size;
-    zstream.zalloc = (alloc_func) 0;
-    zstream.zfree = (free_func) 0;
-    zstream.opaque = (voidpf) 0;
-    if (inflateInit (&zstream) != Z_OK) {
-      GST_WARNING ("zlib initialization failed.");
+    if (zstream == NULL) {
+      zstream = g_new0 (z_stream, 1);
+      if (inflateInit (zstream) != Z_OK) {
+        GST_WARNING ("zlib initialization failed.");
+        g_free (zstream);
+        ret = FALSE;
+        goto out;
+      }
+      enc->comp_context = zstream;
+    } else if (inflateReset (zstream) != Z_OK) {
+      GST_WARNING ("zlib reset failed.");
       ret = FALSE;
       goto out;
     }
-    zstream.next_in = (Bytef *) data;
-    zstream.avail_in = orig_size;
-    new_size = orig_size;
+
+    zstream->next_in = (Bytef *) data;
+    zstream->avail_in = size;
+    new_size = gst_matroska_decompress_initial_size (enc, size);
     new_data = g_malloc (new_size);
-    zstream.avail_out = new_size;
-    zstream.next_out = (Bytef *) new_data;
+    zstream->avail_out = new_size;
+    zstream->next_out = (Bytef *) new_data;
 
     do {
-      result = inflate (&zstream, Z_NO_FLUSH);
-      if (result != Z_OK && result != Z_STREAM_END) {
-        GST_WARNING ("zlib decompression failed.");
-        g_free (new_data);
-        inflateEnd (&zstream);
-        break;
+      if (zstream->avail_out == 0) {
+        new_size *= 2;
+        new_data = g_realloc (new_data, new_size);
+        zstream->next_out = (Bytef *) (new_data + zstream->total_out);
+        zstream->avail_out = new_size - zstream->total_out;
       }
-      new_size += 4000;
-      new_data = g_realloc (new_data, new_size);
-      zstream.next_out = (Bytef *) (new_data + zstream.total_out);
-      zstream.avail_out += 4000;
-    } while (zstream.avail_in != 0 && result != Z_STREAM_END);
+      result = inflate (zstream, Z_NO_FLUSH);
+    } while (result == Z_OK && zstream->avail_out == 0);
 
     if (result != Z_STREAM_END) {
+      GST_WARNING ("zlib decompression failed.");
+      g_free (new_data);
       ret = FALSE;
       goto out;
-    } else {
-      new_size = zstream.total_out;
-      inflateEnd (&zstream);
     }
+    new_size = zstream->total_out;
 #else
     GST_WARNING ("zlib encoded tracks not supported.");
     ret = FALSE;
@@ -131,15 +151,13 @@ gst_matroska_decompress_data (GstMatroskaTrackEncoding * enc,
 #endif
   } else if (algo == GST_MATROSKA_TRACK_COMPRESSION_ALGORITHM_BZLIB) {
 #ifdef HAVE_BZ2
-    /* bzip2 encoded data */
+    /* bzip2 encoded data, libbz2 has no way to reset a stream */
     bz_stream bzstream;
-    guint orig_size;
     int result;
 
     bzstream.bzalloc = NULL;
     bzstream.bzfree = NULL;
     bzstream.opaque = NULL;
-    orig_size = size;
 
     if (BZ2_bzDecompressInit (&bzstream, 0, 0) != BZ_OK) {
       GST_WARNING ("bzip2 initialization failed.");
@@ -148,70 +166,64 @@ gst_matroska_decompress_data (GstMatroskaTrackEncoding * enc,
     }
 
     bzstream.next_in = (char *) data;
-    bzstream.avail_in = orig_size;
-    new_size = orig_size;
+    bzstream.avail_in = size;
+    new_size = gst_matroska_decompress_initial_size (enc, size);
     new_data = g_malloc (new_size);
     bzstream.avail_out = new_size;
     bzstream.next_out = (char *) new_data;
 
     do {
-      result = BZ2_bzDecompress (&bzstream);
-      if (result != BZ_OK && result != BZ_STREAM_END) {
-        GST_WARNING ("bzip2 decompression failed.");
-        g_free (new_data);
-        BZ2_bzDecompressEnd (&bzstream);
-        break;
+      if (bzstream.avail_out == 0) {
+        new_size *= 2;
+        new_data = g_realloc (new_data, new_size);
+        bzstream.next_out = (char *) (new_data + bzstream.total_out_lo32);
+        bzstream.avail_out = new_size - bzstream.total_out_lo32;
       }
-      new_size += 4000;
-      new_data = g_realloc (new_data, new_size);
-      bzstream.next_out = (char *) (new_data + bzstream.total_out_lo32);
-      bzstream.avail_out += 4000;
-    } while (bzstream.avail_in != 0 && result != BZ_STREAM_END);
+      result = BZ2_bzDecompress (&bzstream);
+    } while (result == BZ_OK && bzstream.avail_out == 0);
 
+    BZ2_bzDecompressEnd (&bzstream);
     if (result != BZ_STREAM_END) {
+      GST_WARNING ("bzip2 decompression failed.");
+      g_free (new_data);
       ret = FALSE;
       goto out;
-    } else {
-      new_size = bzstream.total_out_lo32;
-      BZ2_bzDecompressEnd (&bzstream);
     }
+    new_size = bzstream.total_out_lo32;
 #else
     GST_WARNING ("bzip2 encoded tracks not supported.");
     ret = FALSE;
     goto out;
 #endif
   } else if (algo == GST_MATROSKA_TRACK_COMPRESSION_ALGORITHM_LZO1X) {
-    /* lzo encoded data */
+    /* lzo encoded data, has to be decoded again from the start if the
+     * output doesn't fit */
     int result;
     int orig_size, out_size;
 
-    orig_size = size;
-    out_size = size;
-    new_size = size;
-    new_data = g_malloc (new_size);
+    new_size = gst_matroska_decompress_initial_size (enc, size);
+    new_data = g_malloc (new_size + LZO_OUTPUT_PADDING);
 
-    do {
+    while (TRUE) {
       orig_size = size;
       out_size = new_size;
 
       result = lzo1x_decode (new_data, &out_size, data, &orig_size);
+      if (!(result & LZO_OUTPUT_FULL))
+        break;
 
-      if (orig_size > 0) {
-        new_size += 4000;
-        new_data = g_realloc (new_data, new_size);
-      }
-    } while (orig_size > 0 && result == LZO_OUTPUT_FULL);
-
-    new_size -= out_size;
+      new_size *= 2;
+      new_data = g_realloc (new_data, new_size + LZO_OUTPUT_PADDING);
+    }
 
-    if (result != LZO_OUTPUT_FULL) {
+    if (result != 0) {
       GST_WARNING ("lzo decompression failed");
       g_free (new_data);
 
       ret = FALSE;
       goto out;
     }
-
+    new_size -= out_size;
   } else if (algo == GST_MATROSKA_TRACK_COMPRESSION_ALGORITHM_HEADERSTRIP) {
     /* header stripped encoded data */
     if (enc->comp_settings_length > 0) {
@@ -221,11 +233,15 @@ gst_matroska_decompress_data (GstMatroskaTrackEncoding * enc,
       memcpy (new_data, enc->comp_settings, enc->comp_settings_length);
       memcpy (new_data + enc->comp_settings_length, data, size);
     }
+    goto out;
   } else {
     GST_ERROR ("invalid compression algorithm %d", algo);
     ret = FALSE;
+    goto out;
   }
 
+  gst_matroska_decompress_update_size (enc, new_size);
+
 out:
 
   if (!ret) {
@@ -239,6 +255,72 @@ out:
   return ret;
 }
 
+void
+gst_matroska_track_encoding_clear (GstMatroskaTrackEncoding * enc)
+{
+  g_free (enc->comp_settings);
+  enc->comp_settings = NULL;
+
+  if (enc->comp_context != NULL
+      && enc->comp_algo == GST_MATROSKA_TRACK_COMPRESSION_ALGORITHM_HEADERSTRIP)
+    gst_memory_unref ((GstMemory *) enc->comp_context);
+#ifdef HAVE_ZLIB
+  if (enc->comp_context != NULL
+      && enc->comp_algo == GST_MATROSKA_TRACK_COMPRESSION_ALGORITHM_ZLIB) {
+    inflateEnd ((z_stream *) enc->comp_context);
+    g_free (enc->comp_context);
+  }
+#endif
+  enc->comp_context = NULL;
+}
+
+/*
+ * Header stripping only puts the same few bytes in front of every frame.
+ * If that is all the frame encodings do, the stripped bytes are prepended
+ * to @buf as a memory shared by all frames of the track instead of copying
+ * the frame. Returns NULL without touching @buf otherwise.
+ */
+GstBuffer *
+gst_matroska_decode_stripped_buffer (GArray * encodings, GstBuffer * buf)
+{
+  gint i;
+
+  for (i = 0; i < encodings->len; i++) {
+    GstMatroskaTrackEncoding *enc =
+        &g_array_index (encodings, GstMatroskaTrackEncoding, i);
+
+    if ((enc->scope & GST_MATROSKA_TRACK_ENCODING_SCOPE_FRAME) == 0)
+      continue;
+
+    if (enc->type != 0
+        || enc->comp_algo != GST_MATROSKA_TRACK_COMPRESSION_ALGORITHM_HEADERSTRIP)
+      return NULL;
+  }
+
+  buf = gst_buffer_make_writable (buf);
+  for (i = 0; i < encodings->len; i++) {
+    GstMatroskaTrackEncoding *enc =
+        &g_array_index (encodings, GstMatroskaTrackEncoding, i);
+
+    if ((enc->scope & GST_MATROSKA_TRACK_ENCODING_SCOPE_FRAME) == 0
+        || enc->comp_settings_length == 0)
+      continue;
+
+    if (enc->comp_context == NULL) {
+      gpointer header = g_memdup (enc->comp_settings,
+          enc->comp_settings_length);
+
+      enc->comp_context = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+          header, enc->comp_settings_length, 0, enc->comp_settings_length,
+          header, g_free);
+    }
+    gst_buffer_prepend_memory (buf,
+        gst_memory_ref ((GstMemory *) enc->comp_context));
+  }
+
+  return buf;
+}
+
 GstFlowReturn
 gst_matroska_decode_content_encodings (GArray * encodings)
 {
@@ -371,16 +453,19 @@ gst_matroska_index_seek_find (GstMatroskaIndex * i1, GstClockTime * time,
     return 0;
 }
 
-GstMatroskaIndex *
+/* fills in @entry with the index entry just before or at the requested
+ * position (or after it, with @next) */
+gboolean
 gst_matroska_read_common_do_index_seek (GstMatroskaReadCommon * common,
-    GstMatroskaTrackContext * track, gint64 seek_pos, GArray ** _index,
-    gint * _entry_index, gboolean next)
+    GstMatroskaTrackContext * track, gint64 seek_pos,
+    GstMatroskaIndexTable ** _index, gint * _entry_index, gboolean next,
+    GstMatroskaIndex * entry)
 {
-  GstMatroskaIndex *entry = NULL;
-  GArray *index;
+  GstMatroskaIndexTable *index;
+  gint i;
 
   if (!common->index || !common->index->len)
-    return NULL;
+    return FALSE;
 
   /* find entry just before or at the requested position */
   if (track && track->index_table)
@@ -388,26 +473,23 @@ gst_matroska_read_common_do_index_seek (GstMatroskaReadCommon * common,
   else
     index = common->index;
 
-  entry =
-      gst_util_array_binary_search (index->data, index->len,
-      sizeof (GstMatroskaIndex),
-      (GCompareDataFunc) gst_matroska_index_seek_find,
-      next ? GST_SEARCH_MODE_AFTER : GST_SEARCH_MODE_BEFORE, &seek_pos, NULL);
+  i = gst_matroska_index_table_search (index, seek_pos, next, entry);
 
-  if (entry == NULL) {
+  if (i < 0) {
     if (next) {
-      return NULL;
+      return FALSE;
     } else {
-      entry = &g_array_index (index, GstMatroskaIndex, 0);
+      i = 0;
+      gst_matroska_index_table_get (index, 0, entry);
     }
   }
 
   if (_index)
     *_index = index;
   if (_entry_index)
-    *_entry_index = entry - (GstMatroskaIndex *) index->data;
+    *_entry_index = i;
 
-  return entry;
+  return TRUE;
 }
 
 static gint
@@ -1325,7 +1407,7 @@ exit:
 
 static GstFlowReturn
 gst_matroska_read_common_parse_index_cuetrack (GstMatroskaReadCommon * common,
-    GstEbmlRead * ebml, guint * nentries)
+    GstEbmlRead * ebml, GArray * index, guint * nentries)
 {
   guint32 id;
   GstFlowReturn ret;
@@ -1425,11 +1507,10 @@ gst_matroska_read_common_parse_index_cuetrack (GstMatroskaReadCommon * common,
 
   /* (e.g.) lavf typically creates entries without a block number,
    * which is bogus and leads to contradictory information */
-  if (common->index->len) {
+  if (index->len) {
     GstMatroskaIndex *last_idx;
 
-    last_idx = &g_array_index (common->index, GstMatroskaIndex,
-        common->index->len - 1);
+    last_idx = &g_array_index (index, GstMatroskaIndex, index->len - 1);
     if (last_idx->block == idx.block && last_idx->pos == idx.pos &&
         last_idx->track == idx.track && idx.time > last_idx->time) {
       GST_DEBUG_OBJECT (common, "Cue entry refers to same location, "
@@ -1440,7 +1521,7 @@ gst_matroska_read_common_parse_index_cuetrack (GstMatroskaReadCommon * common,
 
   if ((ret == GST_FLOW_OK || ret == GST_FLOW_EOS)
       && idx.pos != (guint64) - 1 && idx.track > 0) {
-    g_array_append_val (common->index, idx);
+    g_array_append_val (index, idx);
     (*nentries)++;
   } else if (ret == GST_FLOW_OK || ret == GST_FLOW_EOS) {
     GST_DEBUG_OBJECT (common, "CueTrackPositions without valid content");
@@ -1451,7 +1532,7 @@ gst_matroska_read_common_parse_index_cuetrack (GstMatroskaReadCommon * common,
 
 static GstFlowReturn
 gst_matroska_read_common_parse_index_pointentry (GstMatroskaReadCommon *
-    common, GstEbmlRead * ebml)
+    common, GstEbmlRead * ebml, GArray * index)
 {
   guint32 id;
   GstFlowReturn ret;
@@ -1486,7 +1567,7 @@ gst_matroska_read_common_parse_index_pointentry (GstMatroskaReadCommon *
       {
         if ((ret =
                 gst_matroska_read_common_parse_index_cuetrack (common, ebml,
-                    &nentries)) != GST_FLOW_OK)
+                    index, &nentries)) != GST_FLOW_OK)
           break;
         break;
       }
@@ -1503,14 +1584,12 @@ gst_matroska_read_common_parse_index_pointentry (GstMatroskaReadCommon *
   if (nentries > 0) {
     if (time == GST_CLOCK_TIME_NONE) {
       GST_WARNING_OBJECT (common, "CuePoint without valid time");
-      g_array_remove_range (common->index, common->index->len - nentries,
-          nentries);
+      g_array_remove_range (index, index->len - nentries, nentries);
     } else {
       gint i;
 
-      for (i = common->index->len - nentries; i < common->index->len; i++) {
-        GstMatroskaIndex *idx =
-            &g_array_index (common->index, GstMatroskaIndex, i);
+      for (i = index->len - nentries; i < index->len; i++) {
+        GstMatroskaIndex *idx = &g_array_index (index, GstMatroskaIndex, i);
 
         idx->time = time;
         GST_DEBUG_OBJECT (common, "Index entry: pos=%" G_GUINT64_FORMAT
@@ -1553,12 +1632,7 @@ gst_matroska_read_common_parse_index (GstMatroskaReadCommon * common,
 {
   guint32 id;
   GstFlowReturn ret = GST_FLOW_OK;
-  guint i;
-
-  if (common->index)
-    g_array_free (common->index, TRUE);
-  common->index =
-      g_array_sized_new (FALSE, FALSE, sizeof (GstMatroskaIndex), 128);
+  GArray *entries;
 
   DEBUG_ELEMENT_START (common, ebml, "Cues");
 
@@ -1567,6 +1641,8 @@ gst_matroska_read_common_parse_index (GstMatroskaReadCommon * common,
     return ret;
   }
 
+  entries = g_array_sized_new (FALSE, FALSE, sizeof (GstMatroskaIndex), 128);
+
   while (ret == GST_FLOW_OK && gst_ebml_read_has_remaining (ebml, 1, TRUE)) {
     if ((ret = gst_ebml_peek_id (ebml, &id)) != GST_FLOW_OK)
       break;
@@ -1574,7 +1650,8 @@ gst_matroska_read_common_parse_index (GstMatroskaReadCommon * common,
     switch (id) {
         /* one single index entry ('point') */
       case GST_MATROSKA_ID_POINTENTRY:
-        ret = gst_matroska_read_common_parse_index_pointentry (common, ebml);
+        ret = gst_matroska_read_common_parse_index_pointentry (common, ebml,
+            entries);
         break;
 
       default:
@@ -1584,18 +1661,39 @@ gst_matroska_read_common_parse_index (GstMatroskaReadCommon * common,
   }
   DEBUG_ELEMENT_STOP (common, ebml, "Cues", ret);
 
-  /* Sort index by time, smallest time first, for easier searching */
-  g_array_sort (common->index, (GCompareFunc) gst_matroska_index_compare);
+  gst_matroska_read_common_finish_index (common, entries);
+  g_array_free (entries, TRUE);
 
-  /* Now sort the track specific index entries into their own arrays */
-  for (i = 0; i < common->index->len; i++) {
-    GstMatroskaIndex *idx = &g_array_index (common->index, GstMatroskaIndex,
-        i);
+  return ret;
+}
+
+/* sets up common->index and the per track tables from @entries; with
+ * @retire the tables that are replaced are kept until
+ * gst_matroska_read_common_free_retired_index() */
+static void
+gst_matroska_read_common_build_index (GstMatroskaReadCommon * common,
+    GArray * entries, gboolean retire)
+{
+  GstMatroskaIndexTable **tables;
+  guint i;
+
+  gst_matroska_index_table_free (common->index);
+  common->index = NULL;
+
+  /* Sort index by time, smallest time first, for easier searching */
+  g_array_sort (entries, (GCompareFunc) gst_matroska_index_compare);
+
+  /* Now sort the track specific index entries into their own tables, which
+   * are only handed to the tracks when complete as the streaming thread
+   * looks at them for QoS */
+  tables = g_new0 (GstMatroskaIndexTable *, common->src->len);
+  for (i = 0; i < entries->len; i++) {
+    GstMatroskaIndex *idx = &g_array_index (entries, GstMatroskaIndex, i);
     gint track_num;
-    GstMatroskaTrackContext *ctx;
 
 #if 0
     if (common->element_index) {
+      GstMatroskaTrackContext *ctx;
       gint writer_id;
 
       if (idx->track != 0 &&
@@ -1631,26 +1729,489 @@ gst_matroska_read_common_parse_index (GstMatroskaReadCommon * common,
     if (track_num == -1)
       continue;
 
-    ctx = g_ptr_array_index (common->src, track_num);
+    if (tables[track_num] == NULL)
+      tables[track_num] = gst_matroska_index_table_new (common->time_scale);
+
+    gst_matroska_index_table_append (tables[track_num], idx);
+  }
 
-    if (ctx->index_table == NULL)
-      ctx->index_table =
-          g_array_sized_new (FALSE, FALSE, sizeof (GstMatroskaIndex), 128);
+  for (i = 0; i < common->src->len; i++) {
+    GstMatroskaTrackContext *ctx = g_ptr_array_index (common->src, i);
 
-    g_array_append_vals (ctx->index_table, idx, 1);
+    if (tables[i] == NULL)
+      continue;
+    /* a single store, the streaming thread never sees the track without
+     * a table */
+    if (retire && ctx->index_table)
+      common->index_retired = g_list_prepend (common->index_retired,
+          ctx->index_table);
+    else
+      gst_matroska_index_table_free (ctx->index_table);
+    ctx->index_table = tables[i];
   }
+  g_free (tables);
 
   common->index_parsed = TRUE;
 
   /* sanity check; empty index normalizes to no index */
-  if (common->index->len == 0) {
-    g_array_free (common->index, TRUE);
-    common->index = NULL;
+  if (entries->len > 0)
+    common->index = gst_matroska_index_table_new_from_array (entries,
+        common->time_scale);
+}
+
+/* takes index entries, whether parsed from Cues or loaded from elsewhere,
+ * and sets up common->index and the per track tables from them; sorts
+ * @entries in place but leaves them to the caller */
+void
+gst_matroska_read_common_finish_index (GstMatroskaReadCommon * common,
+    GArray * entries)
+{
+  gst_matroska_read_common_build_index (common, entries, FALSE);
+}
+
+/* Lazily loaded Cues (pull mode): when the Cues are found, only their
+ * position is noted. They are split into pages of
+ * GST_MATROSKA_CUES_PAGE_SIZE bytes, each holding the CuePoints that start
+ * in it. CuePoints are ordered by time, so a seek binary searches the pages
+ * by the time of their first CuePoint and only decodes the pages around
+ * its target. The first CuePoint of a page is found by scanning for one
+ * that looks plausible, as its start isn't known without reading all the
+ * preceding ones. Where a neighbouring page was decoded, the element
+ * boundary between them is known and used instead, so elements before a
+ * page's first plausible CuePoint aren't lost. */
+
+#define GST_MATROSKA_CUES_PAGE_SIZE  (64 * 1024)
+#define GST_MATROSKA_CUES_PROBE_SIZE 4096
+
+typedef struct
+{
+  /* first CuePoint, G_MAXUINT64 until probed and the end of the Cues if
+   * none starts in the page */
+  guint64 pos;
+  GstClockTime time;
+  /* where decoding starts, the end of the last element of the previous
+   * page once that is decoded, or where it started; G_MAXUINT64 if not
+   * known */
+  guint64 start;
+  gboolean decoded;
+} GstMatroskaCuePage;
+
+void
+gst_matroska_read_common_defer_index (GstMatroskaReadCommon * common,
+    guint64 offset, guint64 size)
+{
+  GstMatroskaCuePage page = { G_MAXUINT64, GST_CLOCK_TIME_NONE, G_MAXUINT64,
+    FALSE
+  };
+  guint i, n_pages;
+
+  gst_matroska_read_common_clear_deferred_index (common);
+  common->index_parsed = TRUE;
+
+  n_pages = (size + GST_MATROSKA_CUES_PAGE_SIZE - 1) /
+      GST_MATROSKA_CUES_PAGE_SIZE;
+  if (n_pages == 0)
+    return;
+
+  common->cues_offset = offset;
+  common->cues_size = size;
+  common->cue_pages = g_array_sized_new (FALSE, FALSE,
+      sizeof (GstMatroskaCuePage), n_pages);
+  for (i = 0; i < n_pages; i++)
+    g_array_append_val (common->cue_pages, page);
+  common->cue_pages_left = n_pages;
+
+  /* the first page may start with something else, decoding skips that */
+  g_array_index (common->cue_pages, GstMatroskaCuePage, 0).pos = offset;
+  g_array_index (common->cue_pages, GstMatroskaCuePage, 0).time = 0;
+
+  GST_DEBUG_OBJECT (common, "Cues at %" G_GUINT64_FORMAT ", %"
+      G_GUINT64_FORMAT " bytes in %u pages, decoding them on demand", offset,
+      size, n_pages);
+}
+
+gboolean
+gst_matroska_read_common_index_is_deferred (GstMatroskaReadCommon * common)
+{
+  return common->cue_pages_left > 0;
+}
+
+void
+gst_matroska_read_common_clear_deferred_index (GstMatroskaReadCommon * common)
+{
+  if (common->cue_pages) {
+    g_array_free (common->cue_pages, TRUE);
+    common->cue_pages = NULL;
   }
+  common->cue_pages_left = 0;
+  gst_matroska_read_common_free_retired_index (common);
+}
+
+void
+gst_matroska_read_common_free_retired_index (GstMatroskaReadCommon * common)
+{
+  g_list_free_full (common->index_retired,
+      (GDestroyNotify) gst_matroska_index_table_free);
+  common->index_retired = NULL;
+}
 
+/* reads from outside the streaming thread, so the cache can't be used */
+static GstFlowReturn
+gst_matroska_read_common_pull_cues (GstMatroskaReadCommon * common,
+    guint64 offset, guint64 size, GstBuffer ** buf)
+{
+  GstFlowReturn ret;
+
+  size = MIN (size, common->cues_offset + common->cues_size - offset);
+  if (common->file_map
+      && gst_file_map_get_range (common->file_map, offset, size, buf))
+    return GST_FLOW_OK;
+
+  ret = gst_pad_pull_range (common->sinkpad, offset, size, buf);
+  if (ret == GST_FLOW_OK && gst_buffer_get_size (*buf) < size) {
+    gst_buffer_unref (*buf);
+    *buf = NULL;
+    ret = GST_FLOW_EOS;
+  }
   return ret;
 }
 
+/* checks for a CuePoint starting with its CueTime at @data, of which @size
+ * bytes are available and @avail belong to the Cues, that is followed by
+ * another CuePoint if that is within reach */
+static gboolean
+gst_matroska_read_common_check_cuepoint (GstMatroskaReadCommon * common,
+    const guint8 * data, guint size, guint64 avail, GstClockTime * time)
+{
+  guint64 length, time_length, end, num = 0;
+  guint pos, i;
+  gint n;
+
+  if (size < 2 || data[0] != GST_MATROSKA_ID_POINTENTRY)
+    return FALSE;
+  if ((n = gst_ebml_read_vint (data + 1, size - 1, &length)) < 0
+      || length == G_MAXUINT64)
+    return FALSE;
+  pos = 1 + n;
+  end = pos + length;
+  if (end > avail)
+    return FALSE;
+
+  if (pos + 2 > size || data[pos] != GST_MATROSKA_ID_CUETIME)
+    return FALSE;
+  if ((n = gst_ebml_read_vint (data + pos + 1, size - pos - 1,
+              &time_length)) < 0 || time_length == 0 || time_length > 8)
+    return FALSE;
+  pos += 1 + n;
+  if (pos + time_length > end || pos + time_length > size)
+    return FALSE;
+  for (i = 0; i < time_length; i++)
+    num = (num << 8) | data[pos + i];
+
+  if (end < size && data[end] != GST_MATROSKA_ID_POINTENTRY)
+    return FALSE;
+
+  *time = num * common->time_scale;
+  return TRUE;
+}
+
+/* looks for the first CuePoint in @buf, which starts at @start, before
+ * @page_end */
+static gboolean
+gst_matroska_read_common_find_cuepoint (GstMatroskaReadCommon * common,
+    GstBuffer * buf, guint64 start, guint64 page_end, guint64 * pos,
+    GstClockTime * time)
+{
+  guint64 cues_end = common->cues_offset + common->cues_size;
+  gboolean found = FALSE;
+  GstMapInfo map;
+  guint i;
+
+  gst_buffer_map (buf, &map, GST_MAP_READ);
+  for (i = 0; i < map.size && start + i < page_end; i++) {
+    if (gst_matroska_read_common_check_cuepoint (common, map.data + i,
+            map.size - i, cues_end - start - i, time)) {
+      *pos = start + i;
+      found = TRUE;
+      break;
+    }
+  }
+  gst_buffer_unmap (buf, &map);
+
+  return found;
+}
+
+static GstFlowReturn
+gst_matroska_read_common_probe_cue_page (GstMatroskaReadCommon * common,
+    guint index)
+{
+  GstMatroskaCuePage *page =
+      &g_array_index (common->cue_pages, GstMatroskaCuePage, index);
+  guint64 start, page_end, cues_end;
+  GstBuffer *buf = NULL;
+  GstFlowReturn ret;
+  gboolean found;
+
+  if (page->pos != G_MAXUINT64)
+    return GST_FLOW_OK;
+
+  cues_end = common->cues_offset + common->cues_size;
+  start = common->cues_offset + (guint64) index * GST_MATROSKA_CUES_PAGE_SIZE;
+  page_end = MIN (start + GST_MATROSKA_CUES_PAGE_SIZE, cues_end);
+
+  ret = gst_matroska_read_common_pull_cues (common, start,
+      GST_MATROSKA_CUES_PROBE_SIZE, &buf);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  found = gst_matroska_read_common_find_cuepoint (common, buf, start,
+      page_end, &page->pos, &page->time);
+  gst_buffer_unref (buf);
+
+  /* the first CuePoint can start later, after a long one from the page
+   * before or after a Void or CRC-32, so look through all of the page */
+  if (!found && start + GST_MATROSKA_CUES_PROBE_SIZE < page_end) {
+    ret = gst_matroska_read_common_pull_cues (common, start,
+        page_end - start + GST_MATROSKA_CUES_PROBE_SIZE, &buf);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    found = gst_matroska_read_common_find_cuepoint (common, buf, start,
+        page_end, &page->pos, &page->time);
+    gst_buffer_unref (buf);
+  }
+
+  if (!found) {
+    page->pos = cues_end;
+    page->time = GST_CLOCK_TIME_NONE;
+  }
+
+  GST_LOG_OBJECT (common, "Cues page %u starts at %" G_GUINT64_FORMAT
+      " with time %" GST_TIME_FORMAT, index, page->pos,
+      GST_TIME_ARGS (page->time));
+
+  return GST_FLOW_OK;
+}
+
+/* returns the end of the last element in @data starting before @limit,
+ * which is beyond @size if more data is needed to tell, or -1 if the
+ * elements are invalid */
+static gint64
+gst_matroska_read_common_cue_page_end (const guint8 * data, gsize size,
+    guint64 limit)
+{
+  guint64 pos = 0, length;
+  guint id_len, len_len;
+  gint n;
+
+  while (pos < limit) {
+    if (pos >= size)
+      return pos + 1;
+    id_len = gst_ebml_vint_length (data[pos]);
+    if (id_len == 0 || id_len > 4)
+      return -1;
+    if (pos + id_len >= size)
+      return pos + id_len + 1;
+    len_len = gst_ebml_vint_length (data[pos + id_len]);
+    if (len_len == 0 || len_len > 8)
+      return -1;
+    if ((n = gst_ebml_read_vint (data + pos + id_len, size - pos - id_len,
+                &length)) < 0)
+      return pos + id_len + len_len;
+    if (length == G_MAXUINT64)
+      return -1;
+    pos += id_len + n + length;
+  }
+
+  return pos;
+}
+
+static GstFlowReturn
+gst_matroska_read_common_decode_cue_page (GstMatroskaReadCommon * common,
+    GstElement * el, guint index, GArray * entries)
+{
+  GstMatroskaCuePage *page, *next = NULL;
+  guint64 start, limit, next_start, cues_end, size;
+  GstBuffer *buf = NULL;
+  GstFlowReturn ret;
+  GstEbmlRead ebml;
+  GstMapInfo map;
+  gint64 end = 0;
+  guint32 id;
+
+  if ((ret = gst_matroska_read_common_probe_cue_page (common, index))
+      != GST_FLOW_OK)
+    return ret;
+
+  page = &g_array_index (common->cue_pages, GstMatroskaCuePage, index);
+  if (page->decoded)
+    return GST_FLOW_OK;
+  if (index + 1 < common->cue_pages->len)
+    next = &g_array_index (common->cue_pages, GstMatroskaCuePage, index + 1);
+
+  cues_end = common->cues_offset + common->cues_size;
+  limit = MIN (common->cues_offset +
+      (guint64) (index + 1) * GST_MATROSKA_CUES_PAGE_SIZE, cues_end);
+
+  /* start where the previous page ended if that is decoded, an element
+   * before the probed CuePoint would be lost otherwise; for the same
+   * reason cover everything up to where a decoded next page started */
+  start = page->start != G_MAXUINT64 ? page->start : page->pos;
+  next_start = page->start;
+  if (next && next->decoded && next->start != G_MAXUINT64)
+    limit = MAX (limit, next->start);
+
+  /* pull up to the end of the last CuePoint starting in the page */
+  size = limit - MIN (start, limit) + GST_MATROSKA_CUES_PROBE_SIZE;
+  while (start < limit) {
+    if ((ret = gst_matroska_read_common_pull_cues (common, start, size,
+                &buf)) != GST_FLOW_OK)
+      return ret;
+    gst_buffer_map (buf, &map, GST_MAP_READ);
+    end = gst_matroska_read_common_cue_page_end (map.data, map.size,
+        limit - start);
+    gst_buffer_unmap (buf, &map);
+
+    if (end < 0 || start + end > cues_end) {
+      GST_WARNING_OBJECT (common, "invalid Cues page %u", index);
+      gst_buffer_unref (buf);
+      return GST_FLOW_ERROR;
+    }
+    if (end <= gst_buffer_get_size (buf))
+      break;
+    gst_buffer_unref (buf);
+    buf = NULL;
+    size = end + GST_MATROSKA_CUES_PROBE_SIZE;
+  }
+
+  if (buf) {
+    page->start = start;
+    next_start = start + end;
+    gst_buffer_resize (buf, 0, end);
+    gst_ebml_read_init (&ebml, el, buf, start);
+    while (ret == GST_FLOW_OK
+        && gst_ebml_read_has_remaining (&ebml, 1, FALSE)) {
+      if ((ret = gst_ebml_peek_id (&ebml, &id)) != GST_FLOW_OK)
+        break;
+      if (id == GST_MATROSKA_ID_POINTENTRY)
+        ret = gst_matroska_read_common_parse_index_pointentry (common, &ebml,
+            entries);
+      else
+        ret = gst_matroska_read_common_parse_skip (common, &ebml, "Cues", id);
+    }
+    gst_ebml_read_clear (&ebml);
+  }
+
+  /* where the elements of this page end, unless only the probe said that
+   * none starts in it */
+  if (next && !next->decoded && next_start != G_MAXUINT64)
+    next->start = next_start;
+
+  GST_DEBUG_OBJECT (common, "decoded Cues page %u, %u entries so far", index,
+      entries->len);
+  page->decoded = TRUE;
+  common->cue_pages_left--;
+
+  return ret;
+}
+
+/* whether @track has an entry at or before @time in Cues page @index or a
+ * later one, among @entries or in its index from earlier loads */
+static gboolean
+gst_matroska_read_common_cue_found (GstMatroskaReadCommon * common,
+    GstMatroskaTrackContext * track, GstClockTime time, guint index,
+    GArray * entries)
+{
+  GstMatroskaCuePage *page;
+  GstMatroskaIndex *idx, entry;
+  guint i;
+
+  for (i = 0; i < entries->len; i++) {
+    idx = &g_array_index (entries, GstMatroskaIndex, i);
+    if (idx->track == track->num && idx->time <= time)
+      return TRUE;
+  }
+
+  /* the Cues are ordered by time, so an entry not before the start of the
+   * page comes from it or a later one */
+  page = &g_array_index (common->cue_pages, GstMatroskaCuePage, index);
+  return track->index_table && GST_CLOCK_TIME_IS_VALID (page->time)
+      && gst_matroska_index_table_search (track->index_table, time, FALSE,
+      &entry) >= 0 && entry.time >= page->time;
+}
+
+/* decodes the Cues around @time, and further back until @track (if any) has
+ * an entry at or before it, or all of them */
+GstFlowReturn
+gst_matroska_read_common_load_index (GstMatroskaReadCommon * common,
+    GstElement * el, GstMatroskaTrackContext * track, GstClockTime time,
+    gboolean all, GArray * entries)
+{
+  GstMatroskaCuePage *page;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint lo, hi, mid, i;
+
+  if (!common->cue_pages_left)
+    return GST_FLOW_OK;
+
+  lo = 0;
+  hi = common->cue_pages->len - 1;
+  if (!all) {
+    /* last page whose first CuePoint is at or before @time */
+    while (lo < hi) {
+      mid = lo + (hi - lo + 1) / 2;
+      if ((ret = gst_matroska_read_common_probe_cue_page (common, mid))
+          != GST_FLOW_OK)
+        return ret;
+      page = &g_array_index (common->cue_pages, GstMatroskaCuePage, mid);
+      if (GST_CLOCK_TIME_IS_VALID (page->time) && page->time <= time)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    /* the neighbours have the entries around @time of the other tracks */
+    hi = MIN (lo + 1, common->cue_pages->len - 1);
+    lo = lo > 0 ? lo - 1 : 0;
+  }
+
+  for (i = lo; i <= hi && ret == GST_FLOW_OK; i++)
+    ret = gst_matroska_read_common_decode_cue_page (common, el, i, entries);
+
+  /* the seek track may have no keyframe in these pages, e.g. with sparse
+   * video Cues between dense audio ones */
+  if (!all && track) {
+    while (ret == GST_FLOW_OK && lo > 0
+        && !gst_matroska_read_common_cue_found (common, track, time, lo,
+            entries))
+      ret = gst_matroska_read_common_decode_cue_page (common, el, --lo,
+          entries);
+  }
+
+  return ret;
+}
+
+/* adds decoded Cues entries to the index, the tables that are replaced are
+ * kept until gst_matroska_read_common_free_retired_index() as the
+ * streaming thread may still be looking at them */
+void
+gst_matroska_read_common_merge_index (GstMatroskaReadCommon * common,
+    GArray * entries)
+{
+  GArray *index;
+
+  if (common->index) {
+    index = gst_matroska_index_table_to_array (common->index);
+    common->index_retired = g_list_prepend (common->index_retired,
+        common->index);
+    common->index = NULL;
+  } else {
+    index = g_array_sized_new (FALSE, FALSE, sizeof (GstMatroskaIndex),
+        entries->len);
+  }
+  g_array_append_vals (index, entries->data, entries->len);
+
+  gst_matroska_read_common_build_index (common, index, TRUE);
+  g_array_free (index, TRUE);
+}
+
 GstFlowReturn
 gst_matroska_read_common_parse_info (GstMatroskaReadCommon * common,
     GstElement * el, GstEbmlRead * ebml)
@@ -2478,6 +3039,222 @@ gst_matroska_read_common_peek_adapter (GstMatroskaReadCommon * common, guint
   return GST_FLOW_OK;
 }
 
+/* smallest cache refill, used while reading headers */
+#define GST_MATROSKA_READ_COMMON_MIN_CACHE (64 * 1024)
+
+static gpointer
+gst_matroska_read_common_prefetch_thread (GstMatroskaReadCommon * common)
+{
+  g_mutex_lock (&common->prefetch_lock);
+  while (!common->prefetch_stop) {
+    GstBuffer *buffer = NULL;
+    GstFlowReturn ret;
+    guint64 offset;
+    guint size;
+
+    if (!common->prefetch_pending) {
+      g_cond_wait (&common->prefetch_cond, &common->prefetch_lock);
+      continue;
+    }
+    offset = common->prefetch_offset;
+    size = common->prefetch_size;
+    common->prefetch_pending = FALSE;
+    common->prefetch_busy = TRUE;
+    g_mutex_unlock (&common->prefetch_lock);
+
+    ret = gst_pad_pull_range (common->sinkpad, offset, size, &buffer);
+    GST_LOG_OBJECT (common, "prefetched %u bytes at offset %" G_GUINT64_FORMAT
+        ": %s", size, offset, gst_flow_get_name (ret));
+
+    g_mutex_lock (&common->prefetch_lock);
+    common->prefetch_busy = FALSE;
+    /* a failed pull (flushing for a seek, EOS) just means there is nothing
+     * prefetched, the streaming thread will run into the error itself */
+    if (ret == GST_FLOW_OK)
+      common->prefetch_buffer = buffer;
+    g_cond_broadcast (&common->prefetch_cond);
+  }
+  g_mutex_unlock (&common->prefetch_lock);
+
+  return NULL;
+}
+
+void
+gst_matroska_read_common_start_prefetch (GstMatroskaReadCommon * common)
+{
+  if (common->prefetch_thread)
+    return;
+
+  g_mutex_init (&common->prefetch_lock);
+  g_cond_init (&common->prefetch_cond);
+  common->prefetch_stop = FALSE;
+  common->prefetch_pending = FALSE;
+  common->prefetch_busy = FALSE;
+  common->prefetch_buffer = NULL;
+  common->prefetch_thread = g_thread_new ("matroska-prefetch",
+      (GThreadFunc) gst_matroska_read_common_prefetch_thread, common);
+}
+
+void
+gst_matroska_read_common_stop_prefetch (GstMatroskaReadCommon * common)
+{
+  if (!common->prefetch_thread)
+    return;
+
+  g_mutex_lock (&common->prefetch_lock);
+  common->prefetch_stop = TRUE;
+  g_cond_broadcast (&common->prefetch_cond);
+  g_mutex_unlock (&common->prefetch_lock);
+  g_thread_join (common->prefetch_thread);
+  common->prefetch_thread = NULL;
+
+  if (common->prefetch_buffer) {
+    gst_buffer_unref (common->prefetch_buffer);
+    common->prefetch_buffer = NULL;
+  }
+  g_mutex_clear (&common->prefetch_lock);
+  g_cond_clear (&common->prefetch_cond);
+}
+
+/* drops a prefetch that wasn't started yet and what was prefetched, a
+ * pull in progress is dropped by take_prefetch() once it's done */
+static void
+gst_matroska_read_common_drop_prefetch (GstMatroskaReadCommon * common)
+{
+  if (!common->prefetch_thread)
+    return;
+
+  g_mutex_lock (&common->prefetch_lock);
+  common->prefetch_pending = FALSE;
+  if (common->prefetch_buffer) {
+    gst_buffer_unref (common->prefetch_buffer);
+    common->prefetch_buffer = NULL;
+  }
+  g_mutex_unlock (&common->prefetch_lock);
+}
+
+/*
+ * Drops the pull mode cache and anything prefetched
+ */
+void
+gst_matroska_read_common_free_cache (GstMatroskaReadCommon * common)
+{
+  if (common->cached_buffer) {
+    if (common->cached_data) {
+      gst_buffer_unmap (common->cached_buffer, &common->cached_map);
+      common->cached_data = NULL;
+    }
+    gst_buffer_unref (common->cached_buffer);
+    common->cached_buffer = NULL;
+  }
+
+  gst_matroska_read_common_drop_prefetch (common);
+}
+
+/*
+ * Forgets the read-ahead window of the current Cluster when reading goes
+ * on elsewhere (after a seek), until the next Cluster sets it again
+ */
+void
+gst_matroska_read_common_reset_read_ahead (GstMatroskaReadCommon * common)
+{
+  common->read_ahead_end = 0;
+  gst_matroska_read_common_drop_prefetch (common);
+}
+
+/* returns the prefetched buffer if it holds (offset,size), waiting for it
+ * if it is still being pulled; drops it if it won't be of use any more */
+static GstBuffer *
+gst_matroska_read_common_take_prefetch (GstMatroskaReadCommon * common,
+    guint64 offset, guint size)
+{
+  GstBuffer *buffer = NULL;
+
+  g_mutex_lock (&common->prefetch_lock);
+  if (offset >= common->prefetch_offset
+      && offset + size <= common->prefetch_offset + common->prefetch_size) {
+    while (common->prefetch_pending || common->prefetch_busy)
+      g_cond_wait (&common->prefetch_cond, &common->prefetch_lock);
+  }
+
+  if (common->prefetch_buffer) {
+    guint64 prefetch_offset = GST_BUFFER_OFFSET (common->prefetch_buffer);
+    gsize prefetch_size = gst_buffer_get_size (common->prefetch_buffer);
+
+    if (offset >= prefetch_offset
+        && offset + size <= prefetch_offset + prefetch_size) {
+      buffer = common->prefetch_buffer;
+      common->prefetch_buffer = NULL;
+    } else if (prefetch_offset < offset
+        || prefetch_offset > offset + common->read_ahead) {
+      /* we seeked away from it */
+      gst_buffer_unref (common->prefetch_buffer);
+      common->prefetch_buffer = NULL;
+    }
+  }
+  g_mutex_unlock (&common->prefetch_lock);
+
+  return buffer;
+}
+
+/* start pulling the window that follows the cache in the background */
+static void
+gst_matroska_read_common_request_prefetch (GstMatroskaReadCommon * common)
+{
+  guint64 next;
+
+  /* the probes of a scan are far apart, the window after them is of no
+   * use */
+  if (!common->prefetch_thread || common->read_ahead_end == 0
+      || common->read_ahead <= GST_MATROSKA_READ_COMMON_MIN_CACHE
+      || common->state == GST_MATROSKA_READ_STATE_SCANNING)
+    return;
+
+  next = GST_BUFFER_OFFSET (common->cached_buffer) +
+      gst_buffer_get_size (common->cached_buffer);
+
+  g_mutex_lock (&common->prefetch_lock);
+  if (!common->prefetch_pending && !common->prefetch_busy
+      && !(common->prefetch_buffer && common->prefetch_offset == next)) {
+    if (common->prefetch_buffer) {
+      gst_buffer_unref (common->prefetch_buffer);
+      common->prefetch_buffer = NULL;
+    }
+    common->prefetch_offset = next;
+    common->prefetch_size = common->read_ahead;
+    common->prefetch_pending = TRUE;
+    g_cond_signal (&common->prefetch_cond);
+  }
+  g_mutex_unlock (&common->prefetch_lock);
+}
+
+/* how much to pull when (common->offset,size) is not in the cache */
+static guint
+gst_matroska_read_common_refill_size (GstMatroskaReadCommon * common,
+    guint size)
+{
+  guint64 want = GST_MATROSKA_READ_COMMON_MIN_CACHE;
+
+  if (common->read_ahead > want && common->read_ahead_end > common->offset
+      && common->state != GST_MATROSKA_READ_STATE_SCANNING) {
+    want = MIN (common->read_ahead_end - common->offset, common->read_ahead);
+    want = MAX (want, GST_MATROSKA_READ_COMMON_MIN_CACHE);
+
+    /* stop where a prefetch starts so it can still be used */
+    if (common->prefetch_thread) {
+      g_mutex_lock (&common->prefetch_lock);
+      if ((common->prefetch_pending || common->prefetch_busy
+              || common->prefetch_buffer)
+          && common->prefetch_offset > common->offset + size
+          && common->prefetch_offset < common->offset + want)
+        want = common->prefetch_offset - common->offset;
+      g_mutex_unlock (&common->prefetch_lock);
+    }
+  }
+
+  return MAX (size, want);
+}
+
 /*
  * Calls pull_range for (offset,size) without advancing our offset
  */
@@ -2487,8 +3264,9 @@ gst_matroska_read_common_peek_bytes (GstMatroskaReadCommon * common, guint64
 {
   GstFlowReturn ret;
 
-  /* Caching here actually makes much less difference than one would expect.
-   * We do it mainly to avoid pulling buffers of 1 byte all the time */
+  /* Caching here mainly avoids pulling buffers of 1 byte all the time.
+   * With read-ahead enabled it also turns reading a Cluster into a single
+   * pull, which matters a lot when every pull is a network round trip. */
   if (common->cached_buffer) {
     guint64 cache_offset = GST_BUFFER_OFFSET (common->cached_buffer);
     gsize cache_size = gst_buffer_get_size (common->cached_buffer);
@@ -2517,15 +3295,44 @@ gst_matroska_read_common_peek_bytes (GstMatroskaReadCommon * common, guint64
     common->cached_buffer = NULL;
   }
 
-  /* refill the cache */
+  /* a mapped file is cached as a whole */
+  if (common->file_map && common->offset + size <= common->file_map->size) {
+    gst_file_map_get_range (common->file_map, 0, common->file_map->size,
+        &common->cached_buffer);
+    return gst_matroska_read_common_peek_bytes (common, offset, size, p_buf,
+        bytes);
+  }
+
+  /* refill the cache, preferably from what was prefetched */
+  if (common->prefetch_thread)
+    common->cached_buffer = gst_matroska_read_common_take_prefetch (common,
+        common->offset, size);
+
+  if (common->cached_buffer) {
+    guint64 cache_offset = GST_BUFFER_OFFSET (common->cached_buffer);
+
+    gst_matroska_read_common_request_prefetch (common);
+    if (p_buf)
+      *p_buf = gst_buffer_copy_region (common->cached_buffer,
+          GST_BUFFER_COPY_ALL, common->offset - cache_offset, size);
+    if (bytes) {
+      gst_buffer_map (common->cached_buffer, &common->cached_map, GST_MAP_READ);
+      common->cached_data = common->cached_map.data;
+      *bytes = common->cached_data + common->offset - cache_offset;
+    }
+    return GST_FLOW_OK;
+  }
+
   ret = gst_pad_pull_range (common->sinkpad, common->offset,
-      MAX (size, 64 * 1024), &common->cached_buffer);
+      gst_matroska_read_common_refill_size (common, size),
+      &common->cached_buffer);
   if (ret != GST_FLOW_OK) {
     common->cached_buffer = NULL;
     return ret;
   }
 
   if (gst_buffer_get_size (common->cached_buffer) >= size) {
+    gst_matroska_read_common_request_prefetch (common);
     if (p_buf)
       *p_buf = gst_buffer_copy_region (common->cached_buffer,
           GST_BUFFER_COPY_ALL, 0, size);
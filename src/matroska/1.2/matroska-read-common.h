@@ -77,7 +77,16 @@ typedef struct _GstMatroskaReadCommon {
   guint64                  ebml_segment_start;
 
   /* a cue (index) table */
-  GArray                  *index;
+  GstMatroskaIndexTable   *index;
+
+  /* Cues decoded on demand (pull mode): position and size of their content,
+   * their pages and the index tables replaced since the streaming thread
+   * was last stopped */
+  guint64                  cues_offset;
+  guint64                  cues_size;
+  GArray                  *cue_pages;
+  guint                    cue_pages_left;
+  GList                   *index_retired;
 
   /* timescale in the file */
   guint64                  time_scale;
@@ -87,11 +96,30 @@ typedef struct _GstMatroskaReadCommon {
 
   GstTagList              *global_tags;
 
-  /* pull mode caching */
+  /* pull mode caching; with file_map (the whole file mapped) set, the cache
+   * is a buffer sharing the mapping */
+  GstMemory *file_map;
   GstBuffer *cached_buffer;
   guint8 *cached_data;
   GstMapInfo cached_map;
 
+  /* pull mode read-ahead: cache refills reach up to read_ahead_end (the end
+   * of the current Cluster, 0 while reading headers) but are limited to
+   * read_ahead bytes, and the window after the cache is pulled by
+   * prefetch_thread. The prefetch_* request and result fields are
+   * protected by prefetch_lock */
+  guint                    read_ahead;
+  guint64                  read_ahead_end;
+  GThread                 *prefetch_thread;
+  GMutex                   prefetch_lock;
+  GCond                    prefetch_cond;
+  gboolean                 prefetch_stop;
+  gboolean                 prefetch_pending;
+  gboolean                 prefetch_busy;
+  guint64                  prefetch_offset;
+  guint                    prefetch_size;
+  GstBuffer               *prefetch_buffer;
+
   /* push and pull mode */
   guint64                  offset;
 
@@ -102,11 +130,15 @@ typedef struct _GstMatroskaReadCommon {
 GstFlowReturn gst_matroska_decode_content_encodings (GArray * encodings);
 gboolean gst_matroska_decode_data (GArray * encodings, gpointer * data_out,
     gsize * size_out, GstMatroskaTrackEncodingScope scope, gboolean free);
+void gst_matroska_track_encoding_clear (GstMatroskaTrackEncoding * enc);
+GstBuffer * gst_matroska_decode_stripped_buffer (GArray * encodings,
+    GstBuffer * buf);
 gint gst_matroska_index_seek_find (GstMatroskaIndex * i1, GstClockTime * time,
     gpointer user_data);
-GstMatroskaIndex * gst_matroska_read_common_do_index_seek (
+gboolean gst_matroska_read_common_do_index_seek (
     GstMatroskaReadCommon * common, GstMatroskaTrackContext * track, gint64
-    seek_pos, GArray ** _index, gint * _entry_index, gboolean next);
+    seek_pos, GstMatroskaIndexTable ** _index, gint * _entry_index,
+    gboolean next, GstMatroskaIndex * entry);
 void gst_matroska_read_common_found_global_tag (GstMatroskaReadCommon * common,
     GstElement * el, GstTagList * taglist);
 gint64 gst_matroska_read_common_get_length (GstMatroskaReadCommon * common);
@@ -114,6 +146,21 @@ GstMatroskaTrackContext * gst_matroska_read_common_get_seek_track (
     GstMatroskaReadCommon * common, GstMatroskaTrackContext * track);
 GstFlowReturn gst_matroska_read_common_parse_index (GstMatroskaReadCommon *
     common, GstEbmlRead * ebml);
+void gst_matroska_read_common_finish_index (GstMatroskaReadCommon * common,
+    GArray * entries);
+void gst_matroska_read_common_defer_index (GstMatroskaReadCommon * common,
+    guint64 offset, guint64 size);
+gboolean gst_matroska_read_common_index_is_deferred (GstMatroskaReadCommon *
+    common);
+GstFlowReturn gst_matroska_read_common_load_index (GstMatroskaReadCommon *
+    common, GstElement * el, GstMatroskaTrackContext * track,
+    GstClockTime time, gboolean all, GArray * entries);
+void gst_matroska_read_common_merge_index (GstMatroskaReadCommon * common,
+    GArray * entries);
+void gst_matroska_read_common_free_retired_index (GstMatroskaReadCommon *
+    common);
+void gst_matroska_read_common_clear_deferred_index (GstMatroskaReadCommon *
+    common);
 GstFlowReturn gst_matroska_read_common_parse_info (GstMatroskaReadCommon *
     common, GstElement * el, GstEbmlRead * ebml);
 GstFlowReturn gst_matroska_read_common_parse_attachments (
@@ -128,6 +175,11 @@ GstFlowReturn gst_matroska_read_common_parse_skip (GstMatroskaReadCommon *
     common, GstEbmlRead * ebml, const gchar * parent_name, guint id);
 GstFlowReturn gst_matroska_read_common_peek_bytes (GstMatroskaReadCommon *
     common, guint64 offset, guint size, GstBuffer ** p_buf, guint8 ** bytes);
+void gst_matroska_read_common_free_cache (GstMatroskaReadCommon * common);
+void gst_matroska_read_common_start_prefetch (GstMatroskaReadCommon * common);
+void gst_matroska_read_common_stop_prefetch (GstMatroskaReadCommon * common);
+void gst_matroska_read_common_reset_read_ahead (GstMatroskaReadCommon *
+    common);
 GstFlowReturn gst_matroska_read_common_peek_id_length_pull (GstMatroskaReadCommon *
     common, GstElement * el, guint32 * _id, guint64 * _length, guint *
     _needed);